@@ -0,0 +1,77 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+/*
+    IR 节点的 bump 分配器：指令、操作数、基本块、函数、符号表项和类型都从
+    当前线程的 arena 中分配，依次建立的节点在内存中相邻。
+    arena 拥有其中的所有节点：显式 delete 立即析构并把节点标记为已释放；
+    release() 析构其余节点后再归还 chunk，期间 isFinalizing() 为真，
+    析构函数只释放自身成员，不再访问其他节点。节点类须单继承 ArenaNode。
+*/
+class Arena
+{
+public:
+    enum Kind
+    {
+        INSTRUCTION,
+        OPERAND,
+        BASICBLOCK,
+        FUNCTION,
+        SYMBOLENTRY,
+        TYPE,
+        NUM_KINDS
+    };
+
+    explicit Arena(size_t chunkSize = 64 * 1024);
+    ~Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    typedef void (*Destroy)(void *);
+    void *allocate(size_t size, Kind kind, Destroy destroy);
+    static void forget(void *node); // 节点已被显式 delete，release 时不再析构
+    void release();                 // 析构仍存活的节点，再一次性释放所有 chunk
+    size_t getBytes(Kind kind) const { return bytes[kind]; };
+    size_t getCount(Kind kind) const { return count[kind]; };
+    size_t getReserved() const { return reserved; };
+    void report(FILE *out) const; // 按节点种类输出内存占用
+
+    // 当前线程上新建 IR 节点所使用的 arena；未设置时退回到线程私有的默认 arena
+    static Arena *current();
+    static void setCurrent(Arena *arena) { active = arena; };
+    // 当前线程是否正在 release 中统一析构节点
+    static bool isFinalizing() { return finalizing; };
+
+private:
+    void *track(char *block, Destroy destroy); // 在 block 开头写入头部，返回其后的节点地址
+
+    std::vector<char *> chunks;
+    char *cur;
+    char *end;
+    size_t chunkSize;
+    size_t reserved;
+    size_t bytes[NUM_KINDS];
+    size_t count[NUM_KINDS];
+    std::vector<void *> nodes; // 按分配顺序记录的节点，其前面是记录析构函数的头部
+    static thread_local Arena *active;
+    static thread_local bool finalizing;
+};
+
+// 继承该类的 IR 节点通过 new 时从当前 arena 中分配，delete 只析构不释放内存。
+// Node 是该种节点的根类，release 时通过它的（虚）析构函数析构
+template <Arena::Kind K, class Node>
+class ArenaNode
+{
+public:
+    static void *operator new(size_t size) { return Arena::current()->allocate(size, K, &destroy); };
+    static void operator delete(void *p) { Arena::forget(p); };
+
+private:
+    static void destroy(void *p) { static_cast<Node *>(static_cast<ArenaNode *>(p))->~Node(); };
+};
+
+#endif
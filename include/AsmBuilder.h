@@ -12,6 +12,7 @@ private:
     MachineBlock* mBlock; // current machine code block;
     int cmpOpcode; // CmpInstruction opcode, for CondInstruction;
 public:
+    AsmBuilder() : mUnit(nullptr), mFunction(nullptr), mBlock(nullptr), cmpOpcode(0) {};
     void setUnit(MachineUnit* unit) { this->mUnit = unit; };
     void setFunction(MachineFunction* func) { this->mFunction = func; };
     void setBlock(MachineBlock* block) { this->mBlock = block; };
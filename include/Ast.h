@@ -13,18 +13,19 @@ class IRBuilder;
 class Node
 {
 private:
-    static int counter;
+    static thread_local int counter;
     int seq;
 
 protected:
     std::vector<Instruction *> true_list;
     std::vector<Instruction *> false_list;
-    static IRBuilder *builder;
+    static thread_local IRBuilder *builder;
     void backPatch(std::vector<Instruction *> &list, BasicBlock *bb);
     std::vector<Instruction *> merge(std::vector<Instruction *> &list1, std::vector<Instruction *> &list2);
 
 public:
     static void setIRBuilder(IRBuilder *ib) { builder = ib; };
+    static void resetCounter() { counter = 0; };
 
     Node *next;
     Node();
@@ -45,7 +46,7 @@ protected:
 
 public:
     Operand *dst; // The result of the subtree is stored into dst.
-    ExprNode(SymbolEntry *symbolEntry) : symbolEntry(symbolEntry) {};
+    ExprNode(SymbolEntry *symbolEntry) : symbolEntry(symbolEntry), dst(nullptr) {};
     SymbolEntry *getSymbolEntry() const
     {
         return symbolEntry;
@@ -60,7 +61,7 @@ public:
     void genCode();
     // reference
     bool cbcai = false;
-    int cbcaivalue;
+    int cbcaivalue = 0;
     void toBool(Function *func);
     virtual int getValue() { return -1; };
 
@@ -235,7 +236,7 @@ private:
     bool isParam;
 
 public:
-    DeclStmt(Id *id, ExprNode *expr = nullptr) : id(id), expr(expr) {};
+    DeclStmt(Id *id, ExprNode *expr = nullptr) : id(id), expr(expr), isParam(false) {};
     void output(int level);
     Id *getId() { return id; }
     void typeCheck();
@@ -290,7 +291,7 @@ private:
     Type *retType;
 
 public:
-    ReturnStmt(ExprNode *retValue) : retValue(retValue) {};
+    ReturnStmt(ExprNode *retValue) : retValue(retValue), retType(nullptr) {};
     void output(int level);
     void typeCheck();
     void genCode();
@@ -4,10 +4,11 @@
 #include <set>
 #include "Instruction.h"
 #include "AsmBuilder.h"
+#include "Arena.h"
 
 class Function;
 
-class BasicBlock
+class BasicBlock : public ArenaNode<Arena::BASICBLOCK, BasicBlock>
 {
     typedef std::vector<BasicBlock *>::iterator bb_iterator;
 
@@ -42,6 +43,8 @@ public:
     bb_iterator succ_end() { return succ.end(); };
     bb_iterator pred_begin() { return pred.begin(); };
     bb_iterator pred_end() { return pred.end(); };
+    std::vector<BasicBlock *> &getPreds() { return pred; };
+    std::vector<BasicBlock *> &getSuccs() { return succ; };
     int getNumOfPred() const { return pred.size(); };
     int getNumOfSucc() const { return succ.size(); };
     void genMachineCode(AsmBuilder*);
@@ -0,0 +1,109 @@
+#ifndef __BITVECTOR_H__
+#define __BITVECTOR_H__
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+    数据流分析使用的定长位向量，按 64 位字运算；
+    原地运算返回结果是否改变，迭代求不动点时不必保留旧值。
+*/
+class BitVector
+{
+private:
+    std::vector<uint64_t> words;
+    size_t nbits;
+
+public:
+    BitVector(size_t n = 0) : words((n + 63) / 64, 0), nbits(n){};
+    void resize(size_t n)
+    {
+        nbits = n;
+        words.assign((n + 63) / 64, 0);
+    };
+    size_t size() const { return nbits; };
+    void clear()
+    {
+        for (auto &w : words)
+            w = 0;
+    };
+    void set(size_t i) { words[i >> 6] |= (uint64_t)1 << (i & 63); };
+    void reset(size_t i) { words[i >> 6] &= ~((uint64_t)1 << (i & 63)); };
+    bool test(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; };
+    bool any() const
+    {
+        for (auto w : words)
+            if (w)
+                return true;
+        return false;
+    };
+    size_t count() const
+    {
+        size_t n = 0;
+        for (auto w : words)
+            n += __builtin_popcountll(w);
+        return n;
+    };
+
+    // this |= other，返回是否有变化
+    bool unionWith(const BitVector &other)
+    {
+        uint64_t changed = 0;
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            uint64_t w = words[i] | other.words[i];
+            changed |= w ^ words[i];
+            words[i] = w;
+        }
+        return changed != 0;
+    };
+    // this &= other
+    void intersectWith(const BitVector &other)
+    {
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= other.words[i];
+    };
+    // this = gen | (in & ~kill)，返回是否有变化
+    bool assignTransfer(const BitVector &gen, const BitVector &in, const BitVector &kill)
+    {
+        uint64_t changed = 0;
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            uint64_t w = gen.words[i] | (in.words[i] & ~kill.words[i]);
+            changed |= w ^ words[i];
+            words[i] = w;
+        }
+        return changed != 0;
+    };
+    void subtract(const BitVector &other)
+    {
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= ~other.words[i];
+    };
+    bool operator==(const BitVector &other) const { return nbits == other.nbits && words == other.words; };
+    bool operator!=(const BitVector &other) const { return !(*this == other); };
+
+    // 依次访问被置位的下标：for (int i = bv.findFirst(); i >= 0; i = bv.findNext(i))
+    int findFirst() const { return findFrom(0); };
+    int findNext(int prev) const { return findFrom(prev + 1); };
+
+private:
+    int findFrom(size_t i) const
+    {
+        if (i >= nbits)
+            return -1;
+        size_t w = i >> 6;
+        uint64_t bits = words[w] & (~(uint64_t)0 << (i & 63));
+        while (true)
+        {
+            if (bits)
+                return (int)(w * 64 + __builtin_ctzll(bits));
+            if (++w >= words.size())
+                return -1;
+            bits = words[w];
+        }
+    };
+};
+
+#endif
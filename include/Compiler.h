@@ -0,0 +1,54 @@
+#ifndef __COMPILER_H__
+#define __COMPILER_H__
+
+#include <string>
+#include "common.h"
+
+class OutputStream;
+
+/*
+    libsysyc：以库的形式使用编译器。compile() 从内存读入源程序，结果保存在
+    getOutput() 或写入调用者给出的 OutputStream，-M/-P/-R/-ftime-report 的报告
+    在 getReport() 中。编译状态都属于 Compiler 或调用线程，多个线程可以各自编译；
+    语义错误仍输出到 stderr，compile() 返回 false。
+*/
+struct CompileOptions
+{
+    dump_type_t dumpType = ASM;
+    int optLevel = 2;
+    bool graphColoring = false;
+    bool memReport = false;
+    bool optReport = false;
+    bool raReport = false;
+    // 指令选择和寄存器分配按函数并行的线程数，1 为在调用线程上顺序执行，0 为硬件线程数
+    unsigned threads = 1;
+    // 函数缓存的目录，为空时不使用缓存；cacheSize 是目录大小的上限，字节
+    std::string cacheDir;
+    size_t cacheSize = 64 << 20;
+    bool cacheReport = false;
+    enum { NO_REPORT, TEXT_REPORT, JSON_REPORT } timeReport = NO_REPORT;
+};
+
+class Compiler
+{
+private:
+    CompileOptions options;
+    std::string output;
+    std::string report;
+
+public:
+    explicit Compiler(const CompileOptions &options = CompileOptions()) : options(options) {};
+    bool compile(const char *source, size_t length);
+    bool compile(const std::string &source) { return compile(source.data(), source.size()); };
+    // 结果直接写到 out（文件、内存或 mmap 映射的文件），不保存在 getOutput() 中
+    bool compile(const char *source, size_t length, OutputStream &out);
+    const std::string &getOutput() const { return output; };
+    const std::string &getReport() const { return report; };
+};
+
+// 报错处已把错误信息写到 stderr，抛出后由 Compiler::compile 捕获，本次编译失败
+struct CompileError
+{
+};
+
+#endif
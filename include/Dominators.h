@@ -0,0 +1,344 @@
+#ifndef __DOMINATORS_H__
+#define __DOMINATORS_H__
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+/*
+    控制流图上的支配树、支配边界和循环嵌套分析。BlockT 只需提供返回
+    std::vector<BlockT *> 的 getPreds()/getSuccs()，IR 和机器代码共用。
+    结果是快照，修改 CFG 后要调用 invalidateAnalyses()。
+*/
+
+// Cooper-Harvey-Kennedy：结点按逆后序编号，0 号为根，preds[i] 为 i 的前驱编号
+inline std::vector<int> computeIdoms(const std::vector<std::vector<int>> &preds)
+{
+    int n = preds.size();
+    std::vector<int> idom(n, -1);
+    if (n == 0)
+        return idom;
+    idom[0] = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int b = 1; b < n; b++)
+        {
+            int newIdom = -1;
+            for (int p : preds[b])
+            {
+                if (idom[p] == -1)
+                    continue;
+                if (newIdom == -1)
+                {
+                    newIdom = p;
+                    continue;
+                }
+                int x = p, y = newIdom;
+                while (x != y)
+                {
+                    while (x > y)
+                        x = idom[x];
+                    while (y > x)
+                        y = idom[y];
+                }
+                newIdom = x;
+            }
+            if (newIdom != -1 && idom[b] != newIdom)
+            {
+                idom[b] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+template <class BlockT>
+class DominatorTree
+{
+private:
+    std::vector<BlockT *> order; // 从入口可达的块，逆后序
+    std::unordered_map<BlockT *, int> index;
+    std::vector<int> idom;
+    std::vector<std::vector<BlockT *>> children;
+    std::vector<std::vector<BlockT *>> frontier;
+    std::vector<int> pre, post; // 支配树上的先序/后序编号，用于 O(1) 判断支配关系
+    std::vector<int> ipdom;     // 反向图上的直接后支配者，-1 为虚拟出口或不存在
+
+    void computeOrder(BlockT *entry)
+    {
+        std::vector<std::pair<BlockT *, size_t>> stack;
+        std::unordered_set<BlockT *> visited;
+        stack.push_back({entry, 0});
+        visited.insert(entry);
+        while (!stack.empty())
+        {
+            auto &top = stack.back();
+            auto &succs = top.first->getSuccs();
+            if (top.second < succs.size())
+            {
+                BlockT *succ = succs[top.second++];
+                if (visited.insert(succ).second)
+                    stack.push_back({succ, 0});
+            }
+            else
+            {
+                order.push_back(top.first);
+                stack.pop_back();
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        for (size_t i = 0; i < order.size(); i++)
+            index[order[i]] = i;
+    }
+
+    void computeDomTree()
+    {
+        int n = order.size();
+        std::vector<std::vector<int>> preds(n);
+        for (int b = 0; b < n; b++)
+            for (auto pred : order[b]->getPreds())
+                if (index.count(pred))
+                    preds[b].push_back(index[pred]);
+        idom = computeIdoms(preds);
+        children.assign(n, {});
+        for (int b = 1; b < n; b++)
+            children[idom[b]].push_back(order[b]);
+
+        pre.assign(n, 0);
+        post.assign(n, 0);
+        int clock = 0;
+        std::vector<std::pair<int, size_t>> stack = {{0, 0}};
+        pre[0] = clock++;
+        while (!stack.empty())
+        {
+            auto &top = stack.back();
+            if (top.second < children[top.first].size())
+            {
+                int child = index[children[top.first][top.second++]];
+                pre[child] = clock++;
+                stack.push_back({child, 0});
+            }
+            else
+            {
+                post[top.first] = clock++;
+                stack.pop_back();
+            }
+        }
+
+        frontier.assign(n, {});
+        for (int b = 0; b < n; b++)
+        {
+            if (preds[b].size() < 2)
+                continue;
+            for (int runner : preds[b])
+                while (runner != idom[b])
+                {
+                    auto &df = frontier[runner];
+                    if (df.empty() || df.back() != order[b])
+                        df.push_back(order[b]);
+                    runner = idom[runner];
+                }
+        }
+    }
+
+    // 反向图加一个虚拟出口（编号 0），它连向所有没有后继的块
+    void computePostDomTree()
+    {
+        int n = order.size();
+        std::vector<std::vector<int>> rsuccs(n + 1);
+        for (int b = 0; b < n; b++)
+        {
+            if (order[b]->getSuccs().empty())
+                rsuccs[0].push_back(b + 1);
+            for (auto pred : order[b]->getPreds())
+                if (index.count(pred))
+                    rsuccs[b + 1].push_back(index[pred] + 1);
+        }
+        std::vector<int> rorder, rindex(n + 1, -1);
+        std::vector<std::pair<int, size_t>> stack = {{0, 0}};
+        std::vector<bool> visited(n + 1, false);
+        visited[0] = true;
+        while (!stack.empty())
+        {
+            auto &top = stack.back();
+            if (top.second < rsuccs[top.first].size())
+            {
+                int succ = rsuccs[top.first][top.second++];
+                if (!visited[succ])
+                {
+                    visited[succ] = true;
+                    stack.push_back({succ, 0});
+                }
+            }
+            else
+            {
+                rorder.push_back(top.first);
+                stack.pop_back();
+            }
+        }
+        std::reverse(rorder.begin(), rorder.end());
+        for (size_t i = 0; i < rorder.size(); i++)
+            rindex[rorder[i]] = i;
+        std::vector<std::vector<int>> rpreds(rorder.size());
+        for (int u = 0; u <= n; u++)
+        {
+            if (rindex[u] == -1)
+                continue;
+            for (int v : rsuccs[u])
+                rpreds[rindex[v]].push_back(rindex[u]);
+        }
+        auto ridom = computeIdoms(rpreds);
+        ipdom.assign(n, -1);
+        for (size_t i = 1; i < rorder.size(); i++)
+        {
+            int node = rorder[ridom[i]];
+            ipdom[rorder[i] - 1] = node == 0 ? -1 : node - 1;
+        }
+    }
+
+public:
+    DominatorTree(BlockT *entry)
+    {
+        computeOrder(entry);
+        computeDomTree();
+        computePostDomTree();
+    };
+    const std::vector<BlockT *> &getOrder() const { return order; };
+    bool isReachable(BlockT *bb) const { return index.count(bb) != 0; };
+    BlockT *getRoot() const { return order[0]; };
+    // 入口块和不可达块返回 nullptr
+    BlockT *getIdom(BlockT *bb) const
+    {
+        auto it = index.find(bb);
+        if (it == index.end() || it->second == 0)
+            return nullptr;
+        return order[idom[it->second]];
+    };
+    const std::vector<BlockT *> &getChildren(BlockT *bb) const { return children[index.at(bb)]; };
+    const std::vector<BlockT *> &getFrontier(BlockT *bb) const { return frontier[index.at(bb)]; };
+    // a 支配 b（自反）；不可达块不被任何块支配
+    bool dominates(BlockT *a, BlockT *b) const
+    {
+        auto ia = index.find(a), ib = index.find(b);
+        if (ia == index.end() || ib == index.end())
+            return false;
+        return pre[ia->second] <= pre[ib->second] && post[ib->second] <= post[ia->second];
+    };
+    // 直接后支配者；以函数出口为直接后支配者或无法到达出口时返回 nullptr
+    BlockT *getIpdom(BlockT *bb) const
+    {
+        auto it = index.find(bb);
+        if (it == index.end() || ipdom[it->second] == -1)
+            return nullptr;
+        return order[ipdom[it->second]];
+    };
+    bool postDominates(BlockT *a, BlockT *b) const
+    {
+        for (BlockT *cur = b; cur != nullptr; cur = getIpdom(cur))
+            if (cur == a)
+                return true;
+        return false;
+    };
+};
+
+template <class BlockT>
+class LoopInfo
+{
+public:
+    // 自然循环：同一头结点的所有回边合并为一个循环
+    struct Loop
+    {
+        BlockT *header;
+        Loop *parent;                   // 外层循环，最外层为 nullptr
+        int depth;                      // 最外层循环深度为 1
+        std::vector<BlockT *> blocks;   // 按逆后序排列，含内层循环的块
+        std::vector<BlockT *> latches;  // 回边的源块
+        std::vector<Loop *> subLoops;
+        std::unordered_set<BlockT *> blockSet;
+        bool contains(BlockT *bb) const { return blockSet.count(bb) != 0; };
+        bool contains(const Loop *other) const
+        {
+            for (; other != nullptr; other = other->parent)
+                if (other == this)
+                    return true;
+            return false;
+        };
+    };
+
+private:
+    std::vector<Loop *> loops; // 外层循环排在内层之前
+    std::vector<Loop *> topLevel;
+    std::unordered_map<BlockT *, Loop *> innermost;
+
+public:
+    LoopInfo(const DominatorTree<BlockT> &dt)
+    {
+        auto &order = dt.getOrder();
+        std::unordered_map<BlockT *, int> rpo;
+        for (size_t i = 0; i < order.size(); i++)
+            rpo[order[i]] = i;
+        // 外层循环的头结点支配内层循环的头结点，按逆后序处理即可先外后内
+        for (auto header : order)
+        {
+            std::vector<BlockT *> latches;
+            for (auto pred : header->getPreds())
+                if (dt.dominates(header, pred))
+                    latches.push_back(pred);
+            if (latches.empty())
+                continue;
+            Loop *loop = new Loop();
+            loop->header = header;
+            loop->latches = latches;
+            loop->blockSet.insert(header);
+            std::vector<BlockT *> worklist = latches;
+            while (!worklist.empty())
+            {
+                BlockT *bb = worklist.back();
+                worklist.pop_back();
+                if (!loop->blockSet.insert(bb).second)
+                    continue;
+                for (auto pred : bb->getPreds())
+                    if (dt.isReachable(pred))
+                        worklist.push_back(pred);
+            }
+            loop->blocks.assign(loop->blockSet.begin(), loop->blockSet.end());
+            std::sort(loop->blocks.begin(), loop->blocks.end(),
+                      [&](BlockT *a, BlockT *b) { return rpo[a] < rpo[b]; });
+            auto it = innermost.find(header);
+            loop->parent = it == innermost.end() ? nullptr : it->second;
+            loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+            if (loop->parent)
+                loop->parent->subLoops.push_back(loop);
+            else
+                topLevel.push_back(loop);
+            for (auto bb : loop->blocks)
+                innermost[bb] = loop;
+            loops.push_back(loop);
+        }
+    };
+    ~LoopInfo()
+    {
+        for (auto loop : loops)
+            delete loop;
+    };
+    LoopInfo(const LoopInfo &) = delete;
+    LoopInfo &operator=(const LoopInfo &) = delete;
+    const std::vector<Loop *> &getLoops() const { return loops; };
+    const std::vector<Loop *> &getTopLevelLoops() const { return topLevel; };
+    Loop *getLoopFor(BlockT *bb) const
+    {
+        auto it = innermost.find(bb);
+        return it == innermost.end() ? nullptr : it->second;
+    };
+    int getLoopDepth(BlockT *bb) const
+    {
+        Loop *loop = getLoopFor(bb);
+        return loop ? loop->depth : 0;
+    };
+};
+
+#endif
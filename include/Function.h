@@ -8,10 +8,12 @@
 #include <iostream>
 #include "BasicBlock.h"
 #include "SymbolTable.h"
+#include "Arena.h"
+#include "Dominators.h"
 
 class Unit;
 
-class Function
+class Function : public ArenaNode<Arena::FUNCTION, Function>
 {
     typedef std::vector<BasicBlock *>::iterator iterator;
     typedef std::vector<BasicBlock *>::reverse_iterator reverse_iterator;
@@ -21,7 +23,9 @@ private:
     SymbolEntry *sym_ptr;
     BasicBlock *entry;
     Unit *parent;
-    std::vector<SymbolEntry *> paramsSymPtr;
+    std::vector<Operand *> params; // 形参的值
+    DominatorTree<BasicBlock> *domTree;  // 按需计算并缓存，CFG 改变后须调用 invalidateAnalyses
+    LoopInfo<BasicBlock> *loopInfo;
 
 public:
     Function(Unit *, SymbolEntry *);
@@ -30,15 +34,26 @@ public:
     BasicBlock *getEntry() { return entry; };
     void remove(BasicBlock *bb);
     void output() const;
+    void printHeader(OutputStream &out) const; // 输出函数定义头，不含 " {"
     std::vector<BasicBlock *> &getBlockList() { return block_list; }; // 基本块列表的引用
     iterator begin() { return block_list.begin(); };
     iterator end() { return block_list.end(); };
     reverse_iterator rbegin() { return block_list.rbegin(); };
     reverse_iterator rend() { return block_list.rend(); };
     SymbolEntry *getSymPtr() { return sym_ptr; };
-    void addParam(SymbolEntry *se) { paramsSymPtr.push_back(se); }
-void dfs1(BasicBlock *block, std::set<BasicBlock *> &v) const;
+    void addParam(Operand *param) { params.push_back(param); }
+    void dfs1(BasicBlock *block, std::set<BasicBlock *> &v) const;
     void genMachineCode(AsmBuilder*);
+    // 缓存的分析，PassManager 按 Pass::getPreserved 作废其余的
+    enum
+    {
+        DOM_TREE = 1,
+        LOOP_INFO = 2,
+        ALL_ANALYSES = DOM_TREE | LOOP_INFO
+    };
+    DominatorTree<BasicBlock> &getDomTree();
+    LoopInfo<BasicBlock> &getLoopInfo();
+    void invalidateAnalyses(unsigned preserved = 0);
 
 };
 
@@ -0,0 +1,41 @@
+#ifndef __FUNCTIONCACHE_H__
+#define __FUNCTIONCACHE_H__
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Function;
+class MachineFunction;
+
+/*
+    按函数缓存生成的汇编，存放在磁盘目录中。键是指令选择前的函数 IR，
+    临时变量和基本块按出现顺序重新编号，并带上编译器版本和影响代码的选项；
+    命中时跳过指令选择和寄存器分配。每项一个文件，以键的 FNV-1a 散列命名，
+    文件中保存完整的键，散列冲突只算未命中。超过大小上限时 evict() 删除最久未用的项。
+    lookup()/store() 可以多线程调用，写临时文件后改名，多个进程可共用目录。
+*/
+class FunctionCache
+{
+private:
+    std::string dir;
+    size_t capacity; // 缓存目录的大小上限，字节
+    std::string salt; // 编译器版本和影响代码生成的选项
+    std::atomic<int> hits, misses, stores, evictions;
+    size_t entries, bytes; // 最近一次 evict() 后目录中的条目数和总大小
+
+    std::string pathOf(const std::string &key) const;
+
+public:
+    FunctionCache(const std::string &dir, size_t capacity, const std::string &options);
+    std::string makeKey(Function *func) const;
+    // 命中时 text 为可以直接输出的汇编
+    bool lookup(const std::string &key, Function *func, std::string &text);
+    // 保存已完成寄存器分配的函数，键在指令选择时记录在 func 中
+    void store(MachineFunction *func);
+    void evict();
+    void printStats(FILE *out) const;
+};
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * iterated register coalescing (George & Appel)
+ */
+
+#ifndef _GRAPHCOLORING_H__
+#define _GRAPHCOLORING_H__
+#include <set>
+#include <vector>
+#include <unordered_set>
+
+class MachineUnit;
+class MachineOperand;
+class MachineFunction;
+class MachineInstruction;
+class ThreadPool;
+
+/*
+    图着色寄存器分配，可在 main.cpp 中用 -C 代替 LinearScan。
+    结点编号沿用 MachineFunction::getLiveIndex：0~15 为预着色的物理寄存器，其后为虚拟寄存器。
+    除 r4-r10 外还使用 r0-r3，这样参数传递、返回值以及 zext 产生的 mov 都可以被合并掉；
+    bl 的隐式定值会让跨越调用的虚拟寄存器与 r0-r3 冲突，从而只能分到被调用者保存的寄存器。
+*/
+class GraphColoring
+{
+private:
+    struct Move
+    {
+        MachineInstruction *inst;
+        int dst;
+        int src;
+        int state;
+    };
+    enum
+    {
+        PRECOLORED,
+        INITIAL,
+        SIMPLIFY,
+        FREEZE,
+        SPILL,
+        SPILLED,
+        COALESCED,
+        COLORED,
+        SELECTED
+    }; // 结点所在的工作表
+    enum
+    {
+        MOVE_COALESCED,
+        MOVE_CONSTRAINED,
+        MOVE_FROZEN,
+        MOVE_WORKLIST,
+        MOVE_ACTIVE
+    }; // 传送指令所在的集合
+
+    MachineUnit *unit;
+    MachineFunction *func;
+    std::vector<int> regs; // 可分配的物理寄存器
+    int K;
+    int n; // 结点数目
+
+    std::unordered_set<long long> adjSet;
+    std::vector<std::vector<int>> adjList;
+    std::vector<int> degree;
+    std::vector<int> alias;
+    std::vector<int> color;
+    std::vector<int> nodeState;
+    std::vector<std::vector<int>> moveList; // 与结点相关的传送指令下标
+    std::vector<Move> moves;
+    std::vector<std::vector<MachineOperand *>> defs, uses; // 每个虚拟寄存器的定值与使用
+    std::vector<double> spillWeight;                      // 按循环深度加权的定值/使用次数
+    std::set<int> spillTemps;                             // 溢出代码中新建的虚拟寄存器，不再溢出
+
+    std::vector<int> simplifyWorklist;
+    std::set<int> freezeWorklist;
+    std::set<int> spillWorklist;
+    std::vector<int> selectStack;
+    std::set<int> worklistMoves;
+    std::set<int> activeMoves;
+    std::vector<int> spilledNodes;
+
+    bool isPrecolored(int u) const { return nodeState[u] == PRECOLORED; };
+    bool isAllocatable(int reg) const;
+    void addEdge(int u, int v);
+    bool adjacent(int u, int v) const;
+    std::vector<int> adjacentNodes(int u) const;
+    std::vector<int> nodeMoves(int u) const;
+    bool moveRelated(int u) const { return !nodeMoves(u).empty(); };
+
+    void build();
+    void makeWorklist();
+    void simplify();
+    void decrementDegree(int m);
+    void enableMoves(int u);
+    void coalesce();
+    void addWorkList(int u);
+    bool ok(int t, int r) const;
+    bool conservative(const std::vector<int> &nodes) const;
+    int getAlias(int u) const;
+    void combine(int u, int v);
+    void freeze();
+    void freezeMoves(int u);
+    void selectSpill();
+    bool onlySpillTemps(int u);
+    bool assignColors(); // 有结点既没有颜色也没有溢出时返回 false
+    void insertSpillLoad(MachineInstruction *inst, int vreg, int off); // 在 inst 之前从栈槽 off 装入 vreg
+    void rewriteProgram();
+    void modifyCode();
+    bool allocate(); // 一轮分配，成功返回 true
+    void allocateFunction(MachineFunction *f);
+
+public:
+    GraphColoring(MachineUnit *unit);
+    void allocateRegisters(ThreadPool *pool = nullptr); // pool 非空时各函数并行分配
+};
+
+#endif
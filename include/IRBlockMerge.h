@@ -2,14 +2,33 @@
 #define _BLOCKMERGE_H
 #include "Instruction.h"
 #include "Type.h"
-#include "Unit.h"
+#include "PassManager.h"
 #include <set>
+#include <string>
 #include <unordered_set>
 
-class BlockMerge {
+/*
+    控制流图化简，反复执行以下变换直到不再变化：
+    删除不可达块；两个目标相同的条件跳转改为无条件跳转；
+    只含一条无条件跳转的空块让前驱直接跳到它的目标；
+    唯一前驱以无条件跳转进入的块并入前驱。
+    跳到布局上下一个块的 b 由寄存器分配后的 MachinePeephole（fallthrough）删除。
+*/
+class BlockMerge : public FunctionPass {
     Unit *unit;
     std::vector<BasicBlock *> mergeList;
-    void findBLocks(Function *func);
+    std::unordered_set<BasicBlock *> deleted;
+    struct Stats
+    {
+        int removed = 0, folded = 0, forwarded = 0, merged = 0;
+    };
+    std::vector<std::pair<std::string, Stats>> stats;
+    Stats cur;
+
+    bool removeUnreachable(Function *func);
+    bool foldBranches(Function *func);
+    bool forwardEmptyBlocks(Function *func);
+    bool findBLocks(Function *func);
     void merge(Function*func,BasicBlock *start);
     void replacePhiBB(BasicBlock* succ,BasicBlock* start);
     void printInsts(BasicBlock* start);
@@ -17,7 +36,9 @@ class BlockMerge {
 
   public:
     BlockMerge(Unit *_unit) : unit(_unit) {}
-    void execute();
+    const char *getName() const { return "simplifycfg"; }
+    bool runOnFunction(Function *func);
+    void printStats(FILE *out);
 };
 
-#endif
\ No newline at end of file
+#endif
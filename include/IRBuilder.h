@@ -14,7 +14,7 @@ private:
   std::vector<Instruction *> while_false_list;
 
 public:
-  IRBuilder(Unit *unit) : unit(unit) {};
+  IRBuilder(Unit *unit) : unit(unit), insertBB(nullptr) {};
   void setInsertBB(BasicBlock *bb) { insertBB = bb; };
   Unit *getUnit() { return unit; };
   BasicBlock *getInsertBB() { return insertBB; };
@@ -1,35 +1,57 @@
 #ifndef __IRCOMSUBEXPRELIM_H__
 #define __IRCOMSUBEXPRELIM_H__
 
-#include "Unit.h"
+#include "PassManager.h"
+#include "BitVector.h"
+#include <string>
+#include <cstdint>
+#include <unordered_map>
 
 struct Expr
 {
     Instruction *inst;
-    Expr(Instruction *inst) : inst(inst){};
-    // 用于调用find函数
+    unsigned kind;     // 指令类型
+    unsigned opcode;
+    uintptr_t ops[2];  // 操作数的标识：常量按值，其余按 Operand 指针
+    int nops;
+    Expr(Instruction *inst);
+    // 两个表达式相同 <==> 指令类型、操作码和操作数均相同（可交换的运算已规范化操作数顺序）
     bool operator==(const Expr &other) const
     {
-        // TODO: 判断两个表达式是否相同
-        // 两个表达式相同 <==> 两个表达式对应的指令的类型和操作数均相同
-        return false;
+        return kind == other.kind && opcode == other.opcode && nops == other.nops &&
+               ops[0] == other.ops[0] && ops[1] == other.ops[1];
     };
 };
 
-class IRComSubExprElim
+struct ExprHash
+{
+    size_t operator()(const Expr &e) const
+    {
+        size_t h = e.kind * 31 + e.opcode;
+        h = h * 1000003 ^ std::hash<uintptr_t>()(e.ops[0]);
+        h = h * 1000003 ^ std::hash<uintptr_t>()(e.ops[1]);
+        return h;
+    };
+};
+
+class IRComSubExprElim : public FunctionPass
 {
 private:
     Unit *unit;
 
-    std::vector<Expr> exprVec;
-    std::map<Instruction *, int> ins2Expr;
-    std::map<BasicBlock *, std::set<int>> genBB;
-    std::map<BasicBlock *, std::set<int>> killBB;
-    std::map<BasicBlock *, std::set<int>> inBB;
-    std::map<BasicBlock *, std::set<int>> outBB;
+    std::vector<Expr> exprVec;                          // 编号 -> 表达式
+    std::unordered_map<Expr, int, ExprHash> expr2Id;    // 表达式 -> 编号
+    std::unordered_map<Instruction *, int> ins2Expr;
+    std::unordered_map<BasicBlock *, BitVector> genBB;
+    std::unordered_map<BasicBlock *, BitVector> inBB;
+    std::unordered_map<BasicBlock *, BitVector> outBB;
+    std::unordered_map<BasicBlock *, std::unordered_map<int, Instruction *>> leaderBB; // 块内计算该表达式的指令
+    std::vector<std::pair<std::string, int>> stats;     // 每个函数消除的指令数
+    int removed;
 
     // 跳过无需分析的指令
     bool skip(Instruction *);
+    void replace(Instruction *inst, Instruction *leader);
 
     // 局部公共子表达式消除
     bool localCSE(Function *);
@@ -43,7 +65,10 @@ private:
 public:
     IRComSubExprElim(Unit *unit);
     ~IRComSubExprElim();
-    void pass();
+    const char *getName() const { return "cse"; };
+    unsigned getPreserved() const { return Function::ALL_ANALYSES; }; // 只删除指令，不改变 CFG
+    bool runOnFunction(Function *);
+    void printStats(FILE *out);
 };
 
-#endif
\ No newline at end of file
+#endif
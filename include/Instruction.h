@@ -3,13 +3,14 @@
 
 #include "Operand.h"
 #include "AsmBuilder.h"
+#include "Arena.h"
 #include <vector>
 #include <map>
 #include <sstream>
 
 class BasicBlock;
 
-class Instruction
+class Instruction : public ArenaNode<Arena::INSTRUCTION, Instruction>
 {
 public:
     Instruction(unsigned instType, BasicBlock *insert_bb = nullptr);
@@ -22,32 +23,67 @@ public:
     bool isLoad() const { return instType == LOAD; }
     bool isRet() const { return instType == RET; };
     bool isAlloc() const { return instType == ALLOCA; };
+    bool isPhi() const { return instType == PHI; };
+    bool isBinary() const { return instType == BINARY; };
+    bool isCmp() const { return instType == CMP; };
+    bool isCall() const { return instType == FUNCTIONCALL; };
+    bool isXor() const { return instType == XOR; };
+    bool isUnary() const { return instType == UNARY; };
+    bool isZext() const { return instType == ZEXT; };
+    bool isToBool() const { return instType == TOBOOL; };
+    // 除调用、访存和控制流之外的计算指令，结果只取决于操作数。
+    // GepInstruction 只有声明，没有实现也不会生成（数组尚未支持），所以不在其中
+    bool isPure() const
+    {
+        return instType == BINARY || instType == UNARY || instType == CMP || instType == ZEXT ||
+               instType == XOR || instType == TYPECONVER || instType == CAST || instType == TOBOOL;
+    };
+    unsigned getOpcode() const { return opcode; };
+    unsigned getInstType() const { return instType; };
+    // 条件跳转在机器代码中直接读取前面 cmp 留下的标志位；xor 生成 eor、逻辑非自己比较，都不读标志位
+    bool readsFlags() const;
+    // 结果被 readsFlags() 的指令直接或经过 xor 使用的 cmp，以及中间的 xor，不能移走，也不能换成别处的
+    bool isFlagSource();
+    // cmp、tobool 或 xor 的结果只被条件跳转直接用作条件，不必再把 0/1 写进寄存器
+    bool isFusedIntoBranch();
+    bool isCopy() const { return instType == COPY; };
     void setParent(BasicBlock *);
     void setNext(Instruction *);
     void setPrev(Instruction *);
     Instruction *getNext();
     Instruction *getPrev();
+    // 把本指令中对 oldOp 的使用改为 newOp，定值槽位不受影响
     void replaceUse(Operand *oldOp, Operand *newOp)
     {
-        for (size_t i = 0; i < operands.size(); ++i)
-        {
-            if (operands[i] == oldOp)
-            {
-                operands[i] = newOp;
-                // oldOp->removeUse(this);//wwwww
-                newOp->addUse(this);
-            }
-        }
-        fprintf(stderr, "replaceUse: %s -> %s\n", oldOp->toStr().c_str(), newOp->toStr().c_str());
+        for (auto &use : operands)
+            if (!use.isDef() && use.get() == oldOp)
+                use.set(newOp);
+    }
+    virtual Operand *getDef()
+    {
+        if (!operands.empty() && operands[0].isDef())
+            return operands[0];
+        return nullptr;
     }
-    virtual Operand *getDef() { return nullptr; }
-    virtual std::vector<Operand *> getUse() { return {}; }
+    virtual std::vector<Operand *> getUse()
+    {
+        std::vector<Operand *> uses;
+        for (auto &use : operands)
+            if (!use.isDef())
+                uses.push_back(use);
+        return uses;
+    }
+    std::vector<Use> &getOperands() { return operands; };
     virtual void output() const = 0;
     MachineOperand *genMachineOperand(Operand *);
     MachineOperand *genMachineReg(int reg);
     MachineOperand *genMachineVReg();
     MachineOperand *genMachineImm(int val);
     MachineOperand *genMachineLabel(int block_no);
+    // 立即数用 mov/mvn/movw/movt 装入新的虚拟寄存器，寄存器操作数原样返回
+    MachineOperand *genMachineRegOf(MachineBlock *block, MachineOperand *ope);
+    // 数据处理指令的第二操作数：能编码的立即数留在指令里，否则同 genMachineRegOf
+    MachineOperand *genMachineOperand2(MachineBlock *block, MachineOperand *ope);
     virtual void genMachineCode(AsmBuilder *) = 0;
     virtual bool isJump() const
     {
@@ -66,7 +102,9 @@ protected:
     Instruction *prev;
     Instruction *next;
     BasicBlock *parent;
-    std::vector<Operand *> operands;
+    std::vector<Use> operands; // 定值操作数（若有）位于 operands[0]
+    void addDef(Operand *dst);
+    void addUse(Operand *src);
     enum
     {
         BINARY,
@@ -84,7 +122,9 @@ protected:
         ALLOCA,
         FUNCTIONCALL,
         GLOBALVAR,
-        TOBOOL
+        TOBOOL,
+        PHI,
+        COPY
     };
 };
 
@@ -92,13 +132,8 @@ class TypeConverInstruction : public Instruction
 {
 public:
     TypeConverInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb = nullptr);
-    ~TypeConverInstruction();
     void output() const;
     void genMachineCode(AsmBuilder *);
-
-private:
-    Operand *dst;
-    Operand *src;
 };
 
 // meaningless instruction, used as the head node of the instruction list.
@@ -114,9 +149,7 @@ class AllocaInstruction : public Instruction
 {
 public:
     AllocaInstruction(Operand *dst, SymbolEntry *se, BasicBlock *insert_bb = nullptr);
-    ~AllocaInstruction();
     void output() const;
-    Operand *getDef() { return operands[0]; }
     void genMachineCode(AsmBuilder *);
 
 private:
@@ -127,10 +160,7 @@ class LoadInstruction : public Instruction
 {
 public:
     LoadInstruction(Operand *dst, Operand *src_addr, BasicBlock *insert_bb = nullptr);
-    ~LoadInstruction();
     void output() const;
-    Operand *getDef() { return operands[0]; }
-    std::vector<Operand *> getUse() { return {operands[1]}; }
     void genMachineCode(AsmBuilder *);
 };
 class ZextInstruction : public Instruction
@@ -144,9 +174,7 @@ class StoreInstruction : public Instruction
 {
 public:
     StoreInstruction(Operand *dst_addr, Operand *src, BasicBlock *insert_bb = nullptr);
-    ~StoreInstruction();
     void output() const;
-    std::vector<Operand *> getUse() { return {operands[0], operands[1]}; }
     void genMachineCode(AsmBuilder *);
 };
 
@@ -154,7 +182,6 @@ class BinaryInstruction : public Instruction
 {
 public:
     BinaryInstruction(unsigned opcode, Operand *dst, Operand *src1, Operand *src2, BasicBlock *insert_bb = nullptr);
-    ~BinaryInstruction();
     void output() const;
     void genMachineCode(AsmBuilder *);
     enum
@@ -167,15 +194,18 @@ public:
         AND,
         OR
     };
-    Operand *getDef() { return operands[0]; }
-    std::vector<Operand *> getUse() { return {operands[1], operands[2]}; }
+
+private:
+    // 第二个操作数是常数时，乘法改用移位和加减，除法和取模改用移位或 smmul；不划算时返回 false
+    bool genMulByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *src, int c);
+    bool genDivByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *src, int d);
+    bool genModByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *src, int d);
 };
 
 class CmpInstruction : public Instruction
 {
 public:
     CmpInstruction(unsigned opcode, Operand *dst, Operand *src1, Operand *src2, BasicBlock *insert_bb = nullptr);
-    ~CmpInstruction();
     void output() const;
     void genMachineCode(AsmBuilder *);
     enum
@@ -187,15 +217,12 @@ public:
         G,
         GE
     };
-    Operand *getDef() { return operands[0]; }
-    std::vector<Operand *> getUse() { return {operands[1], operands[2]}; }
 };
 
 class UnaryInstruction : public Instruction
 {
 public:
     UnaryInstruction(unsigned opcode, Operand *dst, Operand *src, BasicBlock *insert_bb = nullptr);
-    ~UnaryInstruction();
     void output() const;
     void genMachineCode(AsmBuilder *);
     enum
@@ -225,7 +252,6 @@ class CondBrInstruction : public Instruction
 {
 public:
     CondBrInstruction(BasicBlock *, BasicBlock *, Operand *, BasicBlock *insert_bb = nullptr);
-    ~CondBrInstruction();
     void output() const;
     void setTrueBranch(BasicBlock *);
     BasicBlock *getTrueBranch();
@@ -234,7 +260,9 @@ public:
     void genMachineCode(AsmBuilder *);
     BasicBlock **patchBranchTrue() { return &true_branch; };
     BasicBlock **patchBranchFalse() { return &false_branch; };
-    std::vector<Operand *> getUse() { return {operands[0]}; }
+    // 同一基本块中产生条件的 cmp/tobool，中间可以隔着若干 xor（negated 表示条件取反）；
+    // 两者之间有别的指令改写标志位时返回 nullptr
+    Instruction *getFlagSource(bool &negated);
 
 protected:
     BasicBlock *true_branch;
@@ -245,14 +273,6 @@ class RetInstruction : public Instruction
 {
 public:
     RetInstruction(Operand *src, BasicBlock *insert_bb = nullptr);
-    ~RetInstruction();
-    std::vector<Operand *> getUse()
-    {
-        if (operands.size())
-            return {operands[0]};
-        else
-            return {};
-    }
     void output() const;
     void genMachineCode(AsmBuilder *);
 };
@@ -260,9 +280,10 @@ class GlobalVarDefInstruction : public Instruction
 {
 public:
     GlobalVarDefInstruction(Operand *dst, ConstantSymbolEntry *se, BasicBlock *insert_bb = nullptr);
-    ~GlobalVarDefInstruction();
     void output() const;
     void genMachineCode(AsmBuilder *);
+    Type *getValueType() const { return type; };
+    int getIntValue() const { return value.intValue; };
 
 private:
     union
@@ -270,15 +291,13 @@ private:
         int intValue;
         float floatValue;
     } value;
-    Operand *dst;
     Type *type;
 };
 
 class IntFloatCastInstructionn : public Instruction
 {
 public:
-    IntFloatCastInstructionn(unsigned opcode, Operand *src, Operand *dst, BasicBlock *insert_bb = nullptr);
-    ~IntFloatCastInstructionn();
+    IntFloatCastInstructionn(unsigned opcode, Operand *dst, Operand *src, BasicBlock *insert_bb = nullptr);
     void output() const;
     enum
     {
@@ -290,27 +309,19 @@ class FuncCallInstruction : public Instruction
 {
 public:
     FuncCallInstruction(SymbolEntry *se, Operand *dst, std::vector<Operand *> params, BasicBlock *insert_bb);
-    ~FuncCallInstruction();
     void output() const;
     void genMachineCode(AsmBuilder *);
 
 private:
     SymbolEntry *se;
-    Operand *dst;
-    std::vector<Operand *> params;
 };
 
 class ToBoolInstruction : public Instruction
 {
 public:
     ToBoolInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb = nullptr);
-    ~ToBoolInstruction();
     void output() const;
     void genMachineCode(AsmBuilder *);
-
-private:
-    Operand *dst;
-    Operand *src;
 };
 class XorInstruction : public Instruction
 {
@@ -320,6 +331,36 @@ public:
     void genMachineCode(AsmBuilder *);
 };
 
+/*
+    phi 指令：operands[0] 为定值，operands[i + 1] 为从 blocks[i] 流入的值。
+    只存在于 mem2reg 之后、SSA 析构之前，不直接生成机器代码。
+*/
+class PhiInstruction : public Instruction
+{
+public:
+    PhiInstruction(Operand *dst, BasicBlock *insert_bb = nullptr);
+    void output() const;
+    void genMachineCode(AsmBuilder *);
+    void addIncoming(Operand *src, BasicBlock *block);
+    void removeIncoming(BasicBlock *block);
+    void replaceIncomingBlock(BasicBlock *oldBlock, BasicBlock *newBlock);
+    int getNumIncoming() const { return blocks.size(); };
+    Operand *getIncomingValue(int i) { return operands[i + 1]; };
+    BasicBlock *getIncomingBlock(int i) { return blocks[i]; };
+
+private:
+    std::vector<BasicBlock *> blocks;
+};
+
+// SSA 析构时用来替换 phi 的复制指令 dst = src
+class CopyInstruction : public Instruction
+{
+public:
+    CopyInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb = nullptr);
+    void output() const;
+    void genMachineCode(AsmBuilder *);
+};
+
 class GepInstruction : public Instruction
 {
 private:
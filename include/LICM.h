@@ -0,0 +1,41 @@
+#ifndef __LICM_H__
+#define __LICM_H__
+
+#include "PassManager.h"
+#include <string>
+#include <vector>
+#include <set>
+
+/*
+    循环不变代码外提：先为每个循环建立唯一的前置块（preheader），
+    再由内向外把操作数都在循环外定义（或本身已外提）的纯计算指令，
+    以及循环内没有写入的全局变量/栈上变量的 load 移到前置块末尾。
+    可能除零的 div/mod 只在所在块支配循环所有出口块时外提，
+    保证循环一次都不执行时不会提前除零。
+    需要在 mem2reg 之后运行，依赖 SSA 形式判断操作数是否循环不变。
+*/
+class LICM : public FunctionPass
+{
+    typedef LoopInfo<BasicBlock>::Loop Loop;
+
+private:
+    Unit *unit;
+    std::vector<std::pair<std::string, int>> hoisted; // 每个函数外提的指令数
+    bool clobbersAll;                                 // 当前循环含调用或写入未知地址
+    std::set<Operand *> storedBases;                  // 当前循环写入的变量
+
+    BasicBlock *getPreheader(Loop *);
+    void insertPreheader(Function *, Loop *);
+    bool isInvariant(Loop *, Operand *);
+    void collectStores(Loop *);
+    bool canHoist(Loop *, Instruction *);
+    int hoist(Loop *);
+
+public:
+    LICM(Unit *unit) : unit(unit){};
+    const char *getName() const { return "licm"; };
+    bool runOnFunction(Function *);
+    void printStats(FILE *out);
+};
+
+#endif
@@ -8,45 +8,71 @@
 #include <map>
 #include <vector>
 #include <list>
+#include <unordered_map>
 
 class MachineUnit;
 class MachineOperand;
 class MachineFunction;
+class MachineInstruction;
+class ThreadPool;
 
+/*
+    先分配 r0-r3、r12，再分配 r4-r10，不含 bl 的函数还可以用 lr。
+    调用者保存的寄存器有由显式和隐式操作数建立的固定区间，bl 的破坏是一条指令长的段，
+    只有不跨过它的区间才能分到这些寄存器。
+*/
 class LinearScan
 {
 private:
+    // 活跃区间中的一段 [from, to]，两端均为位置且包含在内：指令 n 读操作数在 2n，写结果在 2n+1
+    struct Range
+    {
+        int from;
+        int to;
+    };
     struct Interval
     {
-        int start;                       // 活跃区间的起始位置（指令编号）
-        int end;                         // 活跃区间的结束位置（指令编号）
-        bool spill;                      // 是否需要溢出到内存 whether this vreg should be spilled to memory
-        int disp;                        // 在堆栈中的偏移量 displacement in stack
-        int rreg;                        // 映射到的物理寄存器编号，如果未溢出 the real register mapped from virtual register if the vreg is not spilled to memory
-        std::set<MachineOperand *> defs; // 定义该寄存器的所有操作数
-        std::set<MachineOperand *> uses; // 使用该寄存器的所有操作数
+        int start;                          // 活跃区间的起始位置
+        int end;                            // 活跃区间的结束位置
+        bool spill;                         // 是否需要溢出到内存 whether this vreg should be spilled to memory
+        int disp;                           // 在堆栈中的偏移量 displacement in stack
+        int rreg;                           // 映射到的物理寄存器编号，如果未溢出 the real register mapped from virtual register if the vreg is not spilled to memory
+        bool spillable;                     // 溢出代码引入的短区间不再溢出，避免反复溢出
+        std::vector<Range> ranges;          // 按位置升序排列、互不相交的若干段，段与段之间是空洞
+        std::vector<MachineOperand *> defs; // 定义该寄存器的所有操作数
+        std::vector<MachineOperand *> uses; // 使用该寄存器的所有操作数
+        bool covers(int pos) const;         // pos 是否落在某一段内
+        bool intersects(const Interval *other) const;
     };
     MachineUnit *unit;
     MachineFunction *func;
-    std::vector<int> regs;                                            // 可用的物理寄存器编号
-    std::map<MachineOperand *, std::set<MachineOperand *>> du_chains; // 定义-使用链，记录每个定义操作数被哪些使用操作数引用
-    std::vector<Interval *> intervals;                                // 活跃区间列表
+    std::vector<int> regs;                     // 可用的物理寄存器编号
+    std::vector<Interval *> intervals;         // 活跃区间列表
+    std::unordered_map<int, Interval *> vreg2interval; // 虚拟寄存器编号 -> 活跃区间
+    std::vector<Interval *> fixedIntervals;    // 调用者保存的物理寄存器自身的活跃区间，bl 处的破坏也计入其中
+    std::set<int> spillTemps;                  // 溢出代码中新建的虚拟寄存器
 
     static bool compareStart(Interval *a, Interval *b); // 比较函数，根据活跃区间的起始位置排序
-    void expireOldIntervals(Interval *interval);        // 释放那些已经结束的活跃区间，回收其占用的寄存器
+    void expireOldIntervals(Interval *interval);        // 根据当前位置维护 actives/inactives，回收已结束区间的寄存器
     void spillAtInterval(Interval *interval);           // 在当前活跃区间上进行溢出处理，将其存储到内存
-    void makeDuChains();                                // 构建定义-使用链，记录每个定义操作数被哪些使用操作数引用
-    void computeLiveIntervals();                        // 计算每个虚拟寄存器的活跃区间
+    Interval *getInterval(MachineOperand *vreg);        // 取得（必要时新建）虚拟寄存器对应的区间
+    Interval *getFixedInterval(int reg);                // 可分配的调用者保存寄存器 reg 的固定区间，其余寄存器返回 nullptr
+    void addRange(Interval *interval, int from, int to); // 在区间前端加入一段，与相邻段合并
+    void computeLiveIntervals();                        // 计算每个虚拟寄存器以及调用者保存寄存器的活跃区间
+    void addFixedConflicts(Interval *interval, std::set<int> &regs); // 把与 interval 相交的固定区间的寄存器加入 regs
     bool linearScanRegisterAllocation();                // 执行线性扫描寄存器分配，尝试将虚拟寄存器映射到物理寄存器
     void modifyCode();                                  // 修改机器代码以反映寄存器分配结果，将虚拟寄存器替换为物理寄存器
     void genSpillCode();                                // 生成溢出代码（加载和存储指令），处理需要溢出的寄存器
+    void insertSpillLoad(MachineInstruction *inst, int vreg, int disp); // 在 inst 之前从栈槽 disp 装入 vreg
+    void allocateFunction(MachineFunction *f);          // 为一个函数分配寄存器
 
     static bool compareEnd(Interval *a, Interval *b); // 比较函数，根据活跃区间的结束位置排序
-    std::vector<Interval *> actives;                  // 当前活跃的区间列表
+    std::vector<Interval *> actives;                  // 当前位置被覆盖的区间，按结束位置排序
+    std::vector<Interval *> inactives;                // 已开始、未结束但当前位置处于空洞中的区间
 
 public:
     LinearScan(MachineUnit *unit);
-    void allocateRegisters(); // 执行寄存器分配
+    void allocateRegisters(ThreadPool *pool = nullptr); // 执行寄存器分配，pool 非空时各函数并行分配
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -5,7 +5,10 @@
 #include <string>
 #include <algorithm>
 #include <fstream>
+#include <unordered_map>
 #include "SymbolTable.h"
+#include "BitVector.h"
+#include "Dominators.h"
 
 /* Hint:
  * MachineUnit: Compiler unit
@@ -23,6 +26,11 @@ class MachineFunction;
 class MachineBlock;
 class MachineInstruction;
 
+// 数据处理指令的立即数：8 位常数循环右移偶数位
+bool isLegalImm(int val);
+// ldr/str 字访问的立即数偏移为 -4095~4095
+inline bool isLegalMemOffset(int off) { return off >= -4095 && off <= 4095; }
+
 class MachineOperand
 {
 private:
@@ -54,6 +62,11 @@ public:
         this->type = REG;
         this->reg_no = regno;
     };
+    void setVReg(int regno) // 改为另一个虚拟寄存器，溢出时使用
+    {
+        this->type = VREG;
+        this->reg_no = regno;
+    };
     std::string getLabel() { return this->label; };
     void setParent(MachineInstruction *p) { this->parent = p; };
     MachineInstruction *getParent() { return this->parent; };
@@ -69,6 +82,7 @@ protected:
     int type;                            // Instruction type 指令类型
     int cond = MachineInstruction::NONE; // Instruction execution condition, optional !!  指令的执行条件
     int op;                              // Instruction opcode 指令操作码
+    bool updateFlags = false;            // 带 s 后缀，按结果设置标志位
     // Instruction operand list, sorted by appearance order in assembly instruction
     std::vector<MachineOperand *> def_list;
     std::vector<MachineOperand *> use_list;
@@ -104,6 +118,35 @@ public:
     std::vector<MachineOperand *> &getDef() { return def_list; };
     std::vector<MachineOperand *> &getUse() { return use_list; };
     MachineBlock *getParent() { return this->parent; };
+    int getCond() const { return cond; };
+    int getOp() const { return op; };
+    bool isCopy() const; // 无条件的寄存器到寄存器 mov
+    bool isBinary() const { return type == BINARY; };
+    bool isLoad() const { return type == LOAD; };
+    bool isStore() const { return type == STORE; };
+    bool isMov() const { return type == MOV; };
+    bool isBranch() const { return type == BRANCH; };
+    bool isCmp() const { return type == CMP; };
+    void setCond(int cond) { this->cond = cond; };
+    void setUpdateFlags() { updateFlags = true; };
+    bool getUpdateFlags() const { return updateFlags; };
+    bool isCall() const; // bl
+    bool isUncondBranch() const; // 无条件的 b
+    // 带条件的定值在条件不成立时保留目标寄存器原来的值，movt 保留低半字，相当于同时读取了它
+    bool readsDefs() const;
+    // use 读的正是本指令 readsDefs() 改写的寄存器，溢出时与定值共用一个临时寄存器
+    bool readsOwnDef(MachineOperand *use);
+    // 隐式操作数只参与活跃变量分析和寄存器分配，不会输出，如 bl 读取的参数寄存器和破坏的调用者保存寄存器
+    void addImplicitDef(MachineOperand *ope)
+    {
+        ope->setParent(this);
+        addDef(ope);
+    };
+    void addImplicitUse(MachineOperand *ope)
+    {
+        ope->setParent(this);
+        addUse(ope);
+    };
 };
 
 class BinaryMInstruction : public MachineInstruction
@@ -117,13 +160,27 @@ public:
         DIV,
         AND,
         OR,
-        XOR
-        // XOR
+        XOR,
+        RSB,  // dst = src2 - src1
+        LSL,
+        LSR,
+        ASR,
+        SMMUL // 有符号乘积的高 32 位
     }; // 单目在这里写???
     BinaryMInstruction(MachineBlock *p, int op,
                        MachineOperand *dst, MachineOperand *src1, MachineOperand *src2,
                        int cond = MachineInstruction::NONE);
     void output();
+    // 第二操作数先移位再参与运算，如 add r0, r1, r2, lsl #2；shiftOp 为 LSL、LSR 或 ASR
+    void setShift(int shiftOp, int amount)
+    {
+        this->shiftOp = shiftOp;
+        this->shiftAmount = amount;
+    };
+
+private:
+    int shiftOp = -1;
+    int shiftAmount = 0;
 };
 
 class LoadMInstruction : public MachineInstruction
@@ -150,7 +207,9 @@ public:
     enum opType
     {
         MOV,
-        MVN // MVN 表示按位取反移动操作，将一个操作数（源 src）的内容按位取反后移动到另一个操作数（目的 dst）没用到吧
+        MVN,  // MVN 表示按位取反移动操作，将一个操作数（源 src）的内容按位取反后移动到另一个操作数（目的 dst）
+        MOVW, // 16 位立即数写入低半字，高半字清零
+        MOVT  // 16 位立即数写入高半字，低半字不变，所以 dst 同时也是使用
     };
     MovMInstruction(MachineBlock *p, int op,
                     MachineOperand *dst, MachineOperand *src,
@@ -211,8 +270,9 @@ private:
     std::vector<MachineBlock *> pred, succ; // 存储前驱和后继基本块的指针列表，用于构建控制流图（CFG）
     std::vector<MachineInstruction *> inst_list;
     // 存储基本块中活动寄存器的集合，live_in表示进入该基本块时活动的寄存器，live_out表示离开该基本块时活动的寄存器。
-    std::set<MachineOperand *> live_in;
-    std::set<MachineOperand *> live_out;
+    // 按 MachineFunction::getLiveIndex 给出的稠密编号置位
+    BitVector live_in;
+    BitVector live_out;
 
 public:
     std::vector<MachineInstruction *> &getInsts() { return inst_list; };
@@ -230,17 +290,22 @@ public:
         this->no = no;
     };
     void InsertInst(MachineInstruction *inst) { this->inst_list.push_back(inst); };
+    // 在 pos 之前插入把常数 val 装入 dst 的 mov、mvn 或 movw/movt，返回 pos 处原来那条指令的新位置
+    std::vector<MachineInstruction *>::iterator insertLoadImm(std::vector<MachineInstruction *>::iterator pos,
+                                                              MachineOperand *dst, int val);
+    void loadImm(MachineOperand *dst, int val) { insertLoadImm(inst_list.end(), dst, val); };
     void addPred(MachineBlock *p) { this->pred.push_back(p); }; // 添加前驱基本块
     void addSucc(MachineBlock *s) { this->succ.push_back(s); }; // 添加后继基本块
 
     // 返回该基本块的live_in和live_out集合的引用
-    std::set<MachineOperand *> &getLiveIn() { return live_in; };
-    std::set<MachineOperand *> &getLiveOut() { return live_out; };
+    BitVector &getLiveIn() { return live_in; };
+    BitVector &getLiveOut() { return live_out; };
 
     // 返回该基本块的前驱和后继列表的引用
     std::vector<MachineBlock *> &getPreds() { return pred; };
     std::vector<MachineBlock *> &getSuccs() { return succ; };
     int getSize() const { return inst_list.size(); }; // 该基本块中指令的数量
+    int getNo() const { return no; };
     void output();
     int getCmpCond() const { return cmpCond; }; // 获取比较条件，条件分支用
     MachineFunction *getParent() { return parent; }
@@ -254,6 +319,15 @@ private:
     int stack_size;           // 函数使用的栈空间大小，用于管理局部变量
     std::set<int> saved_regs; // 该函数需要保存的寄存器编号集。这些寄存器在函数调用前被保存，在函数返回后恢复。
     SymbolEntry *sym_ptr;
+    std::unordered_map<int, int> vreg_index; // 虚拟寄存器编号 -> 稠密编号
+    std::vector<int> vregs;                  // 稠密编号 - NUM_PHYS_REGS -> 虚拟寄存器编号
+    int alloc_rounds;                        // 寄存器分配经历的分配/溢出轮数
+    int spilled_vregs;                       // 被溢出到栈上的虚拟寄存器数目
+    int next_vreg;                           // 指令选择结束时的虚拟寄存器编号，溢出代码的新编号从这里继续
+    std::string cache_key;                   // 函数缓存的键，未启用缓存时为空
+    std::string cached_asm;                  // 缓存命中时的汇编文本，此时函数没有基本块，也不做寄存器分配
+    DominatorTree<MachineBlock> *domTree;    // 按需计算并缓存，机器 CFG 改变后须调用 invalidateAnalyses
+    LoopInfo<MachineBlock> *loopInfo;
 
 public:
     std::vector<MachineBlock *> &getBlocks() { return block_list; };              // 返回该函数中基本块列表的引用，用于访问和操作这些基本块
@@ -274,7 +348,31 @@ public:
     };
     void InsertBlock(MachineBlock *block) { this->block_list.push_back(block); }; // 将一个基本块插入到函数的基本块列表中
     void addSavedRegs(int regno) { saved_regs.insert(regno); };                   // 将一个寄存器编号添加到需要保存的寄存器集合中
+
+    // 活跃变量分析使用的稠密编号：物理寄存器占 0~15，虚拟寄存器按出现顺序排在其后
+    static const int NUM_PHYS_REGS = 16;
+    int numberVRegs();                         // 重新为函数中出现的虚拟寄存器编号，返回编号总数
+    int getNumLiveIndex() const { return NUM_PHYS_REGS + vregs.size(); };
+    int getLiveIndex(MachineOperand *ope);     // 立即数和标签返回 -1
+    int getVRegOf(int index) const { return vregs[index - NUM_PHYS_REGS]; };
+
+    // 寄存器分配统计
+    void addAllocRound() { alloc_rounds++; };
+    void addSpilledVReg() { spilled_vregs++; };
+    int getAllocRounds() const { return alloc_rounds; };
+    int getSpilledVRegs() const { return spilled_vregs; };
+    SymbolEntry *getSymPtr() const { return sym_ptr; };
+    void setNextVReg(int no) { next_vreg = no; };
+    void setCacheKey(const std::string &key) { cache_key = key; };
+    const std::string &getCacheKey() const { return cache_key; };
+    void setCachedAsm(const std::string &text) { cached_asm = text; };
+    bool isCached() const { return !cached_asm.empty(); };
+    int getNextVReg() const { return next_vreg; };
+    DominatorTree<MachineBlock> &getDomTree();
+    LoopInfo<MachineBlock> &getLoopInfo();
+    void invalidateAnalyses();
     void output();
+    void printSavedRegs(const char *op);          // 输出 op {保存的寄存器, fp, lr}，op 为 push 或 pop
     std::vector<MachineOperand *> getSavedRegs(); // 返回保存的寄存器操作数列表，用于在函数调用前后保存和恢复寄存器状态
     MachineUnit *getParent() const { return parent; };
 };
@@ -294,6 +392,7 @@ public:
     void output();
     void PrintGlobalDecl();
     void PrintGlobal();
+    void printAllocStats(FILE *out); // 输出每个函数寄存器分配的轮数与溢出数目
 };
 
 #endif
\ No newline at end of file
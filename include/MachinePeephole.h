@@ -0,0 +1,49 @@
+#ifndef __MACHINEPEEPHOLE_H__
+#define __MACHINEPEEPHOLE_H__
+
+#include <atomic>
+#include <cstdio>
+
+class MachineUnit;
+class MachineFunction;
+class MachineBlock;
+class ThreadPool;
+
+/*
+    寄存器分配之后、输出和写入函数缓存之前，在每个 MachineBlock 内做窥孔优化：
+    store-to-load   从 fp 栈槽 ldr 的值仍在寄存器中时改为 mov
+    redundant-move  删除 mov rX, rX 以及两个寄存器已相等时的拷贝
+    fallthrough     删除跳到下一个块的 b，b<cond> 下一个块; b L 改为 b<!cond> L
+    cmp-zero        紧跟在定义 rX 的指令后的 cmp rX, #0 并入该指令的 s 后缀，
+                    前提是读这些标志位的条件都是 eq/ne
+    标志位不会跨块活跃，每个模式只看一个块。
+*/
+class MachinePeephole
+{
+public:
+    enum
+    {
+        STORE_TO_LOAD,
+        REDUNDANT_MOVE,
+        FALLTHROUGH,
+        CMP_ZERO,
+        NUM_PATTERNS
+    };
+
+private:
+    MachineUnit *unit;
+    std::atomic<int> hits[NUM_PATTERNS];
+
+    int forwardStores(MachineBlock *block);
+    int removeRedundantMoves(MachineBlock *block);
+    int removeFallthrough(MachineBlock *block, MachineBlock *next);
+    int foldCmpZero(MachineBlock *block);
+    void runOnFunction(MachineFunction *func);
+
+public:
+    MachinePeephole(MachineUnit *unit);
+    void pass(ThreadPool *pool = nullptr); // pool 非空时各函数并行处理
+    void printStats(FILE *out) const;
+};
+
+#endif
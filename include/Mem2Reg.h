@@ -0,0 +1,36 @@
+#ifndef __MEM2REG_H__
+#define __MEM2REG_H__
+
+#include "PassManager.h"
+#include <vector>
+#include <unordered_map>
+
+/*
+    mem2reg：把只经由 load/store 访问的标量 alloca 提升为 SSA 形式的临时变量。
+    先在写入块集合的迭代支配边界上插入 phi，再沿支配树先序遍历重命名：
+    store 压入新值，load 直接替换为当前值，两者随后都被删除。
+*/
+class Mem2Reg : public FunctionPass
+{
+private:
+    Unit *unit;
+
+    std::vector<Instruction *> allocas;           // 可提升的 alloca
+    std::unordered_map<Operand *, int> allocaIdx; // alloca 地址 -> allocas 下标
+    std::unordered_map<Instruction *, int> phi2alloca;
+
+    void removeUnreachableBlocks(Function *);
+    bool isPromotable(Instruction *);
+    void insertPhis(Function *);
+    void rename(Function *);
+    void removeDeadPhis();
+
+public:
+    Mem2Reg(Unit *unit) : unit(unit){};
+    const char *getName() const { return "mem2reg"; };
+    // 删除不可达块时自行作废分析，提升本身不改变 CFG
+    unsigned getPreserved() const { return Function::ALL_ANALYSES; };
+    bool runOnFunction(Function *);
+};
+
+#endif
@@ -2,37 +2,119 @@
 #define __OPERAND_H__
 
 #include "SymbolTable.h"
+#include "Arena.h"
 #include <vector>
+#include <iterator>
 
 class Instruction;
 class Function;
+class Operand;
+
+/*
+    Use：指令的一个操作数槽位。读取操作数的槽位串在该操作数的侵入式 use 链表上，
+    增删和改指向都是 O(1) 且不分配内存；定值槽位（operands[0]）不在链表中。
+*/
+class Use
+{
+private:
+    Operand *val;      // 该槽位当前引用的操作数
+    Instruction *user; // 槽位所属的指令
+    Use *prev;         // val 的 use 链表中的前驱/后继
+    Use *next;
+    bool def; // 定值槽位不进入 use 链表
+
+    void link();
+    void unlink();
+
+public:
+    Use(Operand *val, Instruction *user, bool def = false);
+    // 移动时修补链表中邻居的指针，保证 std::vector<Use> 扩容后链表仍然有效
+    Use(Use &&other) noexcept;
+    Use(const Use &) = delete;
+    Use &operator=(const Use &) = delete;
+    Use &operator=(Use &&) = delete;
+    ~Use();
+
+    Operand *get() const { return val; };
+    void set(Operand *newVal);
+    Instruction *getUser() const { return user; };
+    Use *getNext() const { return next; };
+    bool isDef() const { return def; };
+
+    // 让 operands[i] 在原有代码中仍可当作 Operand * 使用
+    operator Operand *() const { return val; };
+    Operand *operator->() const { return val; };
+
+    friend class Operand;
+};
 
 // class Operand - The operand of an instruction.
-class Operand
+class Operand : public ArenaNode<Arena::OPERAND, Operand>
 {
-    typedef std::vector<Instruction *>::iterator use_iterator;
+public:
+    // 沿 use 链表遍历使用该操作数的指令
+    class use_iterator
+    {
+        Use *cur;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Instruction *value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Instruction **pointer;
+        typedef Instruction *reference;
+
+        use_iterator(Use *u = nullptr) : cur(u){};
+        Instruction *operator*() const { return cur->getUser(); };
+        Use *getUse() const { return cur; };
+        use_iterator &operator++()
+        {
+            cur = cur->getNext();
+            return *this;
+        };
+        use_iterator operator++(int)
+        {
+            use_iterator tmp = *this;
+            cur = cur->getNext();
+            return tmp;
+        };
+        bool operator==(const use_iterator &other) const { return cur == other.cur; };
+        bool operator!=(const use_iterator &other) const { return cur != other.cur; };
+    };
+
+    struct use_range
+    {
+        use_iterator first, last;
+        use_iterator begin() const { return first; };
+        use_iterator end() const { return last; };
+        bool empty() const { return first == last; };
+    };
 
 private:
-    Instruction *def;                // The instruction where this operand is defined.
-    std::vector<Instruction *> uses; // Intructions that use this operand.
-    SymbolEntry *se;                 // The symbol entry of this operand.
-    std::vector<Instruction *> loaduses;
+    Instruction *def; // The instruction where this operand is defined.
+    Use *useHead;     // Head of the intrusive list of slots that use this operand.
+    int numUses;
+    SymbolEntry *se; // The symbol entry of this operand.
+
+    friend class Use;
+
 public:
-    Operand(SymbolEntry *se) : se(se) { def = nullptr; };
+    Operand(SymbolEntry *se) : def(nullptr), useHead(nullptr), numUses(0), se(se){};
     void setDef(Instruction *inst) { def = inst; };
-    void addUse(Instruction *inst) { uses.push_back(inst); };
-    void removeUse(Instruction *inst);
-    int usersNum() const { return uses.size(); };
-    void addloadUse(Instruction *inst) { loaduses.push_back(inst); };
-    int loadusersNum() const { return loaduses.size(); };
+    int usersNum() const { return numUses; };
+    int loadusersNum() const; // 以该操作数为地址的 load 指令数目
     Instruction *getDef() { return def; };
-    std::vector<Instruction *> &getUse() { return uses; };
+    use_range getUse() { return {use_begin(), use_end()}; };
+    Use *getUseHead() const { return useHead; };
+    // 把所有对该操作数的使用改为使用 newOp
+    void replaceAllUsesWith(Operand *newOp);
     SymbolEntry* getSymPtr(){return se;}
 
-    use_iterator use_begin() { return uses.begin(); };
-    use_iterator use_end() { return uses.end(); };
+    use_iterator use_begin() { return use_iterator(useHead); };
+    use_iterator use_end() { return use_iterator(); };
     Type *getType() { return se->getType(); };
     std::string toStr() const;
+    void print(OutputStream &out) const { se->print(out); };
     SymbolEntry * getEntry() { return se; };
     bool isConst()
     {
@@ -43,4 +125,10 @@ public:
     }
 };
 
-#endif
\ No newline at end of file
+inline OutputStream &operator<<(OutputStream &out, const Operand *op)
+{
+    op->print(out);
+    return out;
+}
+
+#endif
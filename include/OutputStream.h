@@ -0,0 +1,98 @@
+#ifndef __OUTPUTSTREAM_H__
+#define __OUTPUTSTREAM_H__
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+    IR、AST 和汇编输出共用的只追加输出流：在可写窗口 [cur, end) 中直接格式化，
+    不产生临时字符串。窗口写满时由 reserve() 决定：FileOutputStream 交给 fwrite，
+    StringOutputStream 扩充字符串，MmapOutputStream 扩大文件并重新映射。
+*/
+class OutputStream
+{
+protected:
+    char *cur = nullptr; // 下一个写入位置
+    char *end = nullptr; // 可写窗口的末尾
+    // 窗口剩余不足 need 字节时调用，返回后 [cur, end) 至少有 need 字节
+    virtual void reserve(size_t need) = 0;
+
+public:
+    virtual ~OutputStream() {};
+    virtual void flush() {};
+    void write(const char *s, size_t n)
+    {
+        if ((size_t)(end - cur) < n)
+            reserve(n);
+        memcpy(cur, s, n);
+        cur += n;
+    };
+    OutputStream &operator<<(char c)
+    {
+        if (cur == end)
+            reserve(1);
+        *cur++ = c;
+        return *this;
+    };
+    OutputStream &operator<<(const char *s)
+    {
+        write(s, strlen(s));
+        return *this;
+    };
+    OutputStream &operator<<(const std::string &s)
+    {
+        write(s.data(), s.size());
+        return *this;
+    };
+    OutputStream &operator<<(int v);
+    void printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void vprintf(const char *format, va_list args);
+};
+
+class FileOutputStream : public OutputStream
+{
+private:
+    FILE *file;
+    std::vector<char> buffer;
+    void reserve(size_t need) override;
+
+public:
+    explicit FileOutputStream(FILE *file, size_t bufferSize = 1 << 16);
+    ~FileOutputStream() { flush(); };
+    void flush() override; // 把缓冲区中的内容写到文件
+};
+
+// 直接写在 str 的末尾之后；flush() 或析构之后 str 才是实际写出的内容
+class StringOutputStream : public OutputStream
+{
+private:
+    std::string &str;
+    void reserve(size_t need) override;
+
+public:
+    explicit StringOutputStream(std::string &str) : str(str) {};
+    ~StringOutputStream() { flush(); };
+    void flush() override;
+};
+
+// 打开失败时 isOpen() 为假，调用者可以改用 FileOutputStream（比如输出到管道）
+class MmapOutputStream : public OutputStream
+{
+private:
+    int fd;
+    char *base;
+    size_t mapped;
+    bool grow(size_t size);
+    void reserve(size_t need) override;
+
+public:
+    explicit MmapOutputStream(const char *path);
+    ~MmapOutputStream() { close(); };
+    bool isOpen() const { return fd >= 0; };
+    void close(); // 解除映射，把文件截断为实际写出的长度
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef __PASSMANAGER_H__
+#define __PASSMANAGER_H__
+
+#include "Unit.h"
+#include <vector>
+#include <cstdio>
+
+/*
+    IR 优化遍的管理：按加入顺序依次运行。
+    函数级的遍对每个函数调用 runOnFunction，模块级的遍对整个编译单元调用 runOnModule。
+    遍返回 true 表示改变了 IR，此时除 getPreserved() 声明保留的分析外，
+    函数上缓存的分析（支配树、循环信息）全部作废，后面的遍按需重新计算。
+*/
+class Pass
+{
+public:
+    virtual ~Pass(){};
+    virtual const char *getName() const = 0;
+    virtual bool isModulePass() const { return false; };
+    // 改变 IR 后仍然有效的分析，Function::DOM_TREE 等的按位或
+    virtual unsigned getPreserved() const { return 0; };
+    virtual void printStats(FILE *){};
+};
+
+class FunctionPass : public Pass
+{
+public:
+    // 在处理各函数之前调用一次，用于收集模块级的信息
+    virtual void doInitialization(){};
+    virtual bool runOnFunction(Function *) = 0;
+};
+
+class ModulePass : public Pass
+{
+public:
+    bool isModulePass() const { return true; };
+    virtual bool runOnModule() = 0;
+};
+
+class PassManager
+{
+private:
+    Unit *unit;
+    std::vector<Pass *> passes;
+
+public:
+    PassManager(Unit *unit) : unit(unit){};
+    ~PassManager();
+    void add(Pass *pass) { passes.push_back(pass); };
+    // -O0 不做优化；-O1 提升 SSA 并做常量传播和控制流化简；-O2 再加上公共子表达式消除和循环不变代码外提
+    void addPipeline(int level);
+    void run();
+    void printStats(FILE *out);
+};
+
+#endif
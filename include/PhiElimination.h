@@ -0,0 +1,23 @@
+#ifndef __PHIELIMINATION_H__
+#define __PHIELIMINATION_H__
+
+#include "Unit.h"
+
+/*
+    SSA 析构：在生成机器代码前把 phi 换成复制指令。
+    每个 phi 引入一个新临时变量 t，在各前驱的跳转指令前写入 t = v_i，
+    并在原位置写入 dst = t。由于 t 只属于这一个 phi，
+    关键边上两个后继的复制互不干扰，也不会出现 swap/lost-copy 问题。
+*/
+class PhiElimination
+{
+private:
+    Unit *unit;
+    void eliminate(Function *);
+
+public:
+    PhiElimination(Unit *unit) : unit(unit){};
+    void pass();
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __SCCP_H__
+#define __SCCP_H__
+
+#include "PassManager.h"
+#include <set>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/*
+    稀疏条件常量传播（Wegman & Zadeck）。
+    同时在 SSA 边和 CFG 边上做工作表迭代：只有可执行的边才参与 phi 的求值，
+    常量条件只让一条出边可执行。结束后把常量值替换进所有使用处，
+    常量条件跳转改为无条件跳转，并删除不可执行的基本块。
+*/
+class SCCP : public FunctionPass
+{
+private:
+    struct Lattice
+    {
+        enum
+        {
+            UNDEF,
+            CONST,
+            NAC
+        };
+        int state;
+        int value;
+    };
+
+    Unit *unit;
+    std::unordered_map<Operand *, Lattice> values;
+    std::unordered_map<Operand *, int> constGlobals; // const 全局变量的地址 -> 初值
+    std::unordered_set<BasicBlock *> execBlocks;
+    std::set<std::pair<BasicBlock *, BasicBlock *>> execEdges;
+    std::vector<std::pair<BasicBlock *, BasicBlock *>> cfgWorklist;
+    std::vector<Instruction *> ssaWorklist;
+    std::vector<std::pair<std::string, std::pair<int, int>>> stats; // 每个函数折叠的指令数、删除的块数
+
+    Lattice getValue(Operand *);
+    void setValue(Operand *, Lattice);
+    Lattice evaluate(Instruction *);
+    void visit(Instruction *);
+    void solve(Function *);
+    int rewrite(Function *);
+    int removeDeadBlocks(Function *);
+
+public:
+    SCCP(Unit *unit) : unit(unit){};
+    const char *getName() const { return "sccp"; };
+    void doInitialization();
+    bool runOnFunction(Function *);
+    void printStats(FILE *out);
+};
+
+#endif
@@ -2,13 +2,16 @@
 #define __SYMBOLTABLE_H__
 
 #include <string>
-#include <map>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
 #include <vector>
 #include "Type.h"
+#include "Arena.h"
 class Type;
 class Operand;
 
-class SymbolEntry
+class SymbolEntry : public ArenaNode<Arena::SYMBOLENTRY, SymbolEntry>
 {
 private:
     int kind;
@@ -21,7 +24,7 @@ protected:
         TEMPORARY,
     };
     Type *type;
-    std::string name;
+    const std::string *name = nullptr; // 标识符的名字，指向 NameTable 中驻留的字符串
 
     union
     {
@@ -40,10 +43,11 @@ public:
     bool isVariable() const { return kind == VARIABLE; };
     Type *getType() { return type; };
     void setType(Type *type) { this->type = type; };
-    virtual std::string toStr() = 0;
+    // 把 IR 中的名字或常量值直接写到 out；toStr() 经由它得到同样的字符串
+    virtual void print(OutputStream &out) = 0;
+    std::string toStr();
     // You can add any function you need here.
-    SymbolEntry(std::string name) : name(name) {}
-    std::string getName() const { return name; }
+    const std::string &getName() const { return *name; }
     // int getParamNo(){return paramNo;};
     float getFloat() { return value.floatValue; }
     int getInt() { return value.intValue; }
@@ -55,6 +59,12 @@ public:
     // void setboolValue(bool a) { value.boolValue = a; }
 };
 
+inline OutputStream &operator<<(OutputStream &out, SymbolEntry *se)
+{
+    se->print(out);
+    return out;
+}
+
 /*
     Symbol entry for literal constant. Example:
 
@@ -89,7 +99,7 @@ public:
     ConstantSymbolEntry(Type *type, int value);
     virtual ~ConstantSymbolEntry() {};
     int getValue() const { return value; };
-    std::string toStr();
+    void print(OutputStream &out) override;
     void setValue(int a) { value = a; }
     // You can add any function you need here.
 };
@@ -103,7 +113,7 @@ public:
     FloatSymbolEntry(Type *type, double value);
     virtual ~FloatSymbolEntry() {};
     double getValue() const { return value; };
-    std::string toStr();
+    void print(OutputStream &out) override;
     // You can add any function you need here.
 };
 class BoolSymbolEntry : public SymbolEntry
@@ -115,7 +125,7 @@ public:
     BoolSymbolEntry(Type *type, bool value);
     virtual ~BoolSymbolEntry() {};
     double getValue() const { return value; };
-    std::string toStr();
+    void print(OutputStream &out) override;
     // You can add any function you need here.
 };
 /*
@@ -149,8 +159,8 @@ private:
         PARAM,
         LOCAL
     };
-    std::string name;
     int scope;
+    int nameId; // 驻留后的名字编号，作用域按它查找
     Operand *addr; // The address of the identifier.
     // You can add any field you need here.
     bool isConst; // 新增成员变量，用于标识是否为const
@@ -158,14 +168,15 @@ private:
 
 public:
     int ConstantValue;
-    IdentifierSymbolEntry(Type *type, std::string name, int scope, bool isConst = false);
+    IdentifierSymbolEntry(Type *type, int nameId, int scope, bool isConst = false);
     virtual ~IdentifierSymbolEntry() {};
-    std::string toStr();
+    void print(OutputStream &out) override;
     bool isGlobal() const { return scope == GLOBAL; };
     bool isParam() const { return scope == PARAM; };
     bool isLocal() const { return scope >= LOCAL; };
     void setValue(int value){this->ConstantValue = value;};
     int getScope() const { return scope; };
+    int getNameId() const { return nameId; };
     void setAddr(Operand *addr) { this->addr = addr; };
     Operand *getAddr() { return addr; };         // You can add any function you need here.
     bool isConstant() const { return isConst; }; // 新增方法用于判断是否为const
@@ -211,35 +222,79 @@ private:
 public:
     TemporarySymbolEntry(Type *type, int label);
     virtual ~TemporarySymbolEntry() {};
-    std::string toStr();
+    void print(OutputStream &out) override;
     int getLabel() const { return label; };
     void setOffset(int offset) { this->stack_offset = offset; };
     int getOffset() { return this->stack_offset; };
     // You can add any function you need here.
 };
 
-// symbol table managing identifier symbol entries
+/*
+    Identifier names interned for one compilation. The lexer interns every
+    ID as it scans it, so equal spellings share one string and one small
+    integer; the symbol table hashes that integer and identifier entries
+    point at the shared string instead of keeping a copy.
+*/
+class NameTable
+{
+private:
+    std::deque<std::string> spellings; // 按编号存放，deque 扩展时已有元素不移动
+    std::unordered_map<std::string_view, int> ids;
+
+public:
+    int intern(const char *name, size_t length);
+    int intern(const std::string &name) { return intern(name.data(), name.size()); };
+    const std::string &getName(int id) const { return spellings[id]; };
+};
+
+/*
+    Symbol table managing identifier symbol entries.
+
+    All scopes share one open-addressing hash table keyed by the interned
+    name, holding the innermost visible binding of each name and the level
+    it was declared at, so lookup is a single probe sequence no matter how
+    deeply blocks nest. install() records the binding it shadows in an undo
+    log; exitScope() replays the log back to the mark set by enterScope().
+*/
 class SymbolTable
 {
 private:
-    std::map<std::string, SymbolEntry *> symbolTable;
-    SymbolTable *prev;
+    struct Binding
+    {
+        int name; // -1 表示空槽
+        int level;
+        SymbolEntry *entry; // 为空表示该名字当前没有可见的声明
+    };
+    std::vector<Binding> slots;      // 容量为 2 的幂，至多一半被占用
+    size_t used;
+    std::vector<Binding> undoLog;    // install 前该名字的绑定
+    std::vector<size_t> scopeMarks;  // 各层作用域开始时 undoLog 的长度
     int level;
-    static int counter;
+    static thread_local int counter;
+
+    Binding &slotOf(int name); // name 所在的槽，不存在时为它应放入的空槽
+    void grow();
 
 public:
     SymbolTable();
-    SymbolTable(SymbolTable *prev);
-    void install(std::string name, SymbolEntry *entry);
-    SymbolEntry *lookup(std::string name);
-    SymbolEntry *lookupCurrentLevel(std::string name);
-    SymbolTable *getPrev() { return prev; };
+    void enterScope();
+    void exitScope();
+    void install(int name, SymbolEntry *entry);
+    SymbolEntry *lookup(int name);
+    SymbolEntry *lookupCurrentLevel(int name);
     int getLevel() { return level; };
     static int getLabel() { return counter++; };
-    bool checkExist(std::string name);
+    static void resetLabel() { counter = 0; }; // 每个编译单元的临时变量和标号从 0 开始编号
+    // 后端各函数的虚拟寄存器互不相干，每个函数从同一个编号开始各自编号，可以在不同线程上生成
+    static int peekLabel() { return counter; };
+    static void setLabel(int label) { counter = label; };
+    bool checkExist(int name);
 };
 
-extern SymbolTable *identifiers;
-extern SymbolTable *globals;
+// 当前线程正在编译的单元的作用域和全局作用域
+extern thread_local SymbolTable *identifiers;
+extern thread_local SymbolTable *globals;
+// 当前线程正在编译的单元的标识符名字表
+extern thread_local NameTable *names;
 
 #endif
@@ -0,0 +1,43 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    固定数目的工作线程，按提交顺序从一个共享队列里取任务执行。
+    wait() 阻塞到已提交的任务全部完成；析构时等待剩余任务并回收线程。
+*/
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable hasJob;
+    std::condition_variable idle;
+    int running = 0;
+    bool stopping = false;
+
+    void work();
+
+public:
+    // threads 为 0 时使用硬件支持的并发线程数
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    void submit(std::function<void()> job);
+    void wait();
+    unsigned size() const { return workers.size(); };
+};
+
+// 对 [0, n) 中的每个下标调用 body，返回时全部完成。pool 为空时在当前线程上按顺序执行；
+// 任务抛出的异常在全部完成后重新抛出
+void parallelFor(ThreadPool *pool, size_t n, const std::function<void(size_t)> &body);
+
+#endif
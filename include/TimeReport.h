@@ -0,0 +1,103 @@
+#ifndef __TIMEREPORT_H__
+#define __TIMEREPORT_H__
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Unit;
+class MachineUnit;
+class MachineFunction;
+class ThreadPool;
+
+/*
+    -ftime-report：每个阶段和 PassManager 中的每个 pass 用 TimeRegion 包住，
+    记录耗时、峰值 RSS 的增长和前后的 IR/机器指令数。区间可以嵌套，
+    同一父记录下同名的区间合并为一条。setCurrent() 之后才在当前线程生效。
+    timedParallelFor() 的每个任务用自己的报告，结束后按下标并入调用线程的报告，
+    因此任意 -j 下的行相同；这些行的机器指令数和耗时是各函数之和。
+*/
+class TimeReport
+{
+public:
+    struct Record
+    {
+        std::string name;
+        int parent; // 父记录的下标，-1 表示顶层
+        int depth;
+        int calls = 0;
+        double wall = 0; // 秒
+        long rss = 0;    // 峰值 RSS 的增长，KB
+        size_t irBefore = 0, irAfter = 0;
+        size_t mirBefore = 0, mirAfter = 0;
+        bool counted = true; // lex 这样只累计时间的记录没有后面几项
+    };
+
+    TimeReport(Unit *unit, MachineUnit *munit);
+    // 并行任务使用的报告，只统计 func 的机器指令，func 为空时不统计
+    explicit TimeReport(MachineFunction *func);
+    void begin(const char *name);
+    void end();
+    // 只累计时间，供每个 token 都要计时的词法分析使用
+    void addTime(const char *name, double seconds);
+    void print(FILE *out) const;
+    void printJSON(FILE *out) const;
+    // 把各任务的报告并入当前所在的记录之下，只能在调用线程上所有任务结束后调用
+    void merge(const std::vector<TimeReport> &jobs);
+
+    static TimeReport *current() { return active; };
+    static void setCurrent(TimeReport *report) { active = report; };
+
+    typedef std::chrono::steady_clock clock;
+
+private:
+    struct Frame
+    {
+        int record;
+        clock::time_point start;
+        long rss;
+    };
+    Unit *unit;
+    MachineUnit *munit;
+    MachineFunction *func = nullptr;
+    std::vector<Record> records;
+    std::vector<Frame> stack;
+    clock::time_point created;
+    long startRss;
+
+    int find(const char *name, bool counted);
+    int find(const char *name, bool counted, int parent, int depth);
+    size_t countIR() const;
+    size_t countMachine() const;
+    static long peakRss();
+    static thread_local TimeReport *active;
+};
+
+// 作用域内的代码计入名为 name 的记录
+class TimeRegion
+{
+    TimeReport *report;
+
+public:
+    explicit TimeRegion(const char *name) : report(TimeReport::current())
+    {
+        if (report)
+            report->begin(name);
+    };
+    ~TimeRegion()
+    {
+        if (report)
+            report->end();
+    };
+    TimeRegion(const TimeRegion &) = delete;
+    TimeRegion &operator=(const TimeRegion &) = delete;
+};
+
+// 与 parallelFor 相同，但任务 i 中的 TimeRegion 也记入调用线程当前的报告，
+// 机器指令按 funcs[i] 统计（funcs 为空时不统计）
+void timedParallelFor(ThreadPool *pool, size_t n, const std::function<void(size_t)> &body,
+                      const std::vector<MachineFunction *> *funcs = nullptr);
+
+#endif
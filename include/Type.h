@@ -3,10 +3,15 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <unordered_map>
+#include "Arena.h"
 using namespace std;
 
+class OutputStream;
+
 // 基类 Type
-class Type
+class Type : public ArenaNode<Arena::TYPE, Type>
 {
 private:
     int kind;
@@ -33,7 +38,9 @@ public:
     int size;
     Type(int kind,int size) : kind(kind),size(size) {};
     virtual ~Type() {};
-    virtual std::string toStr() = 0;
+    // 把类型的文本形式直接写到 out；toStr() 经由它得到同样的字符串
+    virtual void print(OutputStream &out) = 0;
+    std::string toStr();
 
     bool isInt() const { return kind == INT; };
     bool isVoid() const { return kind == VOID; };
@@ -52,8 +59,15 @@ public:
     int get(){return kind;}
     int getSize() const { return size; };
     bool isPtr() const { return kind == PTR; };
+    bool isArray() const { return kind == ARRAY; };
 };
 
+inline OutputStream &operator<<(OutputStream &out, Type *type)
+{
+    type->print(out);
+    return out;
+}
+
 // 各种类型的定义
 class IntType : public Type
 {
@@ -62,7 +76,7 @@ private:
 
 public:
     IntType(int size) : Type(Type::INT,size) {};
-    std::string toStr();
+    void print(OutputStream &out) override;
 };
 class BoolType : public Type
 {
@@ -71,23 +85,24 @@ private:
 
 public:
     BoolType(int size, bool is_const = false) : Type(Type::BOOL,size) {};
-    std::string toStr() override;
+    void print(OutputStream &out) override;
 };
 class VoidType : public Type
 {
 public:
     VoidType() : Type(Type::VOID,0) {};
-    std::string toStr();
+    void print(OutputStream &out) override;
 };
 
+// 派生类型（函数、指针、const、数组）由 TypeSystem 的 getXXXType() 唯一化创建，不要直接 new
 class FunctionType : public Type
 {
 private:
     Type *returnType;          // 返回值类型
     vector<Type *> paramsType; // 参数类型
 public:
-    FunctionType(Type *returnType, vector<Type *> paramsType) : Type(Type::FUNC,0), returnType(returnType), paramsType(paramsType) {};
-    void setParamsType(vector<Type *> p) { paramsType = p; }
+    FunctionType(Type *returnType, const vector<Type *> &paramsType) : Type(Type::FUNC,0), returnType(returnType), paramsType(paramsType) {};
+    const vector<Type *> &getParamsTypes() const { return paramsType; };
     Type *getParamsType(unsigned int index)
     {
         if (index < paramsType.size())
@@ -96,7 +111,7 @@ public:
             return nullptr;
     }
     Type *getRetType() { return returnType; };
-    std::string toStr();
+    void print(OutputStream &out) override;
 };
 
 class DecimalType : public Type
@@ -106,7 +121,7 @@ private:
 
 public:
     DecimalType(int size) : Type(Type::DECIMAL,size) {}
-    std::string toStr() override;
+    void print(OutputStream &out) override;
 };
 
 
@@ -120,7 +135,7 @@ private:
 
 public:
     FloatType(int size) : Type(Type::FLOAT,size) {}
-    std::string toStr() override;
+    void print(OutputStream &out) override;
 };
 
 
@@ -134,18 +149,22 @@ private:
 
 public:
     ConstType(Type *baseType) : Type(Type::CONST,32), baseType(baseType) {} // 设置为 CONST 类型，并记录基础类型
-    std::string toStr() override;
+    void print(OutputStream &out) override;
     Type *getBaseType() const { return baseType; } // 获取基础类型
 };
 
+// 多维数组是数组的数组：int a[2][3] 的类型为 [2 x [3 x i32]]
 class ArrayType : public Type
 {
 private:
-    // int size;
+    Type *elementType;
+    int length;
 
 public:
-    ArrayType(int size) : Type(Type::ARRAY,0) {} // 将类型设置为 ARRAY
-    std::string toStr() override;
+    ArrayType(Type *elementType, int length) : Type(Type::ARRAY, elementType->getSize() * length), elementType(elementType), length(length) {}
+    void print(OutputStream &out) override;
+    Type *getElementType() const { return elementType; };
+    int getLength() const { return length; };
 };
 class PointerType : public Type
 {
@@ -154,10 +173,30 @@ private:
 
 public:
     PointerType(Type *valueType) : Type(Type::PTR,0) { this->valueType = valueType; };
-    std::string toStr();
+    void print(OutputStream &out) override;
 
     Type *getValueType() { return valueType; }
 };
+/*
+    一次编译中的派生类型表：结构相同的函数、指针、常量和数组类型只建一次，
+    类型相等即指针相等。类型本身分配在 arena 中，这里只做索引。
+*/
+class TypeContext
+{
+private:
+    std::unordered_map<Type *, Type *> pointers;
+    std::unordered_map<Type *, Type *> consts;
+    std::map<std::pair<Type *, int>, Type *> arrays;
+    std::unordered_multimap<size_t, FunctionType *> functions; // 按返回值和形参类型的哈希
+
+public:
+    TypeContext();
+    Type *getPointerType(Type *valueType);
+    Type *getConstType(Type *baseType);
+    Type *getArrayType(Type *elementType, int length);
+    Type *getFunctionType(Type *returnType, const vector<Type *> &paramsType);
+};
+
 class TypeSystem
 {
 private:
@@ -171,8 +210,9 @@ private:
 
     static FloatType commonFloat;
 
-    static ArrayType commonArray;
     static ConstType commonConst;
+    // 当前线程正在编译的单元的派生类型
+    static thread_local TypeContext *context;
 
 public:
     static Type *intType;
@@ -184,9 +224,12 @@ public:
     static Type *octalFloatType;
     static Type *hexFloatType;
     static Type *constType;
-    static Type *arrayType;
 
-    static Type *getConstType(Type *baseType); // 获取常量类型
+    static void setContext(TypeContext *c) { context = c; };
+    static Type *getConstType(Type *baseType) { return context->getConstType(baseType); }; // 获取常量类型
+    static Type *getPointerType(Type *valueType) { return context->getPointerType(valueType); };
+    static Type *getArrayType(Type *elementType, int length) { return context->getArrayType(elementType, length); };
+    static Type *getFunctionType(Type *returnType, const vector<Type *> &paramsType) { return context->getFunctionType(returnType, paramsType); };
     static bool needCast(Type *type1, Type *type2);
 };
 
@@ -4,6 +4,10 @@
 #include <vector>
 #include "Function.h"
 #include "AsmBuilder.h"
+#include "Arena.h"
+
+class ThreadPool;
+class FunctionCache;
 
 class Unit
 {
@@ -13,6 +17,8 @@ class Unit
 private:
     std::vector<Function *> func_list;
     std::vector<GlobalVarDefInstruction *> global_var;
+    std::vector<SymbolEntry *> global_syms; // 全局变量的符号表项，生成机器代码时交给 MachineUnit
+    Arena arena; // 该编译单元所有 IR 节点的内存来源
 
 public:
     Unit() = default;
@@ -21,6 +27,8 @@ public:
     void removeFunc(Function *);
     void insertGlobalVar(GlobalVarDefInstruction *i) { global_var.push_back(i); }
     void removeGlobalVar(GlobalVarDefInstruction *i) { global_var.erase(std::find(global_var.begin(), global_var.end(), i)); }
+    std::vector<GlobalVarDefInstruction *> &getGlobalVars() { return global_var; };
+    void insertGlobal(SymbolEntry *se) { global_syms.push_back(se); };
     void output() const;
     void initLibraryFunctions();
     iterator begin() { return func_list.begin(); };
@@ -29,7 +37,9 @@ public:
     reverse_iterator rend() { return func_list.rend(); };
     void removeUnusedAlloca();
     void samebboptimize();
-    void genMachineCode(MachineUnit* munit);
+    // pool 非空时各函数并行生成；cache 非空时命中缓存的函数直接使用缓存的汇编
+    void genMachineCode(MachineUnit* munit, ThreadPool *pool = nullptr, FunctionCache *cache = nullptr);
+    Arena *getArena() { return &arena; };
 };
 
 #endif
\ No newline at end of file
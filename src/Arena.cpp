@@ -0,0 +1,123 @@
+#include "Arena.h"
+#include <cstdlib>
+#include <new>
+
+thread_local Arena *Arena::active = nullptr;
+thread_local bool Arena::finalizing = false;
+
+// 每个节点前面的头部，按最大对齐补齐，使节点本身仍然对齐
+union NodeHeader
+{
+    Arena::Destroy destroy; // 节点被显式 delete 后置空
+    std::max_align_t align;
+};
+
+static NodeHeader *headerOf(void *node)
+{
+    return static_cast<NodeHeader *>(node) - 1;
+}
+
+static const char *kindName[Arena::NUM_KINDS] = {
+    "Instruction",
+    "Operand",
+    "BasicBlock",
+    "Function",
+    "SymbolEntry",
+    "Type"};
+
+Arena::Arena(size_t chunkSize) : cur(nullptr), end(nullptr), chunkSize(chunkSize), reserved(0)
+{
+    for (int i = 0; i < NUM_KINDS; i++)
+        bytes[i] = count[i] = 0;
+}
+
+Arena::~Arena()
+{
+    release();
+    if (active == this)
+        active = nullptr;
+}
+
+void *Arena::allocate(size_t size, Kind kind, Destroy destroy)
+{
+    const size_t align = alignof(std::max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+    bytes[kind] += size;
+    count[kind]++;
+    size += sizeof(NodeHeader);
+    if (cur == nullptr || size > (size_t)(end - cur))
+    {
+        // 超过 chunk 大小的节点单独占一个 chunk，不影响当前 chunk 的剩余空间
+        size_t len = size > chunkSize ? size : chunkSize;
+        char *chunk = (char *)std::malloc(len);
+        if (chunk == nullptr)
+            throw std::bad_alloc();
+        chunks.push_back(chunk);
+        reserved += len;
+        if (len > chunkSize)
+            return track(chunk, destroy);
+        cur = chunk;
+        end = chunk + len;
+    }
+    char *p = cur;
+    cur += size;
+    return track(p, destroy);
+}
+
+void *Arena::track(char *block, Destroy destroy)
+{
+    auto header = reinterpret_cast<NodeHeader *>(block);
+    header->destroy = destroy;
+    nodes.push_back(header + 1);
+    return header + 1;
+}
+
+void Arena::forget(void *node)
+{
+    headerOf(node)->destroy = nullptr;
+}
+
+void Arena::release()
+{
+    // 后分配的先析构；析构函数看到 finalizing 时不再访问其他节点，因此顺序并不重要
+    bool saved = finalizing;
+    finalizing = true;
+    for (auto it = nodes.rbegin(); it != nodes.rend(); it++)
+    {
+        auto header = headerOf(*it);
+        if (header->destroy != nullptr)
+        {
+            auto destroy = header->destroy;
+            header->destroy = nullptr;
+            destroy(*it);
+        }
+    }
+    finalizing = saved;
+    nodes.clear();
+    for (auto chunk : chunks)
+        std::free(chunk);
+    chunks.clear();
+    cur = end = nullptr;
+    reserved = 0;
+}
+
+void Arena::report(FILE *out) const
+{
+    size_t totalBytes = 0, totalCount = 0;
+    fprintf(out, "IR memory report:\n");
+    fprintf(out, "  %-12s %10s %12s\n", "kind", "count", "bytes");
+    for (int i = 0; i < NUM_KINDS; i++)
+    {
+        fprintf(out, "  %-12s %10zu %12zu\n", kindName[i], count[i], bytes[i]);
+        totalBytes += bytes[i];
+        totalCount += count[i];
+    }
+    fprintf(out, "  %-12s %10zu %12zu\n", "total", totalCount, totalBytes);
+    fprintf(out, "  %zu chunk(s), %zu bytes reserved\n", chunks.size(), reserved);
+}
+
+Arena *Arena::current()
+{
+    static thread_local Arena fallback;
+    return active ? active : &fallback;
+}
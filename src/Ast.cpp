@@ -5,16 +5,17 @@
 #include "IRBuilder.h"
 #include <string>
 #include "Type.h"
+#include "Compiler.h"
+#include "OutputStream.h"
 using namespace std;
 
-extern FILE *yyout;
-int Node::counter = 0;
-extern MachineUnit mUnit;
-IRBuilder *Node::builder = nullptr;
-Type *returnType = nullptr;
-bool funcReturned = false;
-Type *retType = nullptr;
-bool hasRet = false;
+extern thread_local OutputStream *code_out;
+thread_local int Node::counter = 0;
+thread_local IRBuilder *Node::builder = nullptr;
+thread_local Type *returnType = nullptr;
+thread_local bool funcReturned = false;
+thread_local Type *retType = nullptr;
+thread_local bool hasRet = false;
 
 Node::Node()
 {
@@ -43,9 +44,10 @@ std::vector<Instruction *> Node::merge(std::vector<Instruction *> &list1, std::v
 void Ast::genCode(Unit *unit)
 {
     // cout << "Ast::genCode(Unit *unit)" << endl;
-    IRBuilder *builder = new IRBuilder(unit);
-    Node::setIRBuilder(builder);
+    IRBuilder builder(unit);
+    Node::setIRBuilder(&builder);
     root->genCode();
+    Node::setIRBuilder(nullptr);
 }
 
 void FunctionDef::genCode()
@@ -56,13 +58,8 @@ void FunctionDef::genCode()
     BasicBlock *entry = func->getEntry();    // 获取函数的入口块
     // set the insert point to the entry basicblock of this function.
     builder->setInsertBB(entry);    // 设置当前插入点为函数的入口块
-    DeclStmt *curr = FuncDefParams; // 获取函数定义的参数列表
-    while (curr != nullptr)         // 遍历函数定义的参数列表
-    {
-        func->addParam(curr->getId()->getSymPtr()); // 为函数添加参数
-        curr->genCode();
-        curr = (DeclStmt *)curr->getNext();
-    }
+    if (FuncDefParams != nullptr) // 形参的声明会依次把自己加入函数的参数列表
+        FuncDefParams->genCode();
     stmt->genCode();
 
     /**
@@ -642,11 +639,6 @@ void DeclStmt::genCode()
     //     se->setAddr(addr);                        // set the addr operand in symbol entry so that we can use it in subsequent code generation.
     // }
 
-    if (next != nullptr)
-    {
-        next->genCode(); // 递归生成下一个声明语句
-    }
-
     IdentifierSymbolEntry *se = dynamic_cast<IdentifierSymbolEntry *>(id->getSymPtr());
     // fstderr, "处理声明: %s\n", se->toStr().c_str()); // 输出正在处理的声明的名称
 
@@ -656,10 +648,10 @@ void DeclStmt::genCode()
         Operand *addr;
         SymbolEntry *addr_se;
         addr_se = new IdentifierSymbolEntry(*se);
-        addr_se->setType(new PointerType(se->getType())); // 为全局变量生成指针类型
+        addr_se->setType(TypeSystem::getPointerType(se->getType())); // 为全局变量生成指针类型
         addr = new Operand(addr_se);
         se->setAddr(addr);
-        mUnit.InsertGlobal(se);
+        builder->getUnit()->insertGlobal(se);
         if (expr == nullptr)
         {
             // fprintf(stderr, "全局变量 %s 未初始化\n", se->toStr().c_str()); // 输出未初始化的全局变量信息
@@ -684,7 +676,7 @@ void DeclStmt::genCode()
         Operand *addr;
         SymbolEntry *addr_se;
         Type *type;
-        type = new PointerType(se->getType());
+        type = TypeSystem::getPointerType(se->getType());
         addr_se = new TemporarySymbolEntry(type, SymbolTable::getLabel());
         addr = new Operand(addr_se);
 
@@ -717,6 +709,13 @@ void DeclStmt::genCode()
         addr_se = new TemporarySymbolEntry(se->getType(), SymbolTable::getLabel());
         addr = new Operand(addr_se);
         se->setAddr(addr);
+        builder->getInsertBB()->getParent()->addParam(addr); // 形参的值，函数体内同名的局部变量由它初始化
+    }
+
+    // 按书写顺序生成下一个声明语句
+    if (next != nullptr)
+    {
+        next->genCode();
     }
 }
 
@@ -793,11 +792,11 @@ void AssignStmt::genCode()
 
 void Ast::typeCheck()
 {
-    SymbolEntry *se = identifiers->lookup("main");
+    SymbolEntry *se = identifiers->lookup(names->intern("main"));
     if (se == nullptr)
     {
         fprintf(stderr, "类型检查错误：没有找到main函数\n");
-        exit(EXIT_FAILURE); // 退出编译器
+        throw CompileError(); // 结束本次编译
     }
     if (root != nullptr)
     {
@@ -808,14 +807,11 @@ void Ast::typeCheck()
 void FunctionDef::typeCheck()
 {
     returnType = ((FunctionType *)se->getType())->getRetType();
-    string name = se->toStr();
-    // cout << name;
-    string type = se->getType()->toStr();
-    // cout << type;
-    if (name == "@main" && type != "i32()")
+    // 类型是唯一化的，比较指针即可
+    if (se->getName() == "main" && se->getType() != TypeSystem::getFunctionType(TypeSystem::intType, {}))
     {
         fprintf(stderr, "函数返回值错误\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     stmt->typeCheck();
     //     if(returnType->isInt())cout<<"asdsda";
@@ -846,7 +842,7 @@ void FunctionDef::typeCheck()
     if (!funcReturned && !returnType->isVoid())
     {
         fprintf(stderr, "类型检查错误：int类型函数无返回值或返回值为void\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
 
     // 如果是void类型函数且没有写return，需要补上一个隐式的return
@@ -893,7 +889,7 @@ void FuncCallExp::typeCheck()
         if (p == nullptr)
         {
             fprintf(stderr, "类型检查错误：函数参数数量错误\n");
-            exit(EXIT_FAILURE);
+            throw CompileError();
         }
         // fprintf(stderr,"是否为空指针 %d\n",p==nullptr);
         // fprintf(stderr,"此时p是%s\n",p->toStr().c_str());
@@ -901,20 +897,20 @@ void FuncCallExp::typeCheck()
         if (p->isVoid())
         {
             fprintf(stderr, "类型检查错误：函数参数类型错误\n");
-            exit(EXIT_FAILURE);
+            throw CompileError();
         }
         Type *currType = curr->getSymPtr()->getType();
         if (currType->isVoid())
         {
             fprintf(stderr, "类型检查错误：函数参数类型错误\n");
-            exit(EXIT_FAILURE);
+            throw CompileError();
         }
         if (currType->isFunc())
             currType = ((FunctionType *)currType)->getRetType();
         if (!Type::isValid(p, currType))
         {
             fprintf(stderr, "类型检查错误：函数参数类型错误\n");
-            exit(EXIT_FAILURE);
+            throw CompileError();
         }
 
         i++;
@@ -923,7 +919,7 @@ void FuncCallExp::typeCheck()
     if (t->getParamsType(i) != nullptr)
     {
         fprintf(stderr, "类型检查错误：函数参数数量错误\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
 }
 void FuncCallExp::genCode()
@@ -977,9 +973,6 @@ void UnaryExpr::genCode()
             src = temp;
         }
         new XorInstruction(dst, src, bb);
-
-        Operand* temp1 = new Operand(new TemporarySymbolEntry(TypeSystem::boolType, SymbolTable::getLabel()));
-        new CmpInstruction(CmpInstruction::NE, temp1, src, new Operand(new ConstantSymbolEntry(TypeSystem::intType, 1)), bb);
         BasicBlock* bb = builder->getInsertBB();
         Function* func = bb->getParent();
         BasicBlock *truebb = new BasicBlock(func);
@@ -1030,7 +1023,7 @@ void BinaryExpr::typeCheck()
     if (op == DIV && expr2->cbcai && expr2->cbcaivalue == 0) // reference
     {
         fprintf(stderr, "类型检查错误：除数为0\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     if (expr1->cbcai && expr2->cbcai)
     {
@@ -1050,7 +1043,7 @@ void BinaryExpr::typeCheck()
             if (expr2->cbcaivalue == 0)
             {
                 fprintf(stderr, "类型检查错误：除数为0\n");
-                exit(EXIT_FAILURE);
+                throw CompileError();
             }
             cbcaivalue = expr1->cbcaivalue / expr2->cbcaivalue;
             break;
@@ -1087,7 +1080,7 @@ void BinaryExpr::typeCheck()
     {
         // 如果 expr1 是 void 类型，报错或提示不能与 void 类型运算
         fprintf(stderr, "类型检查错误：不能与void类型进行运算\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
 
         return; // 或者抛出异常
     }
@@ -1096,7 +1089,7 @@ void BinaryExpr::typeCheck()
     {
         // 如果 expr2 是 void 类型，报错或提示不能与 void 类型运算
         fprintf(stderr, "类型检查错误：不能与void类型进行运算");
-        exit(EXIT_FAILURE);
+        throw CompileError();
 
         return; // 或者抛出异常
     }
@@ -1111,7 +1104,7 @@ void UnaryExpr::typeCheck()
     if (type->isVoid())
     {
         fprintf(stderr, "类型检查错误：表达式类型为void\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     else if (type->isFunc())
     {
@@ -1120,7 +1113,7 @@ void UnaryExpr::typeCheck()
         if (returnType->isVoid())
         {
             fprintf(stderr, "类型检查错误：函数返回值void参与单目运算\n");
-            exit(EXIT_FAILURE);
+            throw CompileError();
         }
     }
 
@@ -1147,7 +1140,7 @@ void Constant::typeCheck()
     if (symbolEntry->getType()->isInt())
     {
         this->cbcai = true;
-        this->cbcaivalue = atoi(symbolEntry->toStr().c_str());
+        this->cbcaivalue = ((ConstantSymbolEntry *)symbolEntry)->getValue();
     }
     // printf("Constant::typeCheck\n");
 }
@@ -1173,7 +1166,7 @@ void IfStmt::typeCheck()
     {
         // 如果条件不是布尔类型，则输出错误并抛出异常
         fprintf(stderr, "类型检查错误：if的cond为void类型\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
 }
 
@@ -1257,7 +1250,7 @@ void DeclStmt::typeCheck()
         {
             // 输出错误信息
             fprintf(stderr, "类型检查错误：不能与void类型进行运算\n");
-            exit(EXIT_FAILURE);
+            throw CompileError();
         }
 
         // 检查变量类型和表达式类型是否匹配
@@ -1271,17 +1264,17 @@ void ReturnStmt::typeCheck()
     if (returnType == nullptr)
     { // not in a fuction
         fprintf(stderr, "return statement outside functions\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     else if (returnType->isVoid() && retValue != nullptr)
     { // returned a value in void()
         fprintf(stderr, "类型检查错误：返回类型错误\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     else if (!returnType->isVoid() && retValue == nullptr)
     { // expected returned value, but returned nothing
         fprintf(stderr, "expected a %s type to return, but returned nothing\n", returnType->toStr().c_str());
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     if (!returnType->isVoid())
     {
@@ -1290,12 +1283,12 @@ void ReturnStmt::typeCheck()
     if (retValue->getType()->isVoid() && !returnType->isVoid())
     {
         fprintf(stderr, "类型检查错误：返回类型错误\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     if (retValue->getType()->isInt() && returnType->isVoid())
     {
         fprintf(stderr, "类型检查错误：返回类型错误\n");
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     this->retType = returnType;
     funcReturned = true;
@@ -1306,7 +1299,7 @@ void AssignStmt::typeCheck()
     if (expr->getType()->isFunc() && ((FunctionType *)(expr->getType()))->getRetType()->isVoid())
     { // 返回值为void的函数做运算数
         fprintf(stderr, "expected a return value, but functionType %s returns nothing\n", expr->getType()->toStr().c_str());
-        exit(EXIT_FAILURE);
+        throw CompileError();
     }
     // Todo
     // cout << "AssignStmt::typeCheck" << endl;
@@ -1376,14 +1369,14 @@ void BinaryExpr::output(int level)
         op_str = "greaterequal";
         break;
     }
-    fprintf(yyout, "%*cBinaryExpr\top: %s\n", level, ' ', op_str.c_str());
+    code_out->printf("%*cBinaryExpr\top: %s\n", level, ' ', op_str.c_str());
     expr1->output(level + 4);
     expr2->output(level + 4);
 }
 
 void Ast::output()
 {
-    fprintf(yyout, "program\n");
+    code_out->printf("program\n");
     if (root != nullptr)
         root->output(4);
 }
@@ -1393,7 +1386,7 @@ void Constant::output(int level)
     std::string type, value;
     type = symbolEntry->getType()->toStr();
     value = symbolEntry->toStr();
-    fprintf(yyout, "%*cIntegerLiteral\tvalue: %s\ttype: %s\n", level, ' ',
+    code_out->printf("%*cIntegerLiteral\tvalue: %s\ttype: %s\n", level, ' ',
             value.c_str(), type.c_str());
 }
 
@@ -1402,7 +1395,7 @@ void ConstExpr::output(int level)
     std::string type, value;
     type = symbolEntry->getType()->toStr();
     value = symbolEntry->toStr(); // 这里可以获取常量的具体值
-    fprintf(yyout, "%*cConstExpr\tvalue: %s\ttype: %s\n", level, ' ',
+    code_out->printf("%*cConstExpr\tvalue: %s\ttype: %s\n", level, ' ',
             value.c_str(), type.c_str());
 }
 
@@ -1411,7 +1404,7 @@ void Float::output(int level)
     std::string type, value;
     type = symbolEntry->getType()->toStr();
     value = symbolEntry->toStr();
-    fprintf(yyout, "%*cFloat\tvalue: %s\ttype: %s\n", level, ' ',
+    code_out->printf("%*cFloat\tvalue: %s\ttype: %s\n", level, ' ',
             value.c_str(), type.c_str());
 }
 void Float::typeCheck()
@@ -1428,7 +1421,7 @@ void Bool::output(int level)
     std::string type, value;
     type = symbolEntry->getType()->toStr();
     value = symbolEntry->toStr();
-    fprintf(yyout, "%*cBool\tvalue: %s\ttype: %s\n", level, ' ',
+    code_out->printf("%*cBool\tvalue: %s\ttype: %s\n", level, ' ',
             value.c_str(), type.c_str());
 }
 void Bool::typeCheck()
@@ -1447,25 +1440,25 @@ void Id::output(int level)
     name = symbolEntry->toStr();
     type = symbolEntry->getType()->toStr();
     scope = dynamic_cast<IdentifierSymbolEntry *>(symbolEntry)->getScope();
-    fprintf(yyout, "%*cId\tname: %s\tscope: %d\ttype: %s\n", level, ' ',
+    code_out->printf("%*cId\tname: %s\tscope: %d\ttype: %s\n", level, ' ',
             name.c_str(), scope, type.c_str());
 }
 
 void CompoundStmt::output(int level)
 {
-    fprintf(yyout, "%*cCompoundStmt\n", level, ' ');
+    code_out->printf("%*cCompoundStmt\n", level, ' ');
     stmt->output(level + 4);
 }
 
 void ExprStmt::output(int level)
 {
-    fprintf(yyout, "%*cExprStmt\n", level, ' ');
+    code_out->printf("%*cExprStmt\n", level, ' ');
     expr->output(level + 4);
 }
 
 void EmptyStmt::output(int level)
 {
-    fprintf(yyout, "%*cEmptyStmt\n", level, ' ');
+    code_out->printf("%*cEmptyStmt\n", level, ' ');
 }
 
 void SeqNode::output(int level)
@@ -1478,20 +1471,20 @@ void SeqNode::output(int level)
 
 void DeclStmt::output(int level)
 {
-    fprintf(yyout, "%*cDeclStmt\n", level, ' ');
+    code_out->printf("%*cDeclStmt\n", level, ' ');
     id->output(level + 4);
 }
 
 void IfStmt::output(int level)
 {
-    fprintf(yyout, "%*cIfStmt\n", level, ' ');
+    code_out->printf("%*cIfStmt\n", level, ' ');
     cond->output(level + 4);
     thenStmt->output(level + 4);
 }
 
 void IfElseStmt::output(int level)
 {
-    fprintf(yyout, "%*cIfElseStmt\n", level, ' ');
+    code_out->printf("%*cIfElseStmt\n", level, ' ');
     cond->output(level + 4);
     thenStmt->output(level + 4);
     elseStmt->output(level + 4);
@@ -1499,14 +1492,14 @@ void IfElseStmt::output(int level)
 
 void WhileStmt::output(int level)
 {
-    fprintf(yyout, "%*cWhileStmt\n", level, ' ');
+    code_out->printf("%*cWhileStmt\n", level, ' ');
     cond->output(level + 4);
     stmt->output(level + 4);
 }
 
 void ReturnStmt::output(int level)
 {
-    fprintf(yyout, "%*cReturnStmt\n", level, ' ');
+    code_out->printf("%*cReturnStmt\n", level, ' ');
     retValue->output(level + 4);
 }
 AssignStmt::AssignStmt(ExprNode *lval, ExprNode *expr) : lval(lval), expr(expr)
@@ -1536,7 +1529,7 @@ AssignStmt::AssignStmt(ExprNode *lval, ExprNode *expr) : lval(lval), expr(expr)
 }
 void AssignStmt::output(int level)
 {
-    fprintf(yyout, "%*cAssignStmt\n", level, ' ');
+    code_out->printf("%*cAssignStmt\n", level, ' ');
     lval->output(level + 4);
     expr->output(level + 4);
 }
@@ -1555,7 +1548,7 @@ void UnaryExpr::output(int level)
         op_str = "not";
         break;
     }
-    fprintf(yyout, "%*cUnaryExpr\top: %s\ttype: %s\n", level, ' ', op_str.c_str(), symbolEntry->getType()->toStr().c_str());
+    code_out->printf("%*cUnaryExpr\top: %s\ttype: %s\n", level, ' ', op_str.c_str(), symbolEntry->getType()->toStr().c_str());
     expr->output(level + 4);
 }
 void FuncCallExp::output(int level)
@@ -1565,7 +1558,7 @@ void FuncCallExp::output(int level)
     name = symbolEntry->toStr();
     type = symbolEntry->getType()->toStr();
     scope = dynamic_cast<IdentifierSymbolEntry *>(symbolEntry)->getScope();
-    fprintf(yyout, "%*cFuncCallExpr\tfunction name: %s\tscope: %d\ttype: %s\n",
+    code_out->printf("%*cFuncCallExpr\tfunction name: %s\tscope: %d\ttype: %s\n",
             level, ' ', name.c_str(), scope, type.c_str());
     Node *temp = param;
     while (temp)
@@ -1580,7 +1573,7 @@ void FunctionDef::output(int level)
     std::string name, type;
     name = se->toStr();
     type = se->getType()->toStr();
-    fprintf(yyout, "%*cFunctionDefine function name: %s, type: %s\n", level, ' ',
+    code_out->printf("%*cFunctionDefine function name: %s, type: %s\n", level, ' ',
             name.c_str(), type.c_str());
     if (name == "main")
     {
@@ -1595,10 +1588,10 @@ void FunctionDef::output(int level)
 
 void BreakStmt::output(int level)
 {
-    fprintf(yyout, "%*cBreakStmt\n", level, ' ');
+    code_out->printf("%*cBreakStmt\n", level, ' ');
 }
 
 void ContinueStmt::output(int level)
 {
-    fprintf(yyout, "%*cContinueStmt\n", level, ' ');
+    code_out->printf("%*cContinueStmt\n", level, ' ');
 }
@@ -1,8 +1,9 @@
 #include "BasicBlock.h"
 #include "Function.h"
 #include <algorithm>
+#include "OutputStream.h"
 
-extern FILE* yyout;
+extern thread_local OutputStream *code_out;
 
 // insert the instruction to the front of the basicblock.
 void BasicBlock::insertFront(Instruction *inst)
@@ -19,16 +20,11 @@ void BasicBlock::insertBack(Instruction *inst)
 // insert the instruction dst before src.
 void BasicBlock::insertBefore(Instruction *dst, Instruction *src)
 {
-    // Todo
-    Instruction *curr = head;
-    while (curr != src)
-    {
-        curr = curr->getNext();
-    }
-    curr->getPrev()->setNext(dst);
-    dst->setPrev(curr->getPrev());
-    curr->setPrev(dst);
-    dst->setNext(curr);
+    // src 必须属于本块，直接在其前面链入，O(1)
+    src->getPrev()->setNext(dst);
+    dst->setPrev(src->getPrev());
+    src->setPrev(dst);
+    dst->setNext(src);
     dst->setParent(this);
 }
 
@@ -42,15 +38,15 @@ void BasicBlock::remove(Instruction *inst)
 void BasicBlock::output() const
 {
     //std::cout<<"BasicBlock::output()"<<std::endl;
-    fprintf(yyout, "B%d:", no);
+    code_out->printf("B%d:", no);
 
     if (!pred.empty())
     {
-        fprintf(yyout, "%*c; preds = %%B%d", 32, '\t', pred[0]->getNo());
+        code_out->printf("%*c; preds = %%B%d", 32, '\t', pred[0]->getNo());
         for (auto i = pred.begin() + 1; i != pred.end(); i++)
-            fprintf(yyout, ", %%B%d", (*i)->getNo());
+            code_out->printf(", %%B%d", (*i)->getNo());
     }
-    fprintf(yyout, "\n");
+    code_out->printf("\n");
     //fprintf(stderr,"准备开始循环输出指令\n");
     for (auto i = head->getNext(); i != head; i = i->getNext())
     {
@@ -93,6 +89,9 @@ BasicBlock::BasicBlock(Function *f)
 
 BasicBlock::~BasicBlock()
 {
+    // arena 统一析构时指令和相邻基本块由 arena 各自析构
+    if (Arena::isFinalizing())
+        return;
     Instruction *inst;
     inst = head->getNext();
     while (inst != head)
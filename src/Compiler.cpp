@@ -0,0 +1,183 @@
+#include "Compiler.h"
+#include "Ast.h"
+#include "Unit.h"
+#include "MachineCode.h"
+#include "LinearScan.h"
+#include "GraphColoring.h"
+#include "MachinePeephole.h"
+#include "PhiElimination.h"
+#include "PassManager.h"
+#include "Arena.h"
+#include "TimeReport.h"
+#include "ThreadPool.h"
+#include "FunctionCache.h"
+#include "OutputStream.h"
+#include "parser.h"
+#include <stdlib.h>
+#include <memory>
+
+extern thread_local OutputStream *code_out;
+
+// flex 生成的可重入扫描器接口，lexer.cpp 没有单独的头文件
+int yylex_init_extra(OutputStream *extra, yyscan_t *scanner);
+int yylex_destroy(yyscan_t scanner);
+struct yy_buffer_state *yy_scan_bytes(const char *bytes, int length, yyscan_t scanner);
+
+bool Compiler::compile(const char *source, size_t length)
+{
+    output.clear();
+    StringOutputStream out(output);
+    bool ok = compile(source, length, out);
+    out.flush();
+    return ok;
+}
+
+bool Compiler::compile(const char *source, size_t length, OutputStream &out)
+{
+    char *reportBuf = nullptr;
+    size_t reportSize = 0;
+    FILE *rep = open_memstream(&reportBuf, &reportSize);
+
+    Ast ast;
+    Unit unit;
+    MachineUnit mUnit;
+    NameTable nameTable;
+    TypeContext typeContext;
+    SymbolTable globalScope;
+    names = &nameTable;
+    TypeSystem::setContext(&typeContext);
+    identifiers = globals = &globalScope;
+    SymbolTable::resetLabel();
+    Node::resetCounter();
+    code_out = &out;
+    Arena::setCurrent(unit.getArena());
+    TimeReport timeReport(&unit, &mUnit);
+    if (options.timeReport != CompileOptions::NO_REPORT)
+        TimeReport::setCurrent(&timeReport);
+
+    bool ok = true;
+    try
+    {
+        unit.initLibraryFunctions();
+        {
+            TimeRegion region("parse");
+            yyscan_t scanner;
+            yylex_init_extra(options.dumpType == TOKENS ? &out : nullptr, &scanner);
+            yy_scan_bytes(source, length, scanner);
+            int failed;
+            try
+            {
+                failed = yyparse(scanner, &ast);
+            }
+            catch (...)
+            {
+                yylex_destroy(scanner);
+                throw;
+            }
+            yylex_destroy(scanner);
+            if (failed)
+                throw CompileError();
+        }
+        if (options.dumpType == AST)
+            ast.output();
+        {
+            TimeRegion region("typecheck");
+            ast.typeCheck();
+        }
+        {
+            TimeRegion region("irgen");
+            ast.genCode(&unit);
+        }
+        PassManager passManager(&unit);
+        passManager.addPipeline(options.optLevel);
+        {
+            TimeRegion region("optimize");
+            passManager.run();
+        }
+        if (options.dumpType == IR)
+        {
+            TimeRegion region("emit");
+            unit.output();
+        }
+        {
+            TimeRegion region("phi-elimination");
+            PhiElimination phiElimination(&unit);
+            phiElimination.pass();
+        }
+        // 输出与线程数无关：各函数的结果按原来的顺序排列，虚拟寄存器按函数各自编号
+        std::unique_ptr<ThreadPool> pool;
+        if (options.threads != 1)
+            pool.reset(new ThreadPool(options.threads));
+        // 影响生成代码的选项是缓存键的一部分
+        std::unique_ptr<FunctionCache> cache;
+        if (!options.cacheDir.empty())
+            cache.reset(new FunctionCache(options.cacheDir, options.cacheSize,
+                                          "-O" + std::to_string(options.optLevel) + (options.graphColoring ? " -C" : "")));
+        {
+            TimeRegion region("isel");
+            unit.genMachineCode(&mUnit, pool.get(), cache.get());
+        }
+        {
+            TimeRegion region("regalloc");
+            if (options.graphColoring)
+            {
+                GraphColoring graphColoring(&mUnit);
+                graphColoring.allocateRegisters(pool.get());
+            }
+            else
+            {
+                LinearScan linearScan(&mUnit);
+                linearScan.allocateRegisters(pool.get());
+            }
+        }
+        MachinePeephole peephole(&mUnit);
+        {
+            TimeRegion region("peephole");
+            peephole.pass(pool.get());
+        }
+        if (cache)
+        {
+            TimeRegion region("cache-store");
+            for (auto func : mUnit.getFuncs())
+                if (!func->isCached())
+                    cache->store(func);
+            cache->evict();
+        }
+        if (options.dumpType == ASM)
+        {
+            TimeRegion region("emit");
+            mUnit.output();
+        }
+        TimeReport::setCurrent(nullptr);
+        if (options.memReport)
+            unit.getArena()->report(rep);
+        if (options.optReport)
+        {
+            passManager.printStats(rep);
+            peephole.printStats(rep);
+        }
+        if (options.raReport)
+            mUnit.printAllocStats(rep);
+        if (options.cacheReport && cache)
+            cache->printStats(rep);
+        if (options.timeReport == CompileOptions::TEXT_REPORT)
+            timeReport.print(rep);
+        else if (options.timeReport == CompileOptions::JSON_REPORT)
+            timeReport.printJSON(rep);
+    }
+    catch (const CompileError &)
+    {
+        ok = false;
+    }
+
+    TimeReport::setCurrent(nullptr);
+    identifiers = globals = nullptr;
+    names = nullptr;
+    TypeSystem::setContext(nullptr);
+    code_out = nullptr;
+    out.flush();
+    fclose(rep);
+    report.assign(reportBuf, reportSize);
+    free(reportBuf);
+    return ok;
+}
@@ -2,8 +2,9 @@
 #include "Unit.h"
 #include "Type.h"
 #include <list>
+#include "OutputStream.h"
 
-extern FILE* yyout;
+extern thread_local OutputStream *code_out;
 
 Function::Function(Unit *u, SymbolEntry *s)
 {
@@ -11,10 +12,16 @@ Function::Function(Unit *u, SymbolEntry *s)
     entry = new BasicBlock(this);//创建entry入口块
     sym_ptr = s;
     parent = u;
+    domTree = nullptr;
+    loopInfo = nullptr;
 }
 
 Function::~Function()
 {
+    invalidateAnalyses();
+    // arena 统一析构时基本块由 arena 各自析构，Unit 也正在销毁
+    if (Arena::isFinalizing())
+        return;
     auto delete_list = block_list;
     for (auto &i : delete_list)
         delete i;
@@ -22,51 +29,74 @@ Function::~Function()
 }
 void FuncCallInstruction::output() const
 {
-    std::string dstr, type, paramStr;
-    dstr = dst->toStr();
-    type = ((FunctionType *)se->getType())->getRetType()->toStr();
-    if (params.size() == 0)
+    Type *retType = ((FunctionType *)se->getType())->getRetType();
+    *code_out << "  ";
+    if (!retType->isVoid())
+        *code_out << operands[0] << " = ";
+    *code_out << "call " << retType << ' ' << se << '(';
+    // operands[0] 为 dst，其后依次为实参
+    for (unsigned int i = 1; i < operands.size(); i++)
     {
-        paramStr = "";
+        if (i > 1)
+            *code_out << ", ";
+        *code_out << operands[i]->getType() << ' ' << operands[i];
     }
-    else
+    *code_out << ")\n";
+}
+// remove the basicblock bb from its block_list.
+void Function::remove(BasicBlock *bb)
+{
+    block_list.erase(std::find(block_list.begin(), block_list.end(), bb));
+}
+
+DominatorTree<BasicBlock> &Function::getDomTree()
+{
+    if (domTree == nullptr)
+        domTree = new DominatorTree<BasicBlock>(entry);
+    return *domTree;
+}
+
+LoopInfo<BasicBlock> &Function::getLoopInfo()
+{
+    if (loopInfo == nullptr)
+        loopInfo = new LoopInfo<BasicBlock>(getDomTree());
+    return *loopInfo;
+}
+
+// 循环信息建立在支配树之上，支配树作废时一并作废
+void Function::invalidateAnalyses(unsigned preserved)
+{
+    if (!(preserved & DOM_TREE))
+        preserved &= ~LOOP_INFO;
+    if (!(preserved & LOOP_INFO))
     {
-        paramStr += params[0]->getType()->toStr() + " " + params[0]->toStr();
-        for (unsigned int i = 1; i < params.size(); i++)
-        {
-            paramStr += ", " + params[i]->getType()->toStr() + " " + params[i]->toStr();
-        }
+        delete loopInfo;
+        loopInfo = nullptr;
     }
-    if (((FunctionType *)se->getType())->getRetType()->isVoid())
+    if (!(preserved & DOM_TREE))
     {
-        fprintf(yyout, "  call %s %s(%s)\n", type.c_str(), se->toStr().c_str(), paramStr.c_str());
+        delete domTree;
+        domTree = nullptr;
     }
-    else
-        fprintf(yyout, "  %s = call %s %s(%s)\n", dstr.c_str(), type.c_str(), se->toStr().c_str(), paramStr.c_str());
 }
-// remove the basicblock bb from its block_list.
-void Function::remove(BasicBlock *bb)
+
+// 函数定义头 "define 返回类型 @名字(形参列表)"
+void Function::printHeader(OutputStream &out) const
 {
-    block_list.erase(std::find(block_list.begin(), block_list.end(), bb));
+    FunctionType *funcType = dynamic_cast<FunctionType *>(sym_ptr->getType());
+    out << "define " << funcType->getRetType() << ' ' << sym_ptr << '(';
+    for (size_t i = 0; i < params.size(); i++)
+        out << (i ? ", " : "") << params[i]->getType() << ' ' << params[i];
+    out << ')';
 }
 
 void Function::output() const
 {
     fprintf(stderr, "\n");
-    FunctionType *funcType = dynamic_cast<FunctionType *>(sym_ptr->getType());
-    Type *retType = funcType->getRetType();
-    std::string paramsStr = "";
-    if (paramsSymPtr.size() != 0)
-    {
-        for (auto p : paramsSymPtr)
-        {
-            paramsStr += p->getType()->toStr() + " " + ((IdentifierSymbolEntry *)p)->getAddr()->toStr() + ", ";
-        }
-        paramsStr = paramsStr.substr(0, paramsStr.size() - 2);
-    }
 
     // 输出函数定义头
-    fprintf(yyout, "define %s %s(%s) {\n", retType->toStr().c_str(), sym_ptr->toStr().c_str(), paramsStr.c_str());
+    printHeader(*code_out);
+    *code_out << " {\n";
 
     // 使用 DFS 标记访问过的基本块
     std::set<BasicBlock *> visitedBlocks;
@@ -74,13 +104,13 @@ void Function::output() const
     // 从入口块开始深度优先遍历，消除不可达基本块
     dfs1(entry, visitedBlocks);
 
-    // 输出已访问的基本块
-    for (auto bb : visitedBlocks)
-    {
-        bb->output();  // 输出已访问的基本块
-    }
+    // 入口块在前，其余可达块按 block_list 的顺序输出，与结点在 arena 中的地址无关
+    entry->output();
+    for (auto bb : block_list)
+        if (bb != entry && visitedBlocks.count(bb))
+            bb->output();
 
-    fprintf(yyout, "}\n");
+    code_out->printf("}\n");
 }
 
 // 使用深度优先搜索（DFS）遍历基本块，消除不可达基本块
@@ -136,6 +166,16 @@ void Function::genMachineCode(AsmBuilder* builder)
         block->genMachineCode(builder);
         map[block] = builder->getBlock();
     }
+    // 入口处把 r0-r3 中的实参复制到形参对应的虚拟寄存器
+    auto entry = map[this->getEntry()];
+    std::vector<MachineInstruction *> paramMoves;
+    for (size_t i = 0; i < params.size() && i < 4; i++)
+    {
+        auto dst = new MachineOperand(MachineOperand::VREG, ((TemporarySymbolEntry *)params[i]->getEntry())->getLabel());
+        auto src = new MachineOperand(MachineOperand::REG, i);
+        paramMoves.push_back(new MovMInstruction(entry, MovMInstruction::MOV, dst, src));
+    }
+    entry->getInsts().insert(entry->getInsts().begin(), paramMoves.begin(), paramMoves.end());
     // Add pred and succ for every block
     for(auto block : block_list)
     {
@@ -145,6 +185,4 @@ void Function::genMachineCode(AsmBuilder* builder)
         for (auto succ = block->succ_begin(); succ != block->succ_end(); succ++)
             mblock->addSucc(map[*succ]);
     }
-    cur_unit->InsertFunc(cur_func);
-
 }
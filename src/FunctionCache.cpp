@@ -0,0 +1,243 @@
+#include "FunctionCache.h"
+#include "Function.h"
+#include "MachineCode.h"
+#include "OutputStream.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+
+extern thread_local OutputStream *code_out;
+
+namespace fs = std::filesystem;
+
+// 后端生成的代码有变化时修改，使旧的缓存条目全部失效
+static const char *cacheVersion = "sysyc function cache 10";
+
+static uint64_t fnv1a(const std::string &s)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : s)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// 运行 print 并把它写到 code_out 的内容作为字符串返回
+template <typename F>
+static std::string capture(F print)
+{
+    std::string text;
+    StringOutputStream out(text);
+    OutputStream *saved = code_out;
+    code_out = &out;
+    print();
+    code_out = saved;
+    out.flush();
+    return text;
+}
+
+// 把 text 中的 ".L编号" 按 from 中的位置换成 to 中同一位置的编号，遇到不在 from 中的标号返回 false
+static bool relabel(const std::string &text, const std::vector<int> &from, const std::vector<int> &to, std::string &result)
+{
+    std::unordered_map<int, int> map;
+    for (size_t i = 0; i < from.size(); i++)
+        map[from[i]] = to[i];
+    result.clear();
+    result.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size())
+    {
+        if (text.compare(i, 2, ".L") != 0 || i + 2 >= text.size() || !isdigit((unsigned char)text[i + 2]))
+        {
+            result.push_back(text[i++]);
+            continue;
+        }
+        size_t j = i + 2;
+        int no = 0;
+        while (j < text.size() && isdigit((unsigned char)text[j]))
+            no = no * 10 + (text[j++] - '0');
+        auto it = map.find(no);
+        if (it == map.end())
+            return false;
+        result += ".L" + std::to_string(it->second);
+        i = j;
+    }
+    return true;
+}
+
+static std::vector<int> positions(size_t n)
+{
+    std::vector<int> v(n);
+    for (size_t i = 0; i < n; i++)
+        v[i] = i;
+    return v;
+}
+
+FunctionCache::FunctionCache(const std::string &dir, size_t capacity, const std::string &options)
+    : dir(dir), capacity(capacity), salt(std::string(cacheVersion) + " " + options),
+      hits(0), misses(0), stores(0), evictions(0), entries(0), bytes(0)
+{
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+}
+
+std::string FunctionCache::pathOf(const std::string &key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.fc", (unsigned long long)fnv1a(key));
+    return dir + "/" + name;
+}
+
+std::string FunctionCache::makeKey(Function *func) const
+{
+    std::string ir = capture([func]
+                             {
+                                 func->printHeader(*code_out);
+                                 *code_out << '\n';
+                                 for (auto bb : func->getBlockList())
+                                     bb->output(); });
+    // 临时变量 %tN 和基本块 BN 按出现的先后重新编号
+    std::string key = salt + "\n";
+    std::unordered_map<int, int> temps, blocks;
+    size_t i = 0;
+    while (i < ir.size())
+    {
+        size_t digits;
+        std::unordered_map<int, int> *names;
+        if (ir.compare(i, 2, "%t") == 0)
+        {
+            digits = i + 2;
+            names = &temps;
+        }
+        else if (ir[i] == 'B' && (i == 0 || ir[i - 1] == '%' || ir[i - 1] == '\n'))
+        {
+            digits = i + 1;
+            names = &blocks;
+        }
+        else
+        {
+            key.push_back(ir[i++]);
+            continue;
+        }
+        if (digits >= ir.size() || !isdigit((unsigned char)ir[digits]))
+        {
+            key.push_back(ir[i++]);
+            continue;
+        }
+        key.append(ir, i, digits - i);
+        int no = 0;
+        while (digits < ir.size() && isdigit((unsigned char)ir[digits]))
+            no = no * 10 + (ir[digits++] - '0');
+        auto it = names->emplace(no, names->size()).first;
+        key += std::to_string(it->second);
+        i = digits;
+    }
+    return key;
+}
+
+bool FunctionCache::lookup(const std::string &key, Function *func, std::string &text)
+{
+    std::string path = pathOf(key);
+    std::ifstream in(path, std::ios::binary);
+    size_t keyLength;
+    if (in && in >> keyLength && in.get() == '\n')
+    {
+        std::stringstream content;
+        content << in.rdbuf();
+        std::string entry = content.str();
+        std::vector<int> nos;
+        for (auto bb : func->getBlockList())
+            nos.push_back(bb->getNo());
+        if (entry.size() >= keyLength && entry.compare(0, keyLength, key) == 0 &&
+            relabel(entry.substr(keyLength), positions(nos.size()), nos, text))
+        {
+            std::error_code ec;
+            fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+            hits++;
+            return true;
+        }
+    }
+    misses++;
+    return false;
+}
+
+void FunctionCache::store(MachineFunction *func)
+{
+    std::vector<int> nos;
+    for (auto block : func->getBlocks())
+        nos.push_back(block->getNo());
+    std::string text;
+    if (!relabel(capture([func]
+                         { func->output(); }),
+                 nos, positions(nos.size()), text))
+        return;
+    const std::string &key = func->getCacheKey();
+    std::string path = pathOf(key);
+    std::ostringstream tmp;
+    tmp << path << ".tmp." << getpid() << "." << std::hash<std::thread::id>()(std::this_thread::get_id());
+    {
+        std::ofstream out(tmp.str(), std::ios::binary);
+        out << key.size() << "\n"
+            << key << text;
+        if (!out)
+            return;
+    }
+    std::error_code ec;
+    fs::rename(tmp.str(), path, ec);
+    if (ec)
+        fs::remove(tmp.str(), ec);
+    else
+        stores++;
+}
+
+void FunctionCache::evict()
+{
+    struct Entry
+    {
+        fs::file_time_type time;
+        size_t size;
+        fs::path path;
+    };
+    std::vector<Entry> list;
+    std::error_code ec;
+    bytes = 0;
+    for (auto &file : fs::directory_iterator(dir, ec))
+    {
+        if (file.path().extension() != ".fc")
+            continue;
+        Entry e{file.last_write_time(ec), (size_t)file.file_size(ec), file.path()};
+        if (ec)
+            continue;
+        bytes += e.size;
+        list.push_back(e);
+    }
+    std::sort(list.begin(), list.end(), [](const Entry &a, const Entry &b)
+              { return a.time < b.time; });
+    size_t i = 0;
+    for (; i < list.size() && bytes > capacity; i++)
+    {
+        fs::remove(list[i].path, ec);
+        bytes -= list[i].size;
+        evictions++;
+    }
+    entries = list.size() - i;
+}
+
+void FunctionCache::printStats(FILE *out) const
+{
+    fprintf(out, "function cache:\n");
+    fprintf(out, "  %-10s %8d\n", "hits", hits.load());
+    fprintf(out, "  %-10s %8d\n", "misses", misses.load());
+    fprintf(out, "  %-10s %8d\n", "stored", stores.load());
+    fprintf(out, "  %-10s %8d\n", "evicted", evictions.load());
+    fprintf(out, "  %-10s %8zu\n", "entries", entries);
+    fprintf(out, "  %-10s %8zu / %zu bytes\n", "size", bytes, capacity);
+}
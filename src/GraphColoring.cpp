@@ -0,0 +1,623 @@
+#include <algorithm>
+#include <climits>
+#include "GraphColoring.h"
+#include "MachineCode.h"
+#include "LiveVariableAnalysis.h"
+#include "TimeReport.h"
+#include "ThreadPool.h"
+#include "Compiler.h"
+
+GraphColoring::GraphColoring(MachineUnit *unit)
+{
+    this->unit = unit;
+    // 优先使用调用者保存的 r0-r3，不需要在序言中压栈
+    for (int i = 0; i < 11; i++)
+        regs.push_back(i);
+    K = regs.size();
+}
+
+bool GraphColoring::isAllocatable(int reg) const
+{
+    return std::find(regs.begin(), regs.end(), reg) != regs.end();
+}
+
+// 执行整个寄存器分配过程。各函数的分配互不相干，每个函数用一个独立的 GraphColoring
+void GraphColoring::allocateRegisters(ThreadPool *pool)
+{
+    auto &funcs = unit->getFuncs();
+    timedParallelFor(pool, funcs.size(), [&](size_t i)
+                     {
+                         GraphColoring allocator(unit);
+                         allocator.allocateFunction(funcs[i]); }, &funcs);
+}
+
+void GraphColoring::allocateFunction(MachineFunction *f)
+{
+    if (f->isCached())
+        return;
+    func = f;
+    // 溢出代码新建的虚拟寄存器接着该函数指令选择时的编号
+    SymbolTable::setLabel(func->getNextVReg());
+    bool success = false;
+    while (!success)
+    {
+        func->addAllocRound(); // 记录分配/溢出的轮数
+        success = allocate();
+    }
+    func->setNextVReg(SymbolTable::peekLabel());
+}
+
+bool GraphColoring::allocate()
+{
+    bool colored;
+    {
+        TimeRegion region("build");
+        build();
+    }
+    {
+        TimeRegion region("color");
+        makeWorklist();
+        while (!simplifyWorklist.empty() || !worklistMoves.empty() || !freezeWorklist.empty() || !spillWorklist.empty())
+        {
+            if (!simplifyWorklist.empty())
+                simplify();
+            else if (!worklistMoves.empty())
+                coalesce();
+            else if (!freezeWorklist.empty())
+                freeze();
+            else
+                selectSpill();
+        }
+        colored = assignColors();
+    }
+    if (!spilledNodes.empty())
+    {
+        TimeRegion region("spill");
+        rewriteProgram(); // 插入溢出代码后重新分配
+        return false;
+    }
+    // 只剩溢出临时寄存器没有颜色时，下一轮与本轮完全相同，分配不会结束
+    if (!colored)
+    {
+        fprintf(stderr, "寄存器分配错误：函数 %s 中溢出代码的临时寄存器分不到物理寄存器\n",
+                func->getSymPtr()->toStr().c_str());
+        throw CompileError();
+    }
+    modifyCode();
+    return true;
+}
+
+void GraphColoring::addEdge(int u, int v)
+{
+    if (u == v || adjSet.count((long long)u * n + v))
+        return;
+    adjSet.insert((long long)u * n + v);
+    adjSet.insert((long long)v * n + u);
+    // 预着色结点的度数视为无穷大，不维护它们的邻接表
+    if (!isPrecolored(u))
+    {
+        adjList[u].push_back(v);
+        degree[u]++;
+    }
+    if (!isPrecolored(v))
+    {
+        adjList[v].push_back(u);
+        degree[v]++;
+    }
+}
+
+bool GraphColoring::adjacent(int u, int v) const
+{
+    return adjSet.count((long long)u * n + v);
+}
+
+// 构建冲突图：每个基本块从 LiveOut 出发自后向前扫描一遍
+void GraphColoring::build()
+{
+    LiveVariableAnalysis lva;
+    lva.pass(func);
+    n = func->getNumLiveIndex();
+
+    adjSet.clear();
+    adjList.assign(n, {});
+    degree.assign(n, 0);
+    alias.resize(n);
+    color.assign(n, -1);
+    nodeState.assign(n, INITIAL);
+    moveList.assign(n, {});
+    moves.clear();
+    defs.assign(n, {});
+    uses.assign(n, {});
+    spillWeight.assign(n, 0);
+    simplifyWorklist.clear();
+    freezeWorklist.clear();
+    spillWorklist.clear();
+    selectStack.clear();
+    worklistMoves.clear();
+    activeMoves.clear();
+    spilledNodes.clear();
+    for (int i = 0; i < n; i++)
+        alias[i] = i;
+    for (int i = 0; i < MachineFunction::NUM_PHYS_REGS; i++)
+    {
+        nodeState[i] = PRECOLORED;
+        color[i] = i;
+        degree[i] = INT_MAX / 2;
+    }
+
+    auto &loops = func->getLoopInfo();
+    for (auto &block : func->getBlocks())
+    {
+        // 循环内的每次定值/使用按 10^深度 计入溢出代价
+        double weight = 1;
+        for (int d = std::min(loops.getLoopDepth(block), 8); d > 0; d--)
+            weight *= 10;
+        BitVector live(n);
+        live.unionWith(block->getLiveOut());
+        auto &insts = block->getInsts();
+        for (auto it = insts.rbegin(); it != insts.rend(); it++)
+        {
+            auto inst = *it;
+            if (inst->isCopy())
+            {
+                int d = func->getLiveIndex(inst->getDef()[0]);
+                int s = func->getLiveIndex(inst->getUse()[0]);
+                // 只合并虚拟寄存器之间、以及虚拟寄存器与可分配物理寄存器之间的传送
+                if (d != s && (d >= MachineFunction::NUM_PHYS_REGS || isAllocatable(d)) &&
+                    (s >= MachineFunction::NUM_PHYS_REGS || isAllocatable(s)))
+                {
+                    live.reset(s);
+                    int m = moves.size();
+                    moves.push_back({inst, d, s, MOVE_WORKLIST});
+                    moveList[d].push_back(m);
+                    moveList[s].push_back(m);
+                    worklistMoves.insert(m);
+                }
+            }
+            for (auto &def : inst->getDef())
+            {
+                int idx = func->getLiveIndex(def);
+                if (idx < 0)
+                    continue;
+                live.set(idx);
+                if (def->isVReg())
+                {
+                    defs[idx].push_back(def);
+                    spillWeight[idx] += weight;
+                }
+            }
+            for (auto &def : inst->getDef())
+            {
+                int idx = func->getLiveIndex(def);
+                if (idx < 0)
+                    continue;
+                for (int l = live.findFirst(); l >= 0; l = live.findNext(l))
+                    addEdge(l, idx);
+            }
+            for (auto &def : inst->getDef())
+            {
+                int idx = func->getLiveIndex(def);
+                if (idx >= 0)
+                    live.reset(idx);
+            }
+            for (auto &use : inst->getUse())
+            {
+                int idx = func->getLiveIndex(use);
+                if (idx < 0)
+                    continue;
+                live.set(idx);
+                if (use->isVReg())
+                {
+                    uses[idx].push_back(use);
+                    spillWeight[idx] += weight;
+                }
+            }
+            // 带条件的定值在条件不成立时保留原值，目标寄存器在指令之前同样活跃
+            if (inst->readsDefs())
+                for (auto &def : inst->getDef())
+                {
+                    int idx = func->getLiveIndex(def);
+                    if (idx >= 0)
+                        live.set(idx);
+                }
+        }
+    }
+}
+
+std::vector<int> GraphColoring::adjacentNodes(int u) const
+{
+    std::vector<int> res;
+    for (auto v : adjList[u])
+        if (nodeState[v] != SELECTED && nodeState[v] != COALESCED)
+            res.push_back(v);
+    return res;
+}
+
+std::vector<int> GraphColoring::nodeMoves(int u) const
+{
+    std::vector<int> res;
+    for (auto m : moveList[u])
+        if (moves[m].state == MOVE_ACTIVE || moves[m].state == MOVE_WORKLIST)
+            res.push_back(m);
+    return res;
+}
+
+void GraphColoring::makeWorklist()
+{
+    for (int u = MachineFunction::NUM_PHYS_REGS; u < n; u++)
+    {
+        if (degree[u] >= K)
+        {
+            nodeState[u] = SPILL;
+            spillWorklist.insert(u);
+        }
+        else if (moveRelated(u))
+        {
+            nodeState[u] = FREEZE;
+            freezeWorklist.insert(u);
+        }
+        else
+        {
+            nodeState[u] = SIMPLIFY;
+            simplifyWorklist.push_back(u);
+        }
+    }
+}
+
+void GraphColoring::simplify()
+{
+    int u = simplifyWorklist.back();
+    simplifyWorklist.pop_back();
+    nodeState[u] = SELECTED;
+    selectStack.push_back(u);
+    for (auto v : adjacentNodes(u))
+        decrementDegree(v);
+}
+
+void GraphColoring::decrementDegree(int m)
+{
+    if (isPrecolored(m))
+        return;
+    int d = degree[m]--;
+    if (d == K)
+    {
+        enableMoves(m);
+        for (auto v : adjacentNodes(m))
+            enableMoves(v);
+        spillWorklist.erase(m);
+        if (moveRelated(m))
+        {
+            nodeState[m] = FREEZE;
+            freezeWorklist.insert(m);
+        }
+        else
+        {
+            nodeState[m] = SIMPLIFY;
+            simplifyWorklist.push_back(m);
+        }
+    }
+}
+
+void GraphColoring::enableMoves(int u)
+{
+    for (auto m : nodeMoves(u))
+        if (moves[m].state == MOVE_ACTIVE)
+        {
+            activeMoves.erase(m);
+            moves[m].state = MOVE_WORKLIST;
+            worklistMoves.insert(m);
+        }
+}
+
+void GraphColoring::addWorkList(int u)
+{
+    if (!isPrecolored(u) && !moveRelated(u) && degree[u] < K)
+    {
+        freezeWorklist.erase(u);
+        nodeState[u] = SIMPLIFY;
+        simplifyWorklist.push_back(u);
+    }
+}
+
+// George 准则
+bool GraphColoring::ok(int t, int r) const
+{
+    return degree[t] < K || isPrecolored(t) || adjacent(t, r);
+}
+
+// Briggs 准则
+bool GraphColoring::conservative(const std::vector<int> &nodes) const
+{
+    std::set<int> seen;
+    int k = 0;
+    for (auto v : nodes)
+        if (seen.insert(v).second && degree[v] >= K)
+            k++;
+    return k < K;
+}
+
+int GraphColoring::getAlias(int u) const
+{
+    while (nodeState[u] == COALESCED)
+        u = alias[u];
+    return u;
+}
+
+void GraphColoring::coalesce()
+{
+    int m = *worklistMoves.begin();
+    worklistMoves.erase(worklistMoves.begin());
+    int x = getAlias(moves[m].dst);
+    int y = getAlias(moves[m].src);
+    int u = x, v = y;
+    if (isPrecolored(y))
+    {
+        u = y;
+        v = x;
+    }
+    if (u == v)
+    {
+        moves[m].state = MOVE_COALESCED;
+        addWorkList(u);
+    }
+    else if (isPrecolored(v) || adjacent(u, v))
+    {
+        moves[m].state = MOVE_CONSTRAINED;
+        addWorkList(u);
+        addWorkList(v);
+    }
+    else
+    {
+        bool canCombine;
+        if (isPrecolored(u))
+        {
+            canCombine = true;
+            for (auto t : adjacentNodes(v))
+                if (!ok(t, u))
+                {
+                    canCombine = false;
+                    break;
+                }
+        }
+        else
+        {
+            auto nodes = adjacentNodes(u);
+            auto vNodes = adjacentNodes(v);
+            nodes.insert(nodes.end(), vNodes.begin(), vNodes.end());
+            canCombine = conservative(nodes);
+        }
+        if (canCombine)
+        {
+            moves[m].state = MOVE_COALESCED;
+            combine(u, v);
+            addWorkList(u);
+        }
+        else
+        {
+            moves[m].state = MOVE_ACTIVE;
+            activeMoves.insert(m);
+        }
+    }
+}
+
+void GraphColoring::combine(int u, int v)
+{
+    if (freezeWorklist.count(v))
+        freezeWorklist.erase(v);
+    else
+        spillWorklist.erase(v);
+    nodeState[v] = COALESCED;
+    alias[v] = u;
+    spillWeight[u] += spillWeight[v];
+    moveList[u].insert(moveList[u].end(), moveList[v].begin(), moveList[v].end());
+    enableMoves(v);
+    for (auto t : adjacentNodes(v))
+    {
+        addEdge(t, u);
+        decrementDegree(t);
+    }
+    if (degree[u] >= K && freezeWorklist.count(u))
+    {
+        freezeWorklist.erase(u);
+        nodeState[u] = SPILL;
+        spillWorklist.insert(u);
+    }
+}
+
+void GraphColoring::freeze()
+{
+    int u = *freezeWorklist.begin();
+    freezeWorklist.erase(freezeWorklist.begin());
+    nodeState[u] = SIMPLIFY;
+    simplifyWorklist.push_back(u);
+    freezeMoves(u);
+}
+
+void GraphColoring::freezeMoves(int u)
+{
+    for (auto m : nodeMoves(u))
+    {
+        int x = moves[m].dst, y = moves[m].src;
+        int v = getAlias(y) == getAlias(u) ? getAlias(x) : getAlias(y);
+        activeMoves.erase(m);
+        worklistMoves.erase(m);
+        moves[m].state = MOVE_FROZEN;
+        if (!isPrecolored(v) && nodeMoves(v).empty() && degree[v] < K && freezeWorklist.count(v))
+        {
+            freezeWorklist.erase(v);
+            nodeState[v] = SIMPLIFY;
+            simplifyWorklist.push_back(v);
+        }
+    }
+}
+
+// 选择溢出代价最小的结点：按循环深度加权的使用次数少、冲突多的优先，溢出代码引入的临时寄存器最后考虑
+void GraphColoring::selectSpill()
+{
+    int best = -1;
+    double bestCost = 0;
+    for (auto u : spillWorklist)
+    {
+        double cost = spillWeight[u] / degree[u];
+        if (spillTemps.count(func->getVRegOf(u)))
+            cost += 1e9;
+        if (best < 0 || cost < bestCost)
+        {
+            best = u;
+            bestCost = cost;
+        }
+    }
+    spillWorklist.erase(best);
+    nodeState[best] = SIMPLIFY;
+    simplifyWorklist.push_back(best);
+    freezeMoves(best);
+}
+
+// u 以及合并到 u 的结点是否都是溢出代码新建的临时寄存器
+bool GraphColoring::onlySpillTemps(int u)
+{
+    for (int v = MachineFunction::NUM_PHYS_REGS; v < n; v++)
+        if (getAlias(v) == u && !spillTemps.count(func->getVRegOf(v)))
+            return false;
+    return true;
+}
+
+bool GraphColoring::assignColors()
+{
+    bool colored = true;
+    while (!selectStack.empty())
+    {
+        int u = selectStack.back();
+        selectStack.pop_back();
+        std::vector<bool> okColors(MachineFunction::NUM_PHYS_REGS, false);
+        for (auto r : regs)
+            okColors[r] = true;
+        for (auto w : adjList[u])
+        {
+            int a = getAlias(w);
+            if (nodeState[a] == COLORED || nodeState[a] == PRECOLORED)
+                okColors[color[a]] = false;
+        }
+        auto reg = std::find_if(regs.begin(), regs.end(), [&](int r)
+                                { return okColors[r]; });
+        if (reg == regs.end() && onlySpillTemps(u))
+        {
+            // 只由溢出代码的临时寄存器组成的结点再溢出也无济于事，本轮不着色，等其他结点溢出后重试
+            nodeState[u] = SELECTED;
+            colored = false;
+        }
+        else if (reg == regs.end())
+        {
+            nodeState[u] = SPILLED;
+            spilledNodes.push_back(u);
+        }
+        else
+        {
+            nodeState[u] = COLORED;
+            color[u] = *reg;
+        }
+    }
+    for (int u = MachineFunction::NUM_PHYS_REGS; u < n; u++)
+        if (nodeState[u] == COALESCED)
+            color[u] = color[getAlias(u)];
+    return colored;
+}
+
+void GraphColoring::insertSpillLoad(MachineInstruction *inst, int vreg, int off)
+{
+    auto block = inst->getParent();
+    auto temp = new MachineOperand(MachineOperand::VREG, vreg);
+    auto fp = new MachineOperand(MachineOperand::REG, 11);
+    auto &instructions = block->getInsts();
+    auto it = std::find(instructions.begin(), instructions.end(), inst);
+    if (!isLegalMemOffset(off))
+    {
+        int off_no = SymbolTable::getLabel();
+        spillTemps.insert(off_no);
+        it = block->insertLoadImm(it, new MachineOperand(MachineOperand::VREG, off_no), off);
+        instructions.insert(it, new LoadMInstruction(block, temp, fp, new MachineOperand(MachineOperand::VREG, off_no)));
+    }
+    else
+        instructions.insert(it, new LoadMInstruction(block, temp, fp, new MachineOperand(MachineOperand::IMM, off)));
+}
+
+// 为溢出的结点分配栈槽，每个使用前插入 ldr，每个定值后插入 str，各用一个新的虚拟寄存器；
+// 带条件的定值之前也插入 ldr
+void GraphColoring::rewriteProgram()
+{
+    std::vector<int> disp(n, 0);
+    for (auto u : spilledNodes)
+    {
+        disp[u] = -func->AllocSpace(4);
+        func->addSpilledVReg();
+    }
+    for (int u = MachineFunction::NUM_PHYS_REGS; u < n; u++)
+    {
+        int root = getAlias(u);
+        if (nodeState[root] != SPILLED)
+            continue;
+        int off = disp[root];
+        for (auto use : uses[u])
+        {
+            // movt 的隐式使用这类读取本指令定值的操作数，在下面与定值一起改写
+            if (use->getParent()->readsOwnDef(use))
+                continue;
+            int temp_no = SymbolTable::getLabel();
+            spillTemps.insert(temp_no);
+            use->setVReg(temp_no);
+            insertSpillLoad(use->getParent(), temp_no, off);
+        }
+        for (auto def : defs[u])
+        {
+            int temp_no = SymbolTable::getLabel();
+            spillTemps.insert(temp_no);
+            int old_no = def->getReg();
+            def->setVReg(temp_no);
+            // 带条件的定值不执行时，str 写回的应是栈槽中原来的值；movt 的低半字也来自栈槽
+            if (def->getParent()->readsDefs())
+            {
+                insertSpillLoad(def->getParent(), temp_no, off);
+                for (auto use : def->getParent()->getUse())
+                    if (use->isVReg() && use->getReg() == old_no)
+                        use->setVReg(temp_no);
+            }
+            auto block = def->getParent()->getParent();
+            auto temp = new MachineOperand(MachineOperand::VREG, temp_no);
+            auto fp = new MachineOperand(MachineOperand::REG, 11);
+            auto &instructions = block->getInsts();
+            auto it = std::find(instructions.begin(), instructions.end(), def->getParent()) + 1;
+            if (!isLegalMemOffset(off))
+            {
+                int off_no = SymbolTable::getLabel();
+                spillTemps.insert(off_no);
+                it = block->insertLoadImm(it, new MachineOperand(MachineOperand::VREG, off_no), off);
+                auto inst = new StoreMInstruction(block, temp, fp, new MachineOperand(MachineOperand::VREG, off_no));
+                instructions.insert(it, inst);
+            }
+            else
+                instructions.insert(it, new StoreMInstruction(block, temp, fp, new MachineOperand(MachineOperand::IMM, off)));
+        }
+    }
+}
+
+// 把虚拟寄存器替换为分配到的物理寄存器，并删除合并后变成 mov rX, rX 的传送指令
+void GraphColoring::modifyCode()
+{
+    for (int u = MachineFunction::NUM_PHYS_REGS; u < n; u++)
+    {
+        int reg = color[u];
+        if (reg >= 4) // r0-r3 由调用者保存
+            func->addSavedRegs(reg);
+        for (auto def : defs[u])
+            def->setReg(reg);
+        for (auto use : uses[u])
+            use->setReg(reg);
+    }
+    for (auto &block : func->getBlocks())
+    {
+        auto &insts = block->getInsts();
+        insts.erase(std::remove_if(insts.begin(), insts.end(), [](MachineInstruction *inst)
+                                   { return inst->isCopy() && inst->getDef()[0]->getReg() == inst->getUse()[0]->getReg(); }),
+                    insts.end());
+    }
+}
@@ -5,41 +5,182 @@
 
 using namespace std;
 
-void BlockMerge::execute() {
-    for (auto func = unit->begin(); func != unit->end(); func++){
-        findBLocks(*func);
+bool BlockMerge::runOnFunction(Function *func) {
+    cur = Stats();
+    bool changed = false;
+    while (true) {
+        // 各项变换互相制造机会，按位或保证每一项都执行
+        bool c = removeUnreachable(func);
+        c |= foldBranches(func);
+        c |= forwardEmptyBlocks(func);
+        c |= findBLocks(func);
+        if (!c)
+            break;
+        changed = true;
     }
+    stats.push_back({func->getSymPtr()->toStr().substr(1), cur});
+    return changed;
 }
 
-// 查找可以合并的块
-void BlockMerge::findBLocks(Function *func) {
+void BlockMerge::printStats(FILE *out) {
+    fprintf(out, "cfg simplification:\n");
+    fprintf(out, "  %-20s %8s %8s %8s %8s\n", "function", "removed", "folded", "forwarded", "merged");
+    for (auto &it : stats)
+        fprintf(out, "  %-20s %8d %8d %8d %8d\n", it.first.c_str(), it.second.removed,
+                it.second.folded, it.second.forwarded, it.second.merged);
+}
+
+// 删除从入口不可达的块，返回是否有变化
+bool BlockMerge::removeUnreachable(Function *func) {
+    std::unordered_set<BasicBlock *> live;
+    std::vector<BasicBlock *> worklist = {func->getEntry()};
+    live.insert(func->getEntry());
+    while (!worklist.empty()) {
+        BasicBlock *bb = worklist.back();
+        worklist.pop_back();
+        for (auto succ : bb->getSuccs())
+            if (live.insert(succ).second)
+                worklist.push_back(succ);
+    }
+    std::vector<BasicBlock *> dead;
+    for (auto bb : func->getBlockList())
+        if (!live.count(bb))
+            dead.push_back(bb);
+    for (auto bb : dead)
+        for (auto succ : bb->getSuccs())
+            if (live.count(succ))
+                replacePhiBB(succ, bb);
+    // 块的析构函数会删除其中的指令并断开 CFG 边
+    for (auto bb : dead)
+        delete bb;
+    cur.removed += dead.size();
+    return !dead.empty();
+}
+
+// 两个目标相同的条件跳转改为无条件跳转
+bool BlockMerge::foldBranches(Function *func) {
+    bool changed = false;
     for (auto bb : func->getBlockList()) {
-        /* 
-         * 如果块内存在条件跳转指令，说明该块的后继块可能不止一个，这里不作合并。
-         * 不过此处如果实现了其他优化，比如常量传播，进一步导致条件判断恒真/假，
-         * 可能会发现有很多分支实际上并不可达，此时即使该块含有cond指令，实际上
-         * 仍然是可以考虑与其后继块进行合并的。
-         * 另外，此处如果实现了phi指令，同样需要根据phi指令的具体实现进一步考虑
-         * 其他情况。
-         */
+        Instruction *term = bb->rbegin();
+        if (term == bb->rend() || !term->isCond())
+            continue;
+        auto br = (CondBrInstruction *)term;
+        BasicBlock *target = br->getTrueBranch();
+        if (target != br->getFalseBranch())
+            continue;
+        bb->insertBefore(new UncondBrInstruction(target), br);
+        delete br;
+        // 去掉重复的一条边，phi 中来自 bb 的两个来值相同，只保留一个
+        bb->removeSucc(target);
+        target->removePred(bb);
+        for (auto inst = target->begin(); inst != target->end() && inst->isPhi(); inst = inst->getNext()) {
+            auto phi = (PhiInstruction *)inst;
+            Operand *value = nullptr;
+            for (int i = 0; i < phi->getNumIncoming() && value == nullptr; i++)
+                if (phi->getIncomingBlock(i) == bb)
+                    value = phi->getIncomingValue(i);
+            phi->removeIncoming(bb);
+            phi->addIncoming(value, bb);
+        }
+        cur.folded++;
+        changed = true;
+    }
+    return changed;
+}
 
-        // TODO: 1. 检查块内是否存在cond指令，后继块数目是否为1 
+// 只含一条无条件跳转的块，让它的前驱直接跳到它的目标
+bool BlockMerge::forwardEmptyBlocks(Function *func) {
+    bool changed = false;
+    std::vector<BasicBlock *> blocks = func->getBlockList();
+    for (auto bb : blocks) {
+        if (bb == func->getEntry() || bb->empty() || bb->begin() != bb->rbegin() || !bb->begin()->isUncond())
+            continue;
+        BasicBlock *target = ((UncondBrInstruction *)bb->begin())->getBranch();
+        if (target == bb)
+            continue;
 
-        BasicBlock *block = bb;
-        int succ_num = block->getNumOfSucc();
-        if(succ_num>1){
+        // 目标有 phi 时，phi 消去后的复制放在前驱末尾：以条件跳转结束的前驱会让另一条路径也执行这些复制，
+        // 这里保留空块作为复制的落脚点。某个前驱已经是目标的前驱时，phi 在两条边上的来值还必须相同
+        bool legal = true;
+        if (target->begin() != target->end() && target->begin()->isPhi())
+            for (auto pred : bb->getPreds())
+                if (!pred->rbegin()->isUncond())
+                    legal = false;
+        for (auto inst = target->begin(); legal && inst != target->end() && inst->isPhi(); inst = inst->getNext()) {
+            auto phi = (PhiInstruction *)inst;
+            Operand *fromBB = nullptr;
+            for (int i = 0; i < phi->getNumIncoming(); i++)
+                if (phi->getIncomingBlock(i) == bb)
+                    fromBB = phi->getIncomingValue(i);
+            for (int i = 0; i < phi->getNumIncoming(); i++) {
+                BasicBlock *in = phi->getIncomingBlock(i);
+                if (in != bb && std::find(bb->pred_begin(), bb->pred_end(), in) != bb->pred_end() &&
+                    phi->getIncomingValue(i) != fromBB)
+                    legal = false;
+            }
+        }
+        if (!legal)
             continue;
+
+        std::vector<BasicBlock *> preds = bb->getPreds();
+        std::set<BasicBlock *> oldPreds(target->pred_begin(), target->pred_end());
+        for (auto inst = target->begin(); inst != target->end() && inst->isPhi(); inst = inst->getNext()) {
+            auto phi = (PhiInstruction *)inst;
+            Operand *fromBB = nullptr;
+            for (int i = 0; i < phi->getNumIncoming(); i++)
+                if (phi->getIncomingBlock(i) == bb)
+                    fromBB = phi->getIncomingValue(i);
+            phi->removeIncoming(bb);
+            for (auto pred : preds)
+                phi->addIncoming(fromBB, pred);
         }
+        for (auto pred : preds) {
+            Instruction *term = pred->rbegin();
+            if (term->isUncond())
+                ((UncondBrInstruction *)term)->setBranch(target);
+            else if (term->isCond()) {
+                auto br = (CondBrInstruction *)term;
+                if (br->getTrueBranch() == bb)
+                    br->setTrueBranch(target);
+                if (br->getFalseBranch() == bb)
+                    br->setFalseBranch(target);
+            }
+            pred->removeSucc(bb);
+            pred->addSucc(target);
+            target->addPred(pred);
+        }
+        bb->getPreds().clear();
+        delete bb;
+        cur.forwarded++;
+        changed = true;
+    }
+    return changed;
+}
+
+// 查找可以合并的块
+bool BlockMerge::findBLocks(Function *func) {
+    bool changed = false;
+    deleted.clear();
+    std::vector<BasicBlock *> blocks = func->getBlockList();
+    for (auto bb : blocks) {
+        /*
+         * 块以无条件跳转结束时只有一个后继；条件恒真/假的跳转已由 SCCP 和 foldBranches 改写。
+         * 后继只有这一个前驱、且不是入口块时，可以把它接到当前块末尾，
+         * 后继中的 phi 此时只有一个来值，直接用该值代替。
+         */
+        if (deleted.count(bb))
+            continue;
 
+        BasicBlock *block = bb;
         mergeList.clear();
-        
+
         // 依据控制流持续向后合并，直至存在块不可合并
         while (true) {
-            // TODO: 2. 检查后继块是否可以合并，包括后继块的前驱块数目等
-            bool can_merge = 0;
-            // 获取block的后继块succ;
-            BasicBlock* succ;
-
+            Instruction *term = block->rbegin();
+            if (term == block->rend() || !term->isUncond())
+                break;
+            BasicBlock *succ = ((UncondBrInstruction *)term)->getBranch();
+            bool can_merge = succ != bb && succ != func->getEntry() && succ->getNumOfPred() == 1;
             if (can_merge) {
                 mergeList.push_back(succ);
                 block = succ;
@@ -47,10 +188,12 @@ void BlockMerge::findBLocks(Function *func) {
                 break;
             }
         }
-        // TODO: 3. 合并基本块
-        if (mergeList.size() > 0)
+        if (mergeList.size() > 0) {
             merge(func, bb);
+            changed = true;
+        }
     }
+    return changed;
 }
 
 // 如果debug时需要查看块内指令信息，可借助该函数
@@ -58,44 +201,50 @@ void BlockMerge::printInsts(BasicBlock *start) {
     auto head = start->end();
     for (auto instr = head->getNext(); instr != head;
          instr = instr->getNext()) {
-        // 此处可以打印自己想要查看的指令信息
+        instr->output();
     }
 }
 
 void BlockMerge::merge(Function *func, BasicBlock *start) {
-    
-    // TODO: 1. 处理所有待合并块之间的联系，包括删除冗余的可合并块之间的跳转等；
-
     for (auto bb : mergeList) {
-        std::vector<Instruction *> mergeInst = {};
-        auto head = bb->end();
-        for (auto instr = head->getNext(); instr != head;
-             instr = instr->getNext()) {
+        // 删去 start 末尾跳到 bb 的跳转，bb 的 phi 只有来自 start 的一个来值
+        delete start->rbegin();
+        for (auto instr = bb->begin(), next = instr; instr != bb->end() && instr->isPhi(); instr = next) {
+            next = instr->getNext();
+            auto phi = (PhiInstruction *)instr;
+            phi->getDef()->replaceAllUsesWith(phi->getIncomingValue(0));
+            delete phi;
+        }
 
-            // 此处需要补充对指令的判断与处理
+        std::vector<Instruction *> mergeInst = {};
+        for (auto instr = bb->begin(); instr != bb->end(); instr = instr->getNext())
             mergeInst.push_back(instr);
-
+        for (auto instr : mergeInst) {
+            bb->remove(instr);
+            start->insertBack(instr);
         }
 
-        // TODO: 2. 在合并留下来的唯一块中插入所有被合并块中留下的指令；
-
-        // TODO: 3. 维护块之间的前驱后继关系，将被合并的块从容器中移除。
-        // bb->deleteAllRelation();
-        func->remove(bb);
+        // bb 的后继改为 start 的后继，它们的 phi 中来自 bb 的边改为来自 start
+        start->removeSucc(bb);
+        for (auto succ : bb->getSuccs()) {
+            start->addSucc(succ);
+            std::replace(succ->pred_begin(), succ->pred_end(), bb, start);
+            for (auto instr = succ->begin(); instr != succ->end() && instr->isPhi(); instr = instr->getNext())
+                ((PhiInstruction *)instr)->replaceIncomingBlock(bb, start);
+        }
+        bb->getPreds().clear();
+        bb->getSuccs().clear();
+        deleted.insert(bb);
+        delete bb;
+        cur.merged++;
     }
 }
 
 
-// 如果实现了phi指令，需要对其进行维护
+// 删去 succ 中 phi 来自 start 的入边
 void BlockMerge::replacePhiBB(BasicBlock *succ, BasicBlock *start) {
-    auto head = succ->end();
-    for (auto instr = head->getNext(); instr != head;
+    for (auto instr = succ->begin(); instr != succ->end() && instr->isPhi();
          instr = instr->getNext()) {
-        // if (!instr->isPhi())
-        //     continue;
-        // PhiInstruction *phi = dynamic_cast<PhiInstruction *>(instr);
-        // auto phiBBs = phi->getPhiBBs();
-        // auto phiOperands = phi->getPhiOperands();
-
+        ((PhiInstruction *)instr)->removeIncoming(start);
     }
-}
\ No newline at end of file
+}
@@ -1,5 +1,52 @@
 #include "IRComSubExprElim.h"
-#include <queue>
+#include <algorithm>
+
+// 常量按值标识（最低位置 1，与按 4 字节对齐的指针区分开），其余按 Operand 指针标识
+static uintptr_t operandKey(Operand *op)
+{
+    auto c = dynamic_cast<ConstantSymbolEntry *>(op->getEntry());
+    if (c != nullptr)
+        return ((uintptr_t)(unsigned)c->getValue() << 1) | 1;
+    return (uintptr_t)op;
+}
+
+Expr::Expr(Instruction *inst) : inst(inst)
+{
+    kind = inst->getInstType();
+    opcode = inst->getOpcode();
+    auto uses = inst->getUse();
+    nops = uses.size();
+    ops[0] = nops > 0 ? operandKey(uses[0]) : 0;
+    ops[1] = nops > 1 ? operandKey(uses[1]) : 0;
+    if (nops != 2 || ops[0] <= ops[1])
+        return;
+    // 可交换的运算把操作数排成升序；a < b 与 b > a 视为同一个比较
+    if (inst->isBinary())
+    {
+        if (opcode == BinaryInstruction::ADD || opcode == BinaryInstruction::MUL ||
+            opcode == BinaryInstruction::AND || opcode == BinaryInstruction::OR)
+            std::swap(ops[0], ops[1]);
+    }
+    else if (inst->isCmp())
+    {
+        switch (opcode)
+        {
+        case CmpInstruction::L:
+            opcode = CmpInstruction::G;
+            break;
+        case CmpInstruction::G:
+            opcode = CmpInstruction::L;
+            break;
+        case CmpInstruction::LE:
+            opcode = CmpInstruction::GE;
+            break;
+        case CmpInstruction::GE:
+            opcode = CmpInstruction::LE;
+            break;
+        }
+        std::swap(ops[0], ops[1]);
+    }
+}
 
 IRComSubExprElim::IRComSubExprElim(Unit *unit)
 {
@@ -14,33 +61,44 @@ bool IRComSubExprElim::skip(Instruction *inst)
 {
     /**
      * 判断当前指令是否可以当成一个表达式
-     * 当前只将二元运算指令当作表达式
-     * 纯函数及一些一元指令也可当作表达式
+     * 二元运算、比较、零扩展和转 bool 的结果只取决于操作数；
+     * 依赖标志位的指令及其 cmp 在机器代码中与上下文绑定，不参与消除
      */
-    if (dynamic_cast<BinaryInstruction *>(inst) != nullptr)
+    if (inst->getDef() == nullptr || inst->readsFlags() || inst->isFlagSource())
+        return true;
+    if (inst->isBinary() || inst->isCmp() || inst->isZext() || inst->isToBool())
         return false;
     return true;
 }
 
+// 用 leader 的结果代替 inst 的结果，并删除 inst
+void IRComSubExprElim::replace(Instruction *inst, Instruction *leader)
+{
+    inst->getDef()->replaceAllUsesWith(leader->getDef());
+    delete inst;
+    removed++;
+}
+
 bool IRComSubExprElim::localCSE(Function *func)
 {
     bool result = true;
-    std::vector<Expr> exprs;
+    std::unordered_map<Expr, Instruction *, ExprHash> exprs;
     for (auto block = func->begin(); block != func->end(); block++)
     {
         exprs.clear();
-        for (auto inst = (*block)->begin(); inst != (*block)->end(); inst = inst->getNext())
+        for (auto inst = (*block)->begin(), next = inst; inst != (*block)->end(); inst = next)
         {
+            next = inst->getNext();
             if (skip(inst))
                 continue;
-            auto preInstIt = std::find(exprs.begin(), exprs.end(), Expr(inst));
-            if (preInstIt != exprs.end())
+            auto it = exprs.find(Expr(inst));
+            if (it != exprs.end())
             {
-                // TODO: 把对当前指令的def的use改成对于preInst的def的use，并删除当前指令。
-
+                replace(inst, it->second);
+                result = false;
             }
             else
-                exprs.emplace_back(inst);
+                exprs.emplace(Expr(inst), inst);
             /**
              * 这里不需要考虑表达式注销的问题
              * 因为ir是ssa形式的代码，目前来说应该不会有这样的情况，这种是错的
@@ -55,13 +113,14 @@ bool IRComSubExprElim::localCSE(Function *func)
 bool IRComSubExprElim::globalCSE(Function *func)
 {
     exprVec.clear();
+    expr2Id.clear();
     ins2Expr.clear();
     genBB.clear();
-    killBB.clear();
     inBB.clear();
     outBB.clear();
+    leaderBB.clear();
 
-    bool result = true; 
+    bool result = true;
     calGenKill(func);
     calInOut(func);
     result = removeGlobalCSE(func);
@@ -70,7 +129,7 @@ bool IRComSubExprElim::globalCSE(Function *func)
 
 void IRComSubExprElim::calGenKill(Function *func)
 {
-    // 计算gen
+    // 先给所有表达式编号，再按编号数目建立位向量
     for (auto block = func->begin(); block != func->end(); block++)
     {
         for (auto inst = (*block)->begin(); inst != (*block)->end(); inst = inst->getNext())
@@ -79,100 +138,114 @@ void IRComSubExprElim::calGenKill(Function *func)
                 continue;
             Expr expr(inst);
             // 对于表达式a + b，我们只需要全局记录一次，重复出现的话，用同一个id即可
-            auto it = find(exprVec.begin(), exprVec.end(), expr);
-            int ind = it - exprVec.begin();
-            if (it == exprVec.end())
+            auto it = expr2Id.find(expr);
+            int ind;
+            if (it == expr2Id.end())
             {
+                ind = exprVec.size();
+                expr2Id.emplace(expr, ind);
                 exprVec.push_back(expr);
             }
+            else
+                ind = it->second;
             ins2Expr[inst] = ind;
-            genBB[*block].insert(ind);
-            /*
-                一个基本块内不会出现这种 t1 = t2 + t3
-                                       t2 = ...
-                所以这里，之后gen的表达式不会kill掉已经gen的表达式
-                就算是phi指令，也是并行取值，所以问题不大哦
-            */
+            if (!leaderBB[*block].count(ind))
+                leaderBB[*block][ind] = inst;
         }
     }
-    // 计算kill
+    // SSA 形式下操作数不会被重新定值，表达式不会被注销，kill 集合为空
+    int n = exprVec.size();
     for (auto block = func->begin(); block != func->end(); block++)
     {
-        for (auto inst = (*block)->begin(); inst != (*block)->end(); inst = inst->getNext())
-        {
-            if (inst->getDef() != nullptr)
-            {
-                for (auto useInst : inst->getDef()->getUse())
-                {
-                    if (!skip(useInst))
-                        killBB[*block].insert(ins2Expr[useInst]);
-                }
-            }
-        }
+        BitVector gen(n);
+        for (auto &it : leaderBB[*block])
+            gen.set(it.first);
+        genBB[*block] = gen;
     }
 }
 
 void IRComSubExprElim::calInOut(Function *func)
 {
-    std::set<int> U;
-    for (size_t i = 0; i < exprVec.size(); i++)
-        U.insert(i);
+    int n = exprVec.size();
+    BitVector U(n);
+    for (int i = 0; i < n; i++)
+        U.set(i);
+    auto &order = func->getDomTree().getOrder();
     auto entry = func->getEntry();
-    inBB[entry].clear();
+    inBB[entry] = BitVector(n);
     outBB[entry] = genBB[entry];
     // 初始化除entry外的基本块的out为U
-    std::set<BasicBlock *> workList;
-    for (auto block = func->begin(); block != func->end(); block++)
+    for (auto block : order)
+        if (block != entry)
+            outBB[block] = U;
+    // 按逆后序迭代直到收敛：in = ∩ out[pred]，out = in ∪ gen
+    bool changed = true;
+    while (changed)
     {
-        if (*block != entry) {
-            outBB[*block] = U;
-            workList.insert(*block);
+        changed = false;
+        for (auto block : order)
+        {
+            if (block == entry)
+                continue;
+            BitVector in = U;
+            for (auto pred = block->pred_begin(); pred != block->pred_end(); pred++)
+                if (outBB.count(*pred)) // 不可达的前驱不参与求交
+                    in.intersectWith(outBB[*pred]);
+            BitVector out = in;
+            out.unionWith(genBB[block]);
+            inBB[block] = in;
+            if (out != outBB[block])
+            {
+                outBB[block] = out;
+                changed = true;
+            }
         }
     }
-    // 不断迭代直到收敛
-    while (!workList.empty())
+}
+
+bool IRComSubExprElim::removeGlobalCSE(Function *func)
+{
+    // 在块入口可用的表达式，沿支配树向上找到最近的计算它的块，用那里的结果代替
+    // 只经由汇合点可用、没有支配者计算过的表达式需要插入 phi 才能消除，这里不处理
+    bool result = true;
+    auto &dt = func->getDomTree();
+    for (auto block : dt.getOrder())
     {
-        auto block = *workList.begin();
-        workList.erase(workList.begin());
-        // 计算in[block] = U outBB[predBB];
-        std::set<int> in[2];
-        if (block->getNumOfPred() > 0)
-            in[0] = outBB[*block->pred_begin()];
-        auto it = block->pred_begin();
-        it++;
-        int turn = 1;
-        for (; it != block->pred_end(); it++)
-        {
-            in[turn].clear();
-            std::set_intersection(outBB[*it].begin(), outBB[*it].end(), in[turn ^ 1].begin(), in[turn ^ 1].end(), inserter(in[turn], in[turn].begin()));
-            turn ^= 1;
-        }
-        inBB[block] = in[turn ^ 1];
-        // 计算outBB[block] = (inBB[block] - killBB[block]) U genBB[block];
-        std::set<int> midDif;
-        std::set<int> out;
-        std::set_difference(inBB[block].begin(), inBB[block].end(), killBB[block].begin(), killBB[block].end(), inserter(midDif, midDif.begin()));
-        std::set_union(genBB[block].begin(), genBB[block].end(), midDif.begin(), midDif.end(), inserter(out, out.begin()));
-        if (out != outBB[block])
+        for (auto inst = block->begin(), next = inst; inst != block->end(); inst = next)
         {
-            outBB[block] = out;
-            for (auto succ = block->succ_begin(); succ != block->succ_end(); succ++)
-                workList.insert(*succ);
+            next = inst->getNext();
+            auto it = ins2Expr.find(inst);
+            if (it == ins2Expr.end() || !inBB[block].test(it->second))
+                continue;
+            int e = it->second;
+            Instruction *leader = nullptr;
+            for (auto dom = dt.getIdom(block); dom != nullptr && leader == nullptr; dom = dt.getIdom(dom))
+                if (genBB[dom].test(e))
+                    leader = leaderBB[dom][e];
+            if (leader == nullptr)
+                continue;
+            if (leaderBB[block].count(e) && leaderBB[block][e] == inst)
+                leaderBB[block][e] = leader; // 后继块再找到这里时直接用更上层的结果
+            replace(inst, leader);
+            result = false;
         }
     }
+    return result;
 }
 
-bool IRComSubExprElim::removeGlobalCSE(Function *func)
+bool IRComSubExprElim::runOnFunction(Function *func)
 {
-    // TODO: 根据计算出的gen kill in out进行全局公共子表达式消除
-    return true;
+    removed = 0;
+    while (!localCSE(func) || !globalCSE(func))
+        ;
+    stats.push_back({func->getSymPtr()->toStr().substr(1), removed});
+    return removed != 0;
 }
 
-void IRComSubExprElim::pass()
+void IRComSubExprElim::printStats(FILE *out)
 {
-    for (auto func = unit->begin(); func != unit->end(); func++)
-    {
-        while (!localCSE(*func) || !globalCSE(*func))
-            ;
-    }
+    fprintf(out, "common subexpression elimination:\n");
+    fprintf(out, "  %-20s %8s\n", "function", "removed");
+    for (auto &it : stats)
+        fprintf(out, "  %-20s %8d\n", it.first.c_str(), it.second);
 }
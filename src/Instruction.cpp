@@ -3,25 +3,24 @@
 #include <iostream>
 #include "Function.h"
 #include "Type.h"
-extern FILE *yyout;
+#include "Compiler.h"
+#include "OutputStream.h"
+#include <climits>
+extern thread_local OutputStream *code_out;
 
 // reference
-TypeConverInstruction::TypeConverInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(TYPECONVER, insert_bb), dst(dst), src(src)
+TypeConverInstruction::TypeConverInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(TYPECONVER, insert_bb)
 {
-    dst->setDef(this);
-    src->addUse(this);
-}
-
-TypeConverInstruction::~TypeConverInstruction()
-{
-    dst->setDef(nullptr);
-    src->addUse(this);
+    addDef(dst);
+    addUse(src);
 }
 
 void TypeConverInstruction::output() const
 {
     // eg. %7 = sitofp i32 %6 to float
-    std::string typeConver;
+    Operand *dst = operands[0];
+    Operand *src = operands[1];
+    const char *typeConver = "";
     if (src->getType() == TypeSystem::boolType && dst->getType()->isInt())
     {
         typeConver = "zext";
@@ -34,7 +33,7 @@ void TypeConverInstruction::output() const
     {
         typeConver = "sitofp";
     }
-    fprintf(yyout, "  %s = %s %s %s to %s\n", dst->toStr().c_str(), typeConver.c_str(), src->getType()->toStr().c_str(), src->toStr().c_str(), dst->getType()->toStr().c_str());
+    *code_out << "  " << dst << " = " << typeConver << ' ' << src->getType() << ' ' << src << " to " << dst->getType() << '\n';
 }
 Instruction::Instruction(unsigned instType, BasicBlock *insert_bb)
 {
@@ -51,9 +50,59 @@ Instruction::Instruction(unsigned instType, BasicBlock *insert_bb)
 
 Instruction::~Instruction()
 {
+    // arena 统一析构时操作数和所在基本块可能已经析构，只释放自身的成员
+    if (Arena::isFinalizing())
+        return;
+    // 操作数槽位析构时自动从各自的 use 链表中摘除
+    Operand *dst = getDef();
+    if (dst != nullptr && dst->getDef() == this)
+        dst->setDef(nullptr);
     parent->remove(this);
 }
 
+bool Instruction::readsFlags() const
+{
+    return instType == COND;
+}
+
+bool Instruction::isFlagSource()
+{
+    if (instType != CMP && instType != TOBOOL && instType != XOR)
+        return false;
+    // xor 本身输出 eor，只有条件跳转透过它沿用 cmp 的标志位时才要留在原处
+    for (auto user = operands[0]->use_begin(); user != operands[0]->use_end(); user++)
+        if ((*user)->readsFlags() || ((*user)->isXor() && (*user)->isFlagSource()))
+            return true;
+    return false;
+}
+
+bool Instruction::isFusedIntoBranch()
+{
+    for (auto user = operands[0]->use_begin(); user != operands[0]->use_end(); user++)
+    {
+        bool negated;
+        if ((*user)->isCond())
+        {
+            if (((CondBrInstruction *)*user)->getFlagSource(negated) == nullptr)
+                return false;
+        }
+        else if (!(*user)->isXor() || !(*user)->isFusedIntoBranch())
+            return false;
+    }
+    return true;
+}
+
+void Instruction::addDef(Operand *dst)
+{
+    operands.emplace_back(dst, this, true);
+    dst->setDef(this);
+}
+
+void Instruction::addUse(Operand *src)
+{
+    operands.emplace_back(src, this);
+}
+
 BasicBlock *Instruction::getParent()
 {
     return parent;
@@ -87,41 +136,17 @@ Instruction *Instruction::getPrev()
 BinaryInstruction::BinaryInstruction(unsigned opcode, Operand *dst, Operand *src1, Operand *src2, BasicBlock *insert_bb) : Instruction(BINARY, insert_bb)
 {
     this->opcode = opcode;
-    operands.push_back(dst);
-    operands.push_back(src1);
-    operands.push_back(src2);
-    dst->setDef(this);
-    src1->addUse(this);
-    src2->addUse(this);
-}
-
-BinaryInstruction::~BinaryInstruction()
-{
-    operands[0]->setDef(nullptr);
-    if (operands[0]->usersNum() == 0)
-        delete operands[0];
-    operands[1]->removeUse(this);
-    operands[2]->removeUse(this);
+    addDef(dst);
+    addUse(src1);
+    addUse(src2);
 }
 
 void BinaryInstruction::output() const
 {
-    std::string s1, s2, s3, op, type;
-    s1 = operands[0]->toStr();
-    s2 = operands[1]->toStr();
-    s3 = operands[2]->toStr();
-    type = operands[0]->getType()->toStr();
+    const char *op = "";
     bool isfloat = false;
     if (operands[1]->getType()->isFloat() || operands[2]->getType()->isFloat())
         isfloat = true;
-    if (isfloat && operands[1]->getType()->isInt() && operands[1]->getSymPtr()->isConstant())
-    {
-        s2 += ".0";
-    }
-    if (isfloat && operands[2]->getType()->isInt() && operands[2]->getSymPtr()->isConstant())
-    {
-        s3 += ".0";
-    }
     switch (opcode)
     {
     case ADD:
@@ -156,51 +181,38 @@ void BinaryInstruction::output() const
     default:
         break;
     }
-    fprintf(yyout, "  %s = %s %s %s, %s\n", s1.c_str(), op.c_str(), type.c_str(), s2.c_str(), s3.c_str());
+    *code_out << "  " << operands[0] << " = " << op << ' ' << operands[0]->getType() << ' ' << operands[1];
+    if (isfloat && operands[1]->getType()->isInt() && operands[1]->getSymPtr()->isConstant())
+        *code_out << ".0";
+    *code_out << ", " << operands[2];
+    if (isfloat && operands[2]->getType()->isInt() && operands[2]->getSymPtr()->isConstant())
+        *code_out << ".0";
+    *code_out << '\n';
 }
 
 void XorInstruction::genMachineCode(AsmBuilder *builder)
 {
-    // TODO 异或运算，主要是在非运算时涉及到的int->bool
-    // 与0作比较，相等为1,不等为0（直接进行了非运算）
+    // 逻辑非：只用作条件时由条件跳转把条件码取反，否则 dst = src eor 1
+    if (isFusedIntoBranch())
+        return;
     auto cur_block = builder->getBlock();
     auto dst = genMachineOperand(operands[0]);
-    auto src = genMachineImm(1);
-    auto cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src, MachineInstruction::EQ);
-    cur_block->InsertInst(cur_inst);
-    src = genMachineImm(0);
-    cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src, MachineInstruction::NE);
-    cur_block->InsertInst(cur_inst);
+    auto src = genMachineRegOf(cur_block, genMachineOperand(operands[1]));
+    cur_block->InsertInst(new BinaryMInstruction(cur_block, BinaryMInstruction::XOR, dst, src, genMachineImm(1)));
 }
 XorInstruction::XorInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(XOR, insert_bb)
 {
-    operands.push_back(dst);
-    operands.push_back(src);
-    dst->setDef(this);
-    src->addUse(this);
+    addDef(dst);
+    addUse(src);
 }
 void XorInstruction::output() const
 {
-    std::string dst = operands[0]->toStr();
-    std::string src = operands[1]->toStr();
-    fprintf(yyout, "  %s = xor i1 %s, true\n", dst.c_str(), src.c_str());
+    *code_out << "  " << operands[0] << " = xor i1 " << operands[1] << ", true\n";
 }
 
-UnaryInstruction::~UnaryInstruction()
-{
-    operands[0]->setDef(nullptr);
-    if (operands[0]->usersNum() == 0)
-        delete operands[0];
-    operands[1]->removeUse(this);
-}
 void UnaryInstruction::output() const
 {
-
-    std::string s1, s2, s3, op, type;
-    s1 = operands[0]->toStr();
-    s2 = operands[1]->toStr();
-    type = operands[0]->getType()->toStr();
-
+    const char *op = "";
     switch (opcode)
     {
     case POS:
@@ -211,25 +223,19 @@ void UnaryInstruction::output() const
         break;
     case NOT:
         // if(operands[0]->getType()->isInt()){}
-        fprintf(yyout, "  %s = xor %s %s, true\n", s1.c_str(), operands[1]->getType()->toStr().c_str(), s2.c_str());
+        *code_out << "  " << operands[0] << " = xor " << operands[1]->getType() << ' ' << operands[1] << ", true\n";
         return;
     }
-    fprintf(yyout, "  %s = %s %s 0, %s\n", s1.c_str(), op.c_str(), operands[1]->getType()->toStr().c_str(), s2.c_str());
+    *code_out << "  " << operands[0] << " = " << op << ' ' << operands[1]->getType() << " 0, " << operands[1] << '\n';
 }
-ZextInstruction::ZextInstruction(Operand *src, Operand *dst, BasicBlock *insert_bb) : Instruction(ZEXT, insert_bb)
+ZextInstruction::ZextInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(ZEXT, insert_bb)
 {
-    operands.push_back(src);
-    operands.push_back(dst);
-    dst->setDef(this);
-    src->addUse(this);
+    addDef(dst);
+    addUse(src);
 }
 void ZextInstruction::output() const
 {
-    std::string src = operands[0]->toStr();
-    std::string dst = operands[1]->toStr();
-    std::string src_type = operands[0]->getType()->toStr();
-    std::string dst_type = operands[1]->getType()->toStr();
-    fprintf(yyout, "  %s = zext %s %s to %s\n", dst.c_str(), src_type.c_str(), src.c_str(), dst_type.c_str());
+    *code_out << "  " << operands[0] << " = zext " << operands[1]->getType() << ' ' << operands[1] << " to " << operands[0]->getType() << '\n';
 }
 void ZextInstruction::genMachineCode(AsmBuilder *builder)
 {
@@ -237,45 +243,32 @@ void ZextInstruction::genMachineCode(AsmBuilder *builder)
     auto cur_block = builder->getBlock();
     auto dst = genMachineOperand(operands[0]);
     auto src = genMachineOperand(operands[1]);
+    if (src->isImm())
+    {
+        cur_block->loadImm(dst, src->getVal());
+        return;
+    }
     auto cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src);
     cur_block->InsertInst(cur_inst);
 }
 
-IntFloatCastInstructionn::IntFloatCastInstructionn(unsigned opcode, Operand *src, Operand *dst, BasicBlock *insert_bb) : Instruction(CAST, insert_bb)
+IntFloatCastInstructionn::IntFloatCastInstructionn(unsigned opcode, Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(CAST, insert_bb)
 {
     this->opcode = opcode;
-    operands.push_back(src);
-    operands.push_back(dst);
-    dst->setDef(this);
-    src->addUse(this);
+    addDef(dst);
+    addUse(src);
 }
 CmpInstruction::CmpInstruction(unsigned opcode, Operand *dst, Operand *src1, Operand *src2, BasicBlock *insert_bb) : Instruction(CMP, insert_bb)
 {
     this->opcode = opcode;
-    operands.push_back(dst);
-    operands.push_back(src1);
-    operands.push_back(src2);
-    dst->setDef(this);
-    src1->addUse(this);
-    src2->addUse(this);
-}
-
-CmpInstruction::~CmpInstruction()
-{
-    operands[0]->setDef(nullptr);
-    if (operands[0]->usersNum() == 0)
-        delete operands[0];
-    operands[1]->removeUse(this);
-    operands[2]->removeUse(this);
+    addDef(dst);
+    addUse(src1);
+    addUse(src2);
 }
 
 void CmpInstruction::output() const
 {
-    std::string s1, s2, s3, op, type, ident;
-    s1 = operands[0]->toStr();
-    s2 = operands[1]->toStr();
-    s3 = operands[2]->toStr();
-    type = operands[1]->getType()->toStr();
+    const char *op = "", *ident = "";
     if (operands[1]->getType()->isInt())
     {
         ident = "icmp";
@@ -305,25 +298,23 @@ void CmpInstruction::output() const
         }
     }
     // cout << "cmp" << endl;
-    fprintf(yyout, "  %s = %s %s %s %s, %s\n", s1.c_str(), ident.c_str(), op.c_str(), type.c_str(), s2.c_str(), s3.c_str());
+    *code_out << "  " << operands[0] << " = " << ident << ' ' << op << ' ' << operands[1]->getType() << ' ' << operands[1] << ", " << operands[2] << '\n';
 }
 
 UncondBrInstruction::UncondBrInstruction(BasicBlock *to, BasicBlock *insert_bb) : Instruction(UNCOND, insert_bb)
 {
     branch = to;
 }
-UnaryInstruction::UnaryInstruction(unsigned opcode, Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(BINARY, insert_bb)
+UnaryInstruction::UnaryInstruction(unsigned opcode, Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(UNARY, insert_bb)
 {
     this->opcode = opcode;
-    operands.push_back(dst);
-    operands.push_back(src);
-    dst->setDef(this);
-    src->addUse(this);
+    addDef(dst);
+    addUse(src);
 }
 
 void UncondBrInstruction::output() const
 {
-    fprintf(yyout, "  br label %%B%d\n", branch->getNo());
+    *code_out << "  br label %B" << branch->getNo() << '\n';
 }
 
 void UncondBrInstruction::setBranch(BasicBlock *bb)
@@ -340,23 +331,12 @@ CondBrInstruction::CondBrInstruction(BasicBlock *true_branch, BasicBlock *false_
 {
     this->true_branch = true_branch;
     this->false_branch = false_branch;
-    cond->addUse(this);
-    operands.push_back(cond);
-}
-
-CondBrInstruction::~CondBrInstruction()
-{
-    operands[0]->removeUse(this);
+    addUse(cond);
 }
 
 void CondBrInstruction::output() const
 {
-    std::string cond, type;
-    cond = operands[0]->toStr();
-    type = operands[0]->getType()->toStr();
-    int true_label = true_branch->getNo();
-    int false_label = false_branch->getNo();
-    fprintf(yyout, "  br %s %s, label %%B%d, label %%B%d\n", type.c_str(), cond.c_str(), true_label, false_label);
+    *code_out << "  br " << operands[0]->getType() << ' ' << operands[0] << ", label %B" << true_branch->getNo() << ", label %B" << false_branch->getNo() << '\n';
 }
 
 void CondBrInstruction::setFalseBranch(BasicBlock *bb)
@@ -382,16 +362,7 @@ BasicBlock *CondBrInstruction::getTrueBranch()
 RetInstruction::RetInstruction(Operand *src, BasicBlock *insert_bb) : Instruction(RET, insert_bb)
 {
     if (src != nullptr)
-    {
-        operands.push_back(src);
-        src->addUse(this);
-    }
-}
-
-RetInstruction::~RetInstruction()
-{
-    if (!operands.empty())
-        operands[0]->removeUse(this);
+        addUse(src);
 }
 
 void RetInstruction::output() const
@@ -399,128 +370,61 @@ void RetInstruction::output() const
     fprintf(stderr, "RetInstruction::output()\n");
     if (operands.empty())
     {
-        fprintf(yyout, "  ret void\n");
+        *code_out << "  ret void\n";
     }
     else
     {
-        std::string ret, type;
-        ret = operands[0]->toStr();
-        type = operands[0]->getType()->toStr();
-        fprintf(yyout, "  ret %s %s\n", type.c_str(), ret.c_str());
+        *code_out << "  ret " << operands[0]->getType() << ' ' << operands[0] << '\n';
     }
 }
 
 AllocaInstruction::AllocaInstruction(Operand *dst, SymbolEntry *se, BasicBlock *insert_bb) : Instruction(ALLOCA, insert_bb)
 {
-    operands.push_back(dst);
-    dst->setDef(this);
+    addDef(dst);
     this->se = se;
 }
 
-AllocaInstruction::~AllocaInstruction()
-{
-    operands[0]->setDef(nullptr);
-    if (operands[0]->usersNum() == 0)
-        delete operands[0];
-}
-
 void AllocaInstruction::output() const
 {
-    std::string dst, type;
-    dst = operands[0]->toStr();
-    type = se->getType()->toStr();
-    fprintf(yyout, "  %s = alloca %s, align 4\n", dst.c_str(), type.c_str());
+    *code_out << "  " << operands[0] << " = alloca " << se->getType() << ", align 4\n";
 }
 
 LoadInstruction::LoadInstruction(Operand *dst, Operand *src_addr, BasicBlock *insert_bb) : Instruction(LOAD, insert_bb)
 {
-    operands.push_back(dst);
-    operands.push_back(src_addr);
-    dst->setDef(this);
-    src_addr->addUse(this);
-    src_addr->addloadUse(this);
-}
-
-LoadInstruction::~LoadInstruction()
-{
-    operands[0]->setDef(nullptr);
-    if (operands[0]->usersNum() == 0)
-        delete operands[0];
-    operands[1]->removeUse(this);
+    addDef(dst);
+    addUse(src_addr);
 }
 
 void LoadInstruction::output() const
 {
-    std::string dst = operands[0]->toStr();
-    std::string src = operands[1]->toStr();
-    std::string src_type;
-    std::string dst_type;
-    dst_type = operands[0]->getType()->toStr();
-    src_type = operands[1]->getType()->toStr();
-    fprintf(yyout, "  %s = load %s, %s %s, align 4\n", dst.c_str(), dst_type.c_str(), src_type.c_str(), src.c_str());
+    *code_out << "  " << operands[0] << " = load " << operands[0]->getType() << ", " << operands[1]->getType() << ' ' << operands[1] << ", align 4\n";
 }
 
 StoreInstruction::StoreInstruction(Operand *dst_addr, Operand *src, BasicBlock *insert_bb) : Instruction(STORE, insert_bb)
 {
-    operands.push_back(dst_addr);
-    operands.push_back(src);
-    dst_addr->addUse(this);
-    src->addUse(this);
-}
-
-StoreInstruction::~StoreInstruction()
-{
-    operands[0]->removeUse(this);
-    operands[1]->removeUse(this);
+    addUse(dst_addr);
+    addUse(src);
 }
 
 void StoreInstruction::output() const
 {
-    std::string dst = operands[0]->toStr();
-    std::string src = operands[1]->toStr();
-    std::string dst_type = operands[0]->getType()->toStr();
-    std::string src_type = operands[1]->getType()->toStr();
-
-    fprintf(yyout, "  store %s %s, %s %s, align 4\n", src_type.c_str(), src.c_str(), dst_type.c_str(), dst.c_str());
-}
-
-IntFloatCastInstructionn::~IntFloatCastInstructionn()
-{
-    operands[0]->setDef(nullptr);
-    if (operands[0]->usersNum() == 0)
-        delete operands[0];
-    operands[1]->removeUse(this);
+    *code_out << "  store " << operands[1]->getType() << ' ' << operands[1] << ", " << operands[0]->getType() << ' ' << operands[0] << ", align 4\n";
 }
 
 // reference
-ToBoolInstruction::ToBoolInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(TOBOOL, insert_bb), dst(dst), src(src)
-{
-    src->addUse(this);
-    dst->setDef(this);
-}
-
-ToBoolInstruction::~ToBoolInstruction()
+ToBoolInstruction::ToBoolInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(TOBOOL, insert_bb)
 {
-    src->removeUse(this);
-    dst->setDef(nullptr);
+    addDef(dst);
+    addUse(src);
 }
 
 void ToBoolInstruction::output() const
 {
-    std::string s1, s2, s3, op, type;
-    s1 = src->toStr();
-    s2 = dst->toStr();
-    type = src->getType()->toStr();
-
-    fprintf(yyout, "  %s = icmp ne %s %s, 0\n", s2.c_str(), type.c_str(), s1.c_str());
+    *code_out << "  " << operands[0] << " = icmp ne " << operands[1]->getType() << ' ' << operands[1] << ", 0\n";
 }
 void IntFloatCastInstructionn::output() const
 {
-    std::string src = operands[0]->toStr();
-    std::string dst = operands[1]->toStr();
-    std::string src_type = operands[0]->getType()->toStr();
-    std::string dst_type = operands[1]->getType()->toStr();
-    std::string castType;
+    const char *castType;
     switch (opcode)
     {
     case I2F:
@@ -533,32 +437,20 @@ void IntFloatCastInstructionn::output() const
         castType = "";
         break;
     }
-    fprintf(yyout, "  %s = %s %s %s to %s\n", dst.c_str(), castType.c_str(), src_type.c_str(), src.c_str(), dst_type.c_str());
-}
-
-FuncCallInstruction::FuncCallInstruction(SymbolEntry *se, Operand *dst, std::vector<Operand *> params, BasicBlock *insert_bb = nullptr) : Instruction(FUNCTIONCALL, insert_bb), se(se), dst(dst), params(params)
-{
-    dst->setDef(this);
-    for (auto t : params)
-    {
-        t->addUse(this);
-        operands.push_back(t);
-    }
+    *code_out << "  " << operands[0] << " = " << castType << ' ' << operands[1]->getType() << ' ' << operands[1] << " to " << operands[0]->getType() << '\n';
 }
 
-FuncCallInstruction::~FuncCallInstruction()
+FuncCallInstruction::FuncCallInstruction(SymbolEntry *se, Operand *dst, std::vector<Operand *> params, BasicBlock *insert_bb = nullptr) : Instruction(FUNCTIONCALL, insert_bb), se(se)
 {
-    dst->setDef(nullptr);
-    if (dst->usersNum() == 0)
-        delete dst;
+    // operands = {dst, params...}
+    operands.reserve(params.size() + 1);
+    addDef(dst);
     for (auto t : params)
-    {
-        t->removeUse(this);
-    }
+        addUse(t);
 }
 
 // reference
-GlobalVarDefInstruction::GlobalVarDefInstruction(Operand *dst, ConstantSymbolEntry *se, BasicBlock *insert_bb) : Instruction(GLOBALVAR, insert_bb), dst(dst)
+GlobalVarDefInstruction::GlobalVarDefInstruction(Operand *dst, ConstantSymbolEntry *se, BasicBlock *insert_bb) : Instruction(GLOBALVAR, insert_bb)
 {
     type = ((PointerType *)dst->getType())->getValueType();
     // fprintf(stderr, "创建全局变量定义指令: %s\n", dst->toStr().c_str()); // 输出创建的全局变量定义指令信息
@@ -603,18 +495,13 @@ GlobalVarDefInstruction::GlobalVarDefInstruction(Operand *dst, ConstantSymbolEnt
             }
         }
     }
-    dst->setDef(this);
-}
-
-GlobalVarDefInstruction::~GlobalVarDefInstruction()
-{
-    // fprintf(stderr, "销毁全局变量定义指令: %s\n", dst->toStr().c_str()); // 输出销毁的全局变量定义指令信息
-    dst->setDef(nullptr);
+    addDef(dst);
 }
 
 void GlobalVarDefInstruction::output() const
 {
-    std::string ident;
+    Operand *dst = operands[0];
+    const char *ident;
     if (dst->isConst())
         ident = "constant";
     else
@@ -622,13 +509,14 @@ void GlobalVarDefInstruction::output() const
 
     if (type->isInt())
     {
-        fprintf(yyout, "%s = %s i32 %d, align 4\n", dst->toStr().c_str(), ident.c_str(), value.intValue);
-        fprintf(stderr, "输出全局变量定义: %s = %s i32 %d, align 4\n", dst->toStr().c_str(), ident.c_str(), value.intValue); // 输出全局变量定义信息
+        *code_out << dst << " = " << ident << " i32 " << value.intValue << ", align 4\n";
+        fprintf(stderr, "输出全局变量定义: %s = %s i32 %d, align 4\n", dst->toStr().c_str(), ident, value.intValue); // 输出全局变量定义信息
     }
     else if (type->isFloat())
     {
-        fprintf(yyout, "%s = %s float %e, align 4\n", dst->toStr().c_str(), ident.c_str(), value.floatValue);
-        fprintf(stderr, "输出全局变量定义: %s = %s float %e, align 4\n", dst->toStr().c_str(), ident.c_str(), value.floatValue); // 输出全局变量定义信息
+        *code_out << dst << " = " << ident << " float ";
+        code_out->printf("%e, align 4\n", value.floatValue);
+        fprintf(stderr, "输出全局变量定义: %s = %s float %e, align 4\n", dst->toStr().c_str(), ident, value.floatValue); // 输出全局变量定义信息
     }
 }
 
@@ -647,7 +535,7 @@ MachineOperand *Instruction::genMachineOperand(Operand *ope)
             // 如果是全局变量，将其名称字符串作为内存地址（MEM）创建一个 MachineOperand
             mope = new MachineOperand(id_se->toStr().c_str());
         else
-            exit(0);
+            throw CompileError();
     }
     return mope;
 }
@@ -667,6 +555,22 @@ MachineOperand *Instruction::genMachineImm(int val)
     return new MachineOperand(MachineOperand::IMM, val);
 }
 
+MachineOperand *Instruction::genMachineRegOf(MachineBlock *block, MachineOperand *ope)
+{
+    if (!ope->isImm())
+        return ope;
+    auto internal_reg = genMachineVReg();
+    block->loadImm(internal_reg, ope->getVal());
+    return new MachineOperand(*internal_reg);
+}
+
+MachineOperand *Instruction::genMachineOperand2(MachineBlock *block, MachineOperand *ope)
+{
+    if (ope->isImm() && isLegalImm(ope->getVal()))
+        return ope;
+    return genMachineRegOf(block, ope);
+}
+
 MachineOperand *Instruction::genMachineLabel(int block_no)
 {
     std::ostringstream buf;
@@ -708,6 +612,8 @@ void LoadInstruction::genMachineCode(AsmBuilder *builder)
         auto src1 = genMachineReg(11);
         int off = dynamic_cast<TemporarySymbolEntry *>(operands[1]->getEntry())->getOffset();
         auto src2 = genMachineImm(off);
+        if (!isLegalMemOffset(off)) // 偏移超出 ldr 的范围时放进寄存器
+            src2 = genMachineRegOf(cur_block, src2);
         cur_inst = new LoadMInstruction(cur_block, dst, src1, src2);
         cur_block->InsertInst(cur_inst);
     }
@@ -726,19 +632,15 @@ void StoreInstruction::genMachineCode(AsmBuilder *builder)
     MachineInstruction *cur_inst = nullptr;
     auto dst = genMachineOperand(operands[0]);
     auto src = genMachineOperand(operands[1]);
-    if (operands[1]->getEntry()->isConstant()) // 如果源操作数是常数 先加载到一个虚拟寄存器
-    {
-        auto dst1 = genMachineVReg();
-        cur_inst = new LoadMInstruction(cur_block, dst1, src);
-        cur_block->InsertInst(cur_inst);
-        src = new MachineOperand(*dst1); // 更新为新的虚拟寄存器操作数，表示存储操作的数据现在来自于寄存器而非直接的常量
-        // 通常不能直接将大于一定范围的立即数存储到内存。因此，需要先将常量加载到寄存器，再将寄存器的值存储到目标地址
-    }
+    // str 只能存寄存器，常数先装入一个虚拟寄存器
+    src = genMachineRegOf(cur_block, src);
     if (operands[0]->getEntry()->isTemporary() && operands[0]->getDef() && operands[0]->getDef()->isAlloc()) // 目的操作数为已分配的临时变量
     {
         auto src1 = genMachineReg(11);                                                        // fp
         int off = dynamic_cast<TemporarySymbolEntry *>(operands[0]->getEntry())->getOffset(); // 获取偏移量
         auto src2 = genMachineImm(off);
+        if (!isLegalMemOffset(off))
+            src2 = genMachineRegOf(cur_block, src2);
         cur_inst = new StoreMInstruction(cur_block, src, src1, src2);
         cur_block->InsertInst(cur_inst);
     }
@@ -759,6 +661,213 @@ void StoreInstruction::genMachineCode(AsmBuilder *builder)
     }
 }
 
+// 追加 dst = src1 op (src2 shiftOp #amount)，操作数各复制一份，调用者可以反复使用同一个操作数
+static void emitBinary(MachineBlock *block, int op, MachineOperand *dst, MachineOperand *src1, MachineOperand *src2,
+                       int shiftOp = -1, int amount = 0)
+{
+    auto inst = new BinaryMInstruction(block, op, new MachineOperand(*dst), new MachineOperand(*src1), new MachineOperand(*src2));
+    if (shiftOp != -1)
+        inst->setShift(shiftOp, amount);
+    block->InsertInst(inst);
+}
+
+// 把 v 分解为 (2^a + sign) << b，sign 为 1、-1，或为 0 表示 v 就是 2^b
+static bool decomposeConst(unsigned v, int &a, int &sign, int &b)
+{
+    if (v == 0)
+        return false;
+    b = __builtin_ctz(v);
+    unsigned long long w = v >> b; // 奇数
+    if (w == 1)
+    {
+        sign = 0;
+        a = 0;
+        return true;
+    }
+    for (int s : {1, -1})
+    {
+        unsigned long long p = w - s;
+        if ((p & (p - 1)) == 0 && p < (1ull << 32))
+        {
+            sign = s;
+            a = __builtin_ctzll(p);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hacker's Delight 10-1：d >= 2 时，n / d 为 n 与 magic 乘积的高 32 位（magic 为负时再加 n）算术右移 shift 位，
+// 负数再加 1
+static void signedMagic(int d, int &magic, int &shift)
+{
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d;
+    unsigned anc = two31 - 1 - two31 % ad;
+    int p = 31;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    do
+    {
+        p++;
+        q1 = 2 * q1;
+        r1 = 2 * r1;
+        if (r1 >= anc)
+        {
+            q1++;
+            r1 -= anc;
+        }
+        q2 = 2 * q2;
+        r2 = 2 * r2;
+        if (r2 >= ad)
+        {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    magic = q2 + 1;
+    shift = p - 32;
+}
+
+bool BinaryInstruction::genMulByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *src, int c)
+{
+    auto zero = genMachineImm(0);
+    if (c == 0)
+    {
+        block->loadImm(dst, 0);
+        return true;
+    }
+    if (c == 1)
+    {
+        block->InsertInst(new MovMInstruction(block, MovMInstruction::MOV, dst, src));
+        return true;
+    }
+    if (c == -1)
+    {
+        emitBinary(block, BinaryMInstruction::RSB, dst, src, zero);
+        return true;
+    }
+    int a, sign, b;
+    if (decomposeConst(c, a, sign, b))
+    {
+        // c = (2^a ± 1) << b：add/rsb 一条，再左移
+        if (sign == 0)
+            emitBinary(block, BinaryMInstruction::LSL, dst, src, genMachineImm(b));
+        else
+        {
+            emitBinary(block, sign > 0 ? BinaryMInstruction::ADD : BinaryMInstruction::RSB, dst, src, src, BinaryMInstruction::LSL, a);
+            if (b > 0)
+                emitBinary(block, BinaryMInstruction::LSL, dst, dst, genMachineImm(b));
+        }
+        return true;
+    }
+    if (decomposeConst(0u - (unsigned)c, a, sign, b))
+    {
+        // -(2^a - 1) = 1 - 2^a 一条 sub 即可，其余先算 -c 倍再取反，至多两条
+        if (sign < 0 && b == 0)
+            emitBinary(block, BinaryMInstruction::SUB, dst, src, src, BinaryMInstruction::LSL, a);
+        else if (sign == 0)
+        {
+            emitBinary(block, BinaryMInstruction::LSL, dst, src, genMachineImm(b));
+            emitBinary(block, BinaryMInstruction::RSB, dst, dst, zero);
+        }
+        else if (b == 0)
+        {
+            emitBinary(block, BinaryMInstruction::ADD, dst, src, src, BinaryMInstruction::LSL, a);
+            emitBinary(block, BinaryMInstruction::RSB, dst, dst, zero);
+        }
+        else
+            return false;
+        return true;
+    }
+    return false;
+}
+
+bool BinaryInstruction::genDivByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *src, int d)
+{
+    if (d == 0 || d == INT_MIN)
+        return false;
+    if (d == 1)
+    {
+        block->InsertInst(new MovMInstruction(block, MovMInstruction::MOV, dst, src));
+        return true;
+    }
+    if (d == -1)
+    {
+        emitBinary(block, BinaryMInstruction::RSB, dst, src, genMachineImm(0));
+        return true;
+    }
+    int ad = d < 0 ? -d : d;
+    if ((ad & (ad - 1)) == 0)
+    {
+        // 负数先加上 2^k - 1，使算术右移向零取整
+        int k = __builtin_ctz(ad);
+        if (k == 1)
+            emitBinary(block, BinaryMInstruction::ADD, dst, src, src, BinaryMInstruction::LSR, 31);
+        else
+        {
+            emitBinary(block, BinaryMInstruction::ASR, dst, src, genMachineImm(31));
+            emitBinary(block, BinaryMInstruction::ADD, dst, src, dst, BinaryMInstruction::LSR, 32 - k);
+        }
+        emitBinary(block, BinaryMInstruction::ASR, dst, dst, genMachineImm(k));
+        if (d < 0)
+            emitBinary(block, BinaryMInstruction::RSB, dst, dst, genMachineImm(0));
+        return true;
+    }
+    int magic, shift;
+    signedMagic(ad, magic, shift);
+    auto m = genMachineVReg();
+    block->loadImm(m, magic);
+    emitBinary(block, BinaryMInstruction::SMMUL, dst, src, m);
+    if (magic < 0)
+        emitBinary(block, BinaryMInstruction::ADD, dst, dst, src);
+    if (shift > 0)
+        emitBinary(block, BinaryMInstruction::ASR, dst, dst, genMachineImm(shift));
+    // src 为负时商加 1：减去 src >> 31；除数为负时反过来用 (src >> 31) 减商
+    emitBinary(block, d > 0 ? BinaryMInstruction::SUB : BinaryMInstruction::RSB, dst, dst, src, BinaryMInstruction::ASR, 31);
+    return true;
+}
+
+bool BinaryInstruction::genModByConst(MachineBlock *block, MachineOperand *dst, MachineOperand *src, int d)
+{
+    // 余数的符号与被除数相同，与除数的符号无关
+    if (d == 0 || d == INT_MIN)
+        return false;
+    int ad = d < 0 ? -d : d;
+    if (ad == 1)
+    {
+        block->loadImm(dst, 0);
+        return true;
+    }
+    if ((ad & (ad - 1)) == 0)
+    {
+        // src - ((src + 偏置) >> k << k)
+        int k = __builtin_ctz(ad);
+        genDivByConst(block, dst, src, ad);
+        emitBinary(block, BinaryMInstruction::SUB, dst, src, dst, BinaryMInstruction::LSL, k);
+        return true;
+    }
+    auto q = genMachineVReg();
+    genDivByConst(block, q, src, ad);
+    int a, sign, b;
+    if (decomposeConst(ad, a, sign, b))
+    {
+        // q * ad = (q * (2^a ± 1)) << b，最后的左移并入减法
+        emitBinary(block, sign > 0 ? BinaryMInstruction::ADD : BinaryMInstruction::RSB, q, q, q, BinaryMInstruction::LSL, a);
+        emitBinary(block, BinaryMInstruction::SUB, dst, src, q, BinaryMInstruction::LSL, b);
+    }
+    else
+    {
+        auto m = genMachineVReg();
+        block->loadImm(m, ad);
+        emitBinary(block, BinaryMInstruction::MUL, q, q, m);
+        emitBinary(block, BinaryMInstruction::SUB, dst, src, q);
+    }
+    return true;
+}
+
 void BinaryInstruction::genMachineCode(AsmBuilder *builder)
 {
     // TODO:
@@ -773,28 +882,40 @@ void BinaryInstruction::genMachineCode(AsmBuilder *builder)
      * So you need to insert LOAD/MOV instrucrion to load immediate num into register.
      * As to other instructions, such as MUL, CMP, you need to deal with this situation, too.*/
     MachineInstruction *cur_inst = nullptr;
-    if (src1->isImm())
+    int op = opcode;
+    // 加法、乘法、与、或可交换，把立即数换到第二操作数的位置
+    if (src1->isImm() && !src2->isImm() && (op == ADD || op == MUL || op == AND || op == OR))
+        std::swap(src1, src2);
+    // 乘、除、取模常数：强度削弱
+    if (!src1->isImm() && src2->isImm())
     {
-        auto internal_reg = genMachineVReg();
-        cur_inst = new LoadMInstruction(cur_block, internal_reg, src1);
-        cur_block->InsertInst(cur_inst);
-        src1 = new MachineOperand(*internal_reg);
+        int c = src2->getVal();
+        if ((op == MUL && genMulByConst(cur_block, dst, src1, c)) ||
+            (op == DIV && genDivByConst(cur_block, dst, src1, c)) ||
+            (op == MOD && genModByConst(cur_block, dst, src1, c)))
+            return;
+    }
+    // 加上一个负数等于减去它的相反数，二者只要有一个能编码就不必占用寄存器
+    if ((op == ADD || op == SUB) && src2->isImm() && !isLegalImm(src2->getVal()) &&
+        src2->getVal() != INT_MIN && isLegalImm(-src2->getVal()))
+    {
+        op = op == ADD ? SUB : ADD;
+        src2 = genMachineImm(-src2->getVal());
     }
     /*
     合法立即数：
         如果一个立即数小于 0xFF（255）那么直接用前 7～0 位表示即可，此时不用移位，11～8 位的 Rotate_imm 等于 0。
         如果前八位 immed_8 的数值大于 255，那么就看这个数是否能有 immed_8 中的某个数移位 2*Rotate_imm 位形成的。如果能，那么就是合法立即数；否则非法。
     加载不合法立即数：
-    只要利用LDR伪指令就可以了，加载任意32位立即数,例如:ldr r1, =12345678
+        能编码按位取反的用 mvn，其余用 movw/movt 分两半装入，见 MachineBlock::insertLoadImm
     */
-    if (src2->isImm())
-    {
-        auto internal_reg = genMachineVReg();
-        cur_inst = new LoadMInstruction(cur_block, internal_reg, src2);
-        cur_block->InsertInst(cur_inst);
-        src2 = new MachineOperand(*internal_reg);
-    }
-    switch (opcode) /* enum { SUB, ADD, AND, OR, MUL, DIV, MOD };*/
+    src1 = genMachineRegOf(cur_block, src1);
+    // 乘除法的两个操作数都必须是寄存器
+    if (op == ADD || op == SUB || op == AND || op == OR)
+        src2 = genMachineOperand2(cur_block, src2);
+    else
+        src2 = genMachineRegOf(cur_block, src2);
+    switch (op) /* enum { SUB, ADD, AND, OR, MUL, DIV, MOD };*/
     {
     case ADD:
         cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::ADD, dst, src1, src2);
@@ -840,90 +961,22 @@ void CmpInstruction::genMachineCode(AsmBuilder *builder)
     MachineOperand *src1 = genMachineOperand(operands[1]);
     MachineOperand *src2 = genMachineOperand(operands[2]);
     MachineInstruction *cur_inst = nullptr;
-    // load 立即数
-    if (src1->isImm()) // 如果 src1 是立即数，需要将其加载到一个虚拟寄存器
-    {
-        auto internal_reg = genMachineVReg();
-        cur_inst = new LoadMInstruction(cur_block, internal_reg, src1); // 把立即数加载到虚拟寄存器中
-        cur_block->InsertInst(cur_inst);
-        src1 = new MachineOperand(*internal_reg); // 将 src1 更新为新生成的寄存器操作数
-    }
-    if (src2->isImm() && ((ConstantSymbolEntry *)(operands[2]->getEntry()))->getValue() > 255) // 如果 src2 是立即数，且大于 255，需要将其加载到一个虚拟寄存器
-    {
-        auto internal_reg = genMachineVReg();
-        cur_inst = new LoadMInstruction(cur_block, internal_reg, src2);
-        cur_block->InsertInst(cur_inst);
-        src2 = new MachineOperand(*internal_reg);
-    }
+    // src1 必须是寄存器，src2 是不能编码的立即数时也装入寄存器
+    src1 = genMachineRegOf(cur_block, src1);
+    src2 = genMachineOperand2(cur_block, src2);
 
     cur_inst = new CmpMInstruction(cur_block, src1, src2, opcode);
     cur_block->InsertInst(cur_inst);
     builder->setCmpOpcode(opcode); // 记录cmp指令的条件码，用于条件分支指令
+    if (isFusedIntoBranch())
+        return;
 
-    // 根据opcode生成相应的条件赋值指令，将比较结果（1或0）存储到目标操作数中
+    // 先无条件置 0，条件成立时再置 1。带条件的 mov 会被当作读取目标寄存器，
+    // 前面的无条件定值使结果不会一直活跃到函数入口
     auto dst = genMachineOperand(operands[0]);
-    auto trueOperand = genMachineImm(1);
-    auto falseOperand = genMachineImm(0);
-    switch (opcode) /*enum {E, NE, L, LE, G, GE}; */
-    {
-    case E:
-    {
-        // cout << "eq" << endl;
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, trueOperand, E); // 如果比较结果等于，将1赋值给dst
-        cur_block->InsertInst(cur_inst);
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, falseOperand, NE); // 如果比较结果不等于，将0赋值给dst
-        cur_block->InsertInst(cur_inst);
-        break;
-    }
-    case NE:
-    {
-        // cout << "ne" << endl;
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, trueOperand, NE);
-        cur_block->InsertInst(cur_inst);
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, falseOperand, E);
-        cur_block->InsertInst(cur_inst);
-        break;
-    }
-    case L:
-    {
-        // cout << "lt" << endl;
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, trueOperand, L);
-        cur_block->InsertInst(cur_inst);
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, falseOperand, GE);
-        cur_block->InsertInst(cur_inst);
-        break;
-    }
-    case LE:
-    {
-        // cout << "le" << endl;
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, trueOperand, LE);
-        cur_block->InsertInst(cur_inst);
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, falseOperand, G);
-        cur_block->InsertInst(cur_inst);
-        break;
-    }
-    case G:
-    {
-        // cout << "gt" << endl;
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, trueOperand, G);
-        cur_block->InsertInst(cur_inst);
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, falseOperand, LE);
-        cur_block->InsertInst(cur_inst);
-        break;
-    }
-    case GE:
-    {
-        // cout << "ge" << endl;
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, trueOperand, GE);
-        cur_block->InsertInst(cur_inst);
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, falseOperand, L);
-        cur_block->InsertInst(cur_inst);
-        break;
-    }
-
-    default:
-        break;
-    }
+    cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, dst, genMachineImm(0)));
+    dst = genMachineOperand(operands[0]);
+    cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, dst, genMachineImm(1), opcode));
 }
 
 void UncondBrInstruction::genMachineCode(AsmBuilder *builder)
@@ -934,11 +987,62 @@ void UncondBrInstruction::genMachineCode(AsmBuilder *builder)
     cur_block->InsertInst(cur_inst);
 }
 
+// 条件取反：E 与 NE、L 与 GE、LE 与 G 互补
+static int negateCond(int cond)
+{
+    switch (cond)
+    {
+    case CmpInstruction::E:
+        return CmpInstruction::NE;
+    case CmpInstruction::NE:
+        return CmpInstruction::E;
+    case CmpInstruction::L:
+        return CmpInstruction::GE;
+    case CmpInstruction::LE:
+        return CmpInstruction::G;
+    case CmpInstruction::G:
+        return CmpInstruction::LE;
+    case CmpInstruction::GE:
+        return CmpInstruction::L;
+    }
+    return cond;
+}
+
+Instruction *CondBrInstruction::getFlagSource(bool &negated)
+{
+    negated = false;
+    Instruction *def = operands[0]->getDef();
+    while (def != nullptr && def->isXor() && def->getParent() == parent)
+    {
+        negated = !negated;
+        def = def->getOperands()[1]->getDef();
+    }
+    if (def == nullptr || (!def->isCmp() && !def->isToBool()) || def->getParent() != parent)
+        return nullptr;
+    // 机器代码中 cmp、tobool 会重新设置标志位，bl 则会破坏标志位
+    for (auto inst = prev; inst != def; inst = inst->getPrev())
+        if (inst->isCmp() || inst->isToBool() || inst->isCall())
+            return nullptr;
+    return def;
+}
+
 void CondBrInstruction::genMachineCode(AsmBuilder *builder)
 {
     auto cur_block = builder->getBlock();
+    bool negated;
+    int cond;
+    if (getFlagSource(negated) != nullptr)
+        // 标志位仍是产生条件的那条 cmp 留下的，直接按它的条件码跳转
+        cond = negated ? negateCond(builder->getCmpOpcode()) : builder->getCmpOpcode();
+    else
+    {
+        // 条件来自别的基本块、phi 或函数调用之前，把它与 0 比较
+        auto src = genMachineRegOf(cur_block, genMachineOperand(operands[0]));
+        cur_block->InsertInst(new CmpMInstruction(cur_block, src, genMachineImm(0), CmpInstruction::NE));
+        cond = CmpInstruction::NE;
+    }
     MachineOperand *dst = genMachineLabel(true_branch->getNo()); // 设置跳转到的真分支
-    auto cur_inst = new BranchMInstruction(cur_block, BranchMInstruction::B, dst, builder->getCmpOpcode());
+    auto cur_inst = new BranchMInstruction(cur_block, BranchMInstruction::B, dst, cond);
     cur_block->InsertInst(cur_inst);
 
     dst = genMachineLabel(false_branch->getNo()); // 设置跳转到的假分支
@@ -954,16 +1058,22 @@ void RetInstruction::genMachineCode(AsmBuilder *builder)
     { // 有返回值 保存返回值到r0
         auto dst = new MachineOperand(MachineOperand::REG, 0);
         auto src = genMachineOperand(operands[0]);
-        auto cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src);
-        cur_block->InsertInst(cur_inst);
+        if (src->isImm())
+            cur_block->loadImm(dst, src->getVal());
+        else
+            cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src));
     }
-    // 调整栈帧 保存寄存器sp
+    // 调整栈帧 恢复sp
+    // 寄存器分配还可能追加溢出槽，此时栈帧大小未定，直接用 fp 恢复 sp
     auto sp = new MachineOperand(MachineOperand::REG, 13);
-    auto funcSize = new MachineOperand(MachineOperand::IMM, builder->getFunction()->AllocSpace(0)); // 获取函数在堆栈上分配的空间大小
-    cur_block->InsertInst(new BinaryMInstruction(cur_block, BinaryMInstruction::ADD, sp, sp, funcSize));
+    auto fp = new MachineOperand(MachineOperand::REG, 11);
+    cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, sp, fp));
     // bx指令，跳转lr寄存器，实现函数返回
     auto lr = new MachineOperand(MachineOperand::REG, 14);
-    cur_block->InsertInst(new BranchMInstruction(cur_block, BranchMInstruction::BX, lr));
+    auto cur_inst = new BranchMInstruction(cur_block, BranchMInstruction::BX, lr);
+    if (!operands.empty())
+        cur_inst->addImplicitUse(genMachineReg(0)); // 返回值在 r0 中
+    cur_block->InsertInst(cur_inst);
 }
 
 void UnaryInstruction::genMachineCode(AsmBuilder *builder)
@@ -978,31 +1088,27 @@ void UnaryInstruction::genMachineCode(AsmBuilder *builder)
     {
     case POS:
         // POS 操作：MOV dst, src
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src);
+        if (src->isImm())
+            cur_block->loadImm(dst, src->getVal());
+        else
+            cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src);
         break;
     case NEG:
         // NEG 操作：SUB dst, zero, src
         {
-            // 生成一个立即数 0
-            MachineOperand *zero = genMachineImm(0);
+            // 0 和 src 都要放在寄存器里
+            MachineOperand *zero = genMachineRegOf(cur_block, genMachineImm(0));
+            src = genMachineRegOf(cur_block, src);
             cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::SUB, dst, zero, src);
         }
         break;
     case NOT:
-        // NOT 操作：XOR dst, src, #1
-        {
-            // 生成一个立即数 1
-            // MachineOperand *one = genMachineImm(1);
-            // cur_inst = new BinaryMInstruction(cur_block, BinaryMInstruction::XOR, dst, src, one);
-            auto cur_block = builder->getBlock();
-            auto dst = genMachineOperand(operands[0]);
-            auto src = genMachineImm(1);
-            auto cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src, MachineInstruction::EQ);
-            cur_block->InsertInst(cur_inst);
-            src = genMachineImm(0);
-            cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src, MachineInstruction::NE);
-            cur_block->InsertInst(cur_inst);
-        }
+        // NOT 操作：自己与 0 比较，相等为 1，不依赖前面指令留下的标志位
+        src = genMachineRegOf(cur_block, src);
+        cur_block->InsertInst(new CmpMInstruction(cur_block, src, genMachineImm(0), CmpInstruction::E));
+        cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, dst, genMachineImm(0)));
+        dst = genMachineOperand(operands[0]);
+        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst, genMachineImm(1), MachineInstruction::EQ);
         break;
     default:
         // 处理其他未定义的单目运算符
@@ -1039,16 +1145,21 @@ void FuncCallInstruction::genMachineCode(AsmBuilder *builder)
     // }
 
     // cout << operands.size() << endl;
-    int paramCount = operands.size(); // 参数数目=operands.size(),那dst呢？
+    int paramCount = operands.size() - 1; // operands = {dst, params...}
     if (paramCount <= 4 && paramCount > 0)
     {
         // cout << "param" << endl;
         for (int i = 0; i < paramCount; i++)
         {
             dst1 = genMachineReg(i); // 生成寄存器R0-R3
-            operand = genMachineOperand(operands[i]);
-            cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst1, operand); // 将参数值移动到寄存器
-            cur_block->InsertInst(cur_inst);
+            operand = genMachineOperand(operands[i + 1]);
+            if (operand->isImm())
+                cur_block->loadImm(dst1, operand->getVal());
+            else
+            {
+                cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, dst1, operand); // 将参数值移动到寄存器
+                cur_block->InsertInst(cur_inst);
+            }
         }
     }
 
@@ -1088,6 +1199,11 @@ void FuncCallInstruction::genMachineCode(AsmBuilder *builder)
 
     // 之后生成跳转指令来进入 Callee 函数；
     cur_inst = new BranchMInstruction(cur_block, BranchMInstruction::BL, new MachineOperand(se->toStr().c_str()));
+    // bl 读取参数寄存器，并破坏调用者保存的 r0-r3、r12 和 lr
+    for (int i = 0; i < paramCount && i < 4; i++)
+        cur_inst->addImplicitUse(genMachineReg(i));
+    for (int reg : {0, 1, 2, 3, 12, 14})
+        cur_inst->addImplicitDef(genMachineReg(reg));
     cur_block->InsertInst(cur_inst);
 
     // 如果之前通过压栈的方式传递了参数，需要恢复 SP 寄存器；
@@ -1103,22 +1219,115 @@ void FuncCallInstruction::genMachineCode(AsmBuilder *builder)
     {
         // cout << "r0";
         MachineOperand *r0 = new MachineOperand(MachineOperand::REG, 0);
-        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, genMachineOperand(dst), r0); // 把R0移动到dst
+        cur_inst = new MovMInstruction(cur_block, MovMInstruction::MOV, genMachineOperand(operands[0]), r0); // 把R0移动到dst
         cur_block->InsertInst(cur_inst);
     }
 }
 
 void ToBoolInstruction::genMachineCode(AsmBuilder *builder)
 {
-    // TODO
+    // int->bool：与 0 比较，不等为 1，相等为 0；条件跳转沿用这里的 cmp
+    auto cur_block = builder->getBlock();
+    auto src = genMachineRegOf(cur_block, genMachineOperand(operands[1]));
+    cur_block->InsertInst(new CmpMInstruction(cur_block, src, genMachineImm(0), CmpInstruction::NE));
+    builder->setCmpOpcode(CmpInstruction::NE);
+    if (isFusedIntoBranch())
+        return;
+    auto dst = genMachineOperand(operands[0]);
+    cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, dst, genMachineImm(0)));
+    dst = genMachineOperand(operands[0]);
+    cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, dst, genMachineImm(1), MachineInstruction::NE));
 }
 
 void TypeConverInstruction::genMachineCode(AsmBuilder *builder)
 {
-    // TODO
+    // 目前只有 bool->int 的零扩展会生成到这里，bool 已经是 0/1，直接 mov
+    auto cur_block = builder->getBlock();
+    auto dst = genMachineOperand(operands[0]);
+    auto src = genMachineOperand(operands[1]);
+    if (src->isImm())
+        cur_block->loadImm(dst, src->getVal());
+    else
+        cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src));
 }
 
 void GlobalVarDefInstruction::genMachineCode(AsmBuilder *builder)
 {
     // TODO
 }
+
+PhiInstruction::PhiInstruction(Operand *dst, BasicBlock *insert_bb) : Instruction(PHI, insert_bb)
+{
+    addDef(dst);
+}
+
+void PhiInstruction::addIncoming(Operand *src, BasicBlock *block)
+{
+    addUse(src);
+    blocks.push_back(block);
+}
+
+// 删去来自 block 的入边，后面的槽位依次前移
+void PhiInstruction::removeIncoming(BasicBlock *block)
+{
+    for (size_t i = 0; i < blocks.size();)
+    {
+        if (blocks[i] != block)
+        {
+            i++;
+            continue;
+        }
+        for (size_t j = i; j + 1 < blocks.size(); j++)
+        {
+            operands[j + 1].set(operands[j + 2].get());
+            blocks[j] = blocks[j + 1];
+        }
+        operands.pop_back();
+        blocks.pop_back();
+    }
+}
+
+void PhiInstruction::replaceIncomingBlock(BasicBlock *oldBlock, BasicBlock *newBlock)
+{
+    for (auto &block : blocks)
+        if (block == oldBlock)
+            block = newBlock;
+}
+
+void PhiInstruction::output() const
+{
+    *code_out << "  " << operands[0] << " = phi " << operands[0]->getType() << ' ';
+    for (size_t i = 0; i < blocks.size(); i++)
+        *code_out << (i ? ", " : "") << "[ " << operands[i + 1] << ", %B" << blocks[i]->getNo() << " ]";
+    *code_out << '\n';
+}
+
+void PhiInstruction::genMachineCode(AsmBuilder *builder)
+{
+    // phi 在 SSA 析构时已被替换为 CopyInstruction，走到这里说明流程有误
+    fprintf(stderr, "phi instruction reached code generation\n");
+    throw CompileError();
+}
+
+CopyInstruction::CopyInstruction(Operand *dst, Operand *src, BasicBlock *insert_bb) : Instruction(COPY, insert_bb)
+{
+    addDef(dst);
+    addUse(src);
+}
+
+void CopyInstruction::output() const
+{
+    // LLVM IR 中没有复制指令，用加 0 表示，仅供调试 SSA 析构的结果
+    *code_out << "  " << operands[0] << " = add " << operands[0]->getType() << ' ' << operands[1] << ", 0\n";
+}
+
+void CopyInstruction::genMachineCode(AsmBuilder *builder)
+{
+    auto cur_block = builder->getBlock();
+    auto dst = genMachineOperand(operands[0]);
+    auto src = genMachineOperand(operands[1]);
+    if (src->isImm()) // 常数按能否编码选用 mov、mvn 或 movw/movt
+        cur_block->loadImm(dst, src->getVal());
+    else
+        cur_block->InsertInst(new MovMInstruction(cur_block, MovMInstruction::MOV, dst, src));
+}
@@ -0,0 +1,212 @@
+#include "LICM.h"
+#include "Type.h"
+
+bool LICM::runOnFunction(Function *func)
+{
+    // 建前置块会改变 CFG，先全部建好再重新计算循环信息
+    bool changed = false;
+    for (auto loop : func->getLoopInfo().getLoops())
+        if (getPreheader(loop) == nullptr)
+        {
+            insertPreheader(func, loop);
+            changed = true;
+        }
+    if (changed)
+        func->invalidateAnalyses();
+
+    // 内层循环先处理，外提到内层前置块的指令还可以继续外提
+    int count = 0;
+    auto &loops = func->getLoopInfo().getLoops();
+    for (auto loop = loops.rbegin(); loop != loops.rend(); loop++)
+        count += hoist(*loop);
+    hoisted.push_back({func->getSymPtr()->toStr().substr(1), count});
+    return changed || count != 0;
+}
+
+void LICM::printStats(FILE *out)
+{
+    fprintf(out, "loop invariant code motion:\n");
+    fprintf(out, "  %-20s %8s\n", "function", "hoisted");
+    for (auto &it : hoisted)
+        fprintf(out, "  %-20s %8d\n", it.first.c_str(), it.second);
+}
+
+// 循环外唯一的前驱，且只有循环头一个后继
+BasicBlock *LICM::getPreheader(Loop *loop)
+{
+    BasicBlock *preheader = nullptr;
+    for (auto pred : loop->header->getPreds())
+    {
+        if (loop->contains(pred))
+            continue;
+        if (preheader != nullptr && preheader != pred)
+            return nullptr;
+        preheader = pred;
+    }
+    if (preheader == nullptr || preheader->getNumOfSucc() != 1)
+        return nullptr;
+    return preheader;
+}
+
+void LICM::insertPreheader(Function *func, Loop *loop)
+{
+    BasicBlock *header = loop->header;
+    BasicBlock *preheader = new BasicBlock(func);
+    std::vector<BasicBlock *> outside;
+    for (auto pred : header->getPreds())
+        if (!loop->contains(pred) && std::find(outside.begin(), outside.end(), pred) == outside.end())
+            outside.push_back(pred);
+
+    // 循环外的前驱改为跳到前置块
+    for (auto pred : outside)
+    {
+        Instruction *term = pred->rbegin();
+        if (term->isUncond())
+            ((UncondBrInstruction *)term)->setBranch(preheader);
+        else if (term->isCond())
+        {
+            auto br = (CondBrInstruction *)term;
+            if (br->getTrueBranch() == header)
+                br->setTrueBranch(preheader);
+            if (br->getFalseBranch() == header)
+                br->setFalseBranch(preheader);
+        }
+        auto &succs = pred->getSuccs();
+        while (std::find(succs.begin(), succs.end(), header) != succs.end())
+        {
+            pred->removeSucc(header);
+            pred->addSucc(preheader);
+            header->removePred(pred);
+            preheader->addPred(pred);
+        }
+    }
+    new UncondBrInstruction(header, preheader);
+    preheader->addSucc(header);
+    header->addPred(preheader);
+
+    // 头结点 phi 中来自循环外的值改为从前置块流入，多个时在前置块中先合并
+    for (auto inst = header->begin(); inst != header->end() && inst->isPhi(); inst = inst->getNext())
+    {
+        auto phi = (PhiInstruction *)inst;
+        std::vector<int> incoming;
+        for (int i = 0; i < phi->getNumIncoming(); i++)
+            if (std::find(outside.begin(), outside.end(), phi->getIncomingBlock(i)) != outside.end())
+                incoming.push_back(i);
+        if (incoming.size() == 1)
+        {
+            phi->replaceIncomingBlock(phi->getIncomingBlock(incoming[0]), preheader);
+            continue;
+        }
+        Operand *dst = new Operand(new TemporarySymbolEntry(phi->getDef()->getType(), SymbolTable::getLabel()));
+        auto merged = new PhiInstruction(dst);
+        preheader->insertFront(merged);
+        for (int i : incoming)
+            merged->addIncoming(phi->getIncomingValue(i), phi->getIncomingBlock(i));
+        for (auto pred : outside)
+            phi->removeIncoming(pred);
+        phi->addIncoming(dst, preheader);
+    }
+}
+
+bool LICM::isInvariant(Loop *loop, Operand *op)
+{
+    Instruction *def = op->getDef();
+    return def == nullptr || !loop->contains(def->getParent());
+}
+
+// 地址所指的变量：全局变量或 alloca 得到的栈上变量，其余返回 nullptr
+static Operand *getBase(Operand *addr)
+{
+    SymbolEntry *se = addr->getEntry();
+    if (se->isVariable() && ((IdentifierSymbolEntry *)se)->isGlobal())
+        return addr;
+    if (se->isTemporary() && addr->getDef() != nullptr && addr->getDef()->isAlloca())
+        return addr;
+    return nullptr;
+}
+
+bool LICM::canHoist(Loop *loop, Instruction *inst)
+{
+    // 操作数全是常数的指令留给常量折叠，外提只会拉长活跃区间
+    bool allConst = true;
+    for (auto &src : inst->getUse())
+    {
+        if (!isInvariant(loop, src))
+            return false;
+        if (!src->getEntry()->isConstant())
+            allConst = false;
+    }
+    if (allConst)
+        return false;
+    // 依赖标志位的指令及其 cmp 必须留在原处
+    if (inst->readsFlags() || inst->isFlagSource())
+        return false;
+    if (inst->isPure())
+    {
+        if (!inst->isBinary() || (inst->getOpcode() != BinaryInstruction::DIV && inst->getOpcode() != BinaryInstruction::MOD))
+            return true;
+        // 除法可能除零，只外提离开循环之前一定执行过的：所在块支配所有出口块。
+        // 只支配回边源不够，循环一次都不执行时原来不会除零，外提后却会
+        auto &dt = inst->getParent()->getParent()->getDomTree();
+        bool exits = false;
+        for (auto bb : loop->blocks)
+            for (auto succ : bb->getSuccs())
+                if (!loop->contains(succ))
+                {
+                    if (!dt.dominates(inst->getParent(), bb))
+                        return false;
+                    exits = true;
+                }
+        return exits;
+    }
+    if (inst->isLoad())
+    {
+        Operand *base = getBase(inst->getOperands()[1]);
+        return base != nullptr && !clobbersAll && !storedBases.count(base);
+    }
+    return false;
+}
+
+// 统计循环对内存的写入：调用或写入未知地址视为可能修改任何变量
+void LICM::collectStores(Loop *loop)
+{
+    clobbersAll = false;
+    storedBases.clear();
+    for (auto bb : loop->blocks)
+        for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+        {
+            if (inst->isCall())
+                clobbersAll = true;
+            else if (inst->isStore())
+            {
+                Operand *base = getBase(inst->getOperands()[0]);
+                if (base == nullptr)
+                    clobbersAll = true;
+                else
+                    storedBases.insert(base);
+            }
+        }
+}
+
+int LICM::hoist(Loop *loop)
+{
+    BasicBlock *preheader = getPreheader(loop);
+    if (preheader == nullptr)
+        return 0;
+    collectStores(loop);
+    int count = 0;
+    // 按逆后序扫描，定值先于使用被访问，一遍即可得到所有可外提的指令
+    for (auto bb : loop->blocks)
+    {
+        for (auto inst = bb->begin(), next = inst; inst != bb->end(); inst = next)
+        {
+            next = inst->getNext();
+            if (!canHoist(loop, inst))
+                continue;
+            bb->remove(inst);
+            preheader->insertBefore(inst, preheader->rbegin());
+            count++;
+        }
+    }
+    return count;
+}
@@ -2,232 +2,317 @@
 #include "LinearScan.h"
 #include "MachineCode.h"
 #include "LiveVariableAnalysis.h"
+#include "TimeReport.h"
+#include "ThreadPool.h"
+#include "Compiler.h"
 
 LinearScan::LinearScan(MachineUnit *unit)
 {
     this->unit = unit;
-    for (int i = 4; i < 11; i++) // 通用寄存器，ARM 架构中的 r4 到 r10
+    // 先用调用者保存的 r0-r3、r12，不需要在序言中压栈；再用 r4 到 r10
+    for (int i : {0, 1, 2, 3, 12})
         regs.push_back(i);
+    for (int i = 4; i < 11; i++)
+        regs.push_back(i);
+}
+
+// lr 总是在序言中压栈，r0-r3、r12 由调用者保存，只有 r4-r10 需要另外保存
+static bool isCalleeSaved(int reg)
+{
+    return reg >= 4 && reg <= 10;
+}
+
+// 执行整个寄存器分配过程。各函数的分配互不相干，每个函数用一个独立的 LinearScan
+void LinearScan::allocateRegisters(ThreadPool *pool)
+{
+    auto &funcs = unit->getFuncs();
+    timedParallelFor(pool, funcs.size(), [&](size_t i)
+                     {
+                         LinearScan allocator(unit);
+                         allocator.allocateFunction(funcs[i]); }, &funcs);
 }
 
-// 执行整个寄存器分配过程
-void LinearScan::allocateRegisters()
+void LinearScan::allocateFunction(MachineFunction *f)
 {
-    for (auto &f : unit->getFuncs()) // 遍历 MachineUnit 中的每个 MachineFunction
+    if (f->isCached())
+        return;
+    func = f;
+    // 不调用其他函数时 lr 只在返回前由 pop 恢复，函数体内可以当作普通寄存器
+    bool leaf = true;
+    for (auto &block : func->getBlocks())
+        for (auto &inst : block->getInsts())
+            if (inst->isCall())
+                leaf = false;
+    if (leaf)
+        regs.push_back(14);
+    // 溢出代码新建的虚拟寄存器接着该函数指令选择时的编号
+    SymbolTable::setLabel(func->getNextVReg());
+    bool success;
+    success = false;
+    // 重复以下步骤，直到成功将所有虚拟寄存器映射到物理寄存器
+    while (!success) // repeat until all vregs can be mapped
     {
-        func = f;
-        bool success;
-        success = false;
-        // 对每个函数，重复以下步骤，直到成功将所有虚拟寄存器映射到物理寄存器
-        while (!success) // repeat until all vregs can be mapped
+        func->addAllocRound();                    // 记录分配/溢出的轮数
         {
-            computeLiveIntervals();                   // 计算当前函数中所有虚拟寄存器的活跃区间
+            TimeRegion region("liveness");
+            computeLiveIntervals(); // 计算当前函数中所有虚拟寄存器的活跃区间
+        }
+        {
+            TimeRegion region("scan");
             success = linearScanRegisterAllocation(); // 执行线性扫描寄存器分配，尝试将虚拟寄存器映射到物理寄存器
-            if (success)                              // all vregs can be mapped to real regs
-                modifyCode();                         // 分配成功，修改机器代码，将虚拟寄存器替换为物理寄存器
-            else                                      // spill vregs that can't be mapped to real regs
-                genSpillCode();                       // 分配失败，生成溢出代码，将部分虚拟寄存器存储到内存中，并重新尝试分配
+        }
+        if (success)      // all vregs can be mapped to real regs
+            modifyCode(); // 分配成功，修改机器代码，将虚拟寄存器替换为物理寄存器
+        else              // spill vregs that can't be mapped to real regs
+        {
+            TimeRegion region("spill");
+            genSpillCode(); // 分配失败，生成溢出代码，将部分虚拟寄存器存储到内存中，并重新尝试分配
         }
     }
+    func->setNextVReg(SymbolTable::peekLabel());
+    for (auto &interval : intervals)
+        delete interval;
+    intervals.clear();
+    for (auto &interval : fixedIntervals)
+        delete interval;
+    fixedIntervals.clear();
 }
 
-// 构建定义-使用（Def-Use）链，记录每个定义操作数被哪些使用操作数引用
-void LinearScan::makeDuChains()
+bool LinearScan::Interval::covers(int pos) const
 {
-    LiveVariableAnalysis lva;
-    lva.pass(func);    // 对当前函数执行活跃变量分析
-    du_chains.clear(); // 清空 du_chains，准备重新构建 Def-Use 链
-    int i = 0;
-    std::map<MachineOperand, std::set<MachineOperand *>> liveVar;
-    for (auto &bb : func->getBlocks()) // 对每个基本块bb
+    // 找到第一段 to >= pos 的段，再看它是否从 pos 之前开始
+    auto it = std::lower_bound(ranges.begin(), ranges.end(), pos,
+                               [](const Range &r, int p)
+                               { return r.to < p; });
+    return it != ranges.end() && it->from <= pos;
+}
+
+bool LinearScan::Interval::intersects(const Interval *other) const
+{
+    if (ranges.empty() || other->ranges.empty())
+        return false;
+    // 固定区间可能遍布整个函数，先跳过两边位于对方起点之前的段
+    auto a = std::lower_bound(ranges.begin(), ranges.end(), other->ranges.front().from,
+                              [](const Range &r, int p)
+                              { return r.to < p; });
+    auto b = std::lower_bound(other->ranges.begin(), other->ranges.end(), ranges.front().from,
+                              [](const Range &r, int p)
+                              { return r.to < p; });
+    while (a != ranges.end() && b != other->ranges.end())
     {
-        liveVar.clear();                 // 清空 liveVar
-        for (auto &t : bb->getLiveOut()) // 遍历 bb 的 LiveOut 集合，记录每个操作数的活跃位置
-            liveVar[*t].insert(t);
-        int no;
-        // no表示当前基本块最后一条指令的编号，i表示所有之前的基本块+当前基本块的指令数量
-        no = i = bb->getInsts().size() + i; // 计算指令编号 no，根据基本块中指令数量更新 i 和 no
-        for (auto inst = bb->getInsts().rbegin(); inst != bb->getInsts().rend(); inst++)
-        {                         // 逆序遍历基本块中的指令（从后向前），以便构建 Def-Use 链
-            (*inst)->setNo(no--); // 为每条指令设置编号 no，并递减 no
-            for (auto &def : (*inst)->getDef())
-            {
-                if (def->isVReg()) // 如果 def 是虚拟寄存器
-                {
-                    auto &uses = liveVar[*def];                      // 获取 def 的所有使用操作数 uses
-                    du_chains[def].insert(uses.begin(), uses.end()); // 将 uses 插入到 du_chains[def] 中
-                    auto &kill = lva.getAllUses()[*def];             // 获取 def 的所有被杀死的使用操作数 kill
-                    std::set<MachineOperand *> res;
-                    // 从 uses 中移除被杀死的操作数
-                    set_difference(uses.begin(), uses.end(), kill.begin(), kill.end(), inserter(res, res.end()));
-                    liveVar[*def] = res; // res = uses - kill
-                }
-            }
-            for (auto &use : (*inst)->getUse())
-            {
-                if (use->isVReg())
-                    liveVar[*use].insert(use); // 对每个使用的操作数 use，如果 use 是虚拟寄存器，记录其在 liveVar 中的使用位置
-            }
-        }
+        if (a->to < b->from)
+            a++;
+        else if (b->to < a->from)
+            b++;
+        else
+            return true;
     }
+    return false;
 }
 
-// 计算所有虚拟寄存器的活跃区间，并对区间进行合并和排序
-void LinearScan::computeLiveIntervals()
+LinearScan::Interval *LinearScan::getInterval(MachineOperand *vreg)
 {
-    makeDuChains(); // 构建定义-使用链
-
-    // 初始化活跃区间
-    intervals.clear();
-    for (auto &du_chain : du_chains)
-    { // 遍历 du_chains，为每个定义操作数创建一个初始的 Interval
-        int t = -1;
-        for (auto &use : du_chain.second)
-            t = std::max(t, use->getParent()->getNo());
-        Interval *interval = new Interval({du_chain.first->getParent()->getNo(), t, false, 0, 0, {du_chain.first}, du_chain.second});
+    auto &interval = vreg2interval[vreg->getReg()];
+    if (interval == nullptr)
+    {
+        interval = new Interval({0, 0, false, 0, 0, !spillTemps.count(vreg->getReg()), {}, {}, {}});
         intervals.push_back(interval);
     }
+    return interval;
+}
+
+LinearScan::Interval *LinearScan::getFixedInterval(int reg)
+{
+    if (reg >= (int)fixedIntervals.size() || isCalleeSaved(reg) ||
+        std::find(regs.begin(), regs.end(), reg) == regs.end())
+        return nullptr;
+    // lr 只在叶函数中分配，而叶函数体内只有返回的 bx 读取它，不需要固定区间
+    if (reg == 14)
+        return nullptr;
+    auto &interval = fixedIntervals[reg];
+    if (interval == nullptr)
+        interval = new Interval({0, 0, false, 0, reg, false, {}, {}, {}});
+    return interval;
+}
+
+void LinearScan::addFixedConflicts(Interval *interval, std::set<int> &regs)
+{
+    for (auto &fixed : fixedIntervals)
+        if (fixed != nullptr && fixed->intersects(interval))
+            regs.insert(fixed->rreg);
+}
+
+// 块按编号从大到小、块内指令从后往前访问，新加入的段总在已有段之前，
+// 因此 ranges 在构建时按降序存放，末尾即位置最靠前的段。
+// 只隔一个位置的两段也合并：条件执行的一对 mov 先后写同一个寄存器，中间不能分给别的区间
+void LinearScan::addRange(Interval *interval, int from, int to)
+{
+    auto &ranges = interval->ranges;
+    if (!ranges.empty() && ranges.back().from <= to + 2)
+    {
+        ranges.back().from = std::min(ranges.back().from, from);
+        ranges.back().to = std::max(ranges.back().to, to);
+    }
+    else
+        ranges.push_back({from, to});
+}
+
+// 计算所有虚拟寄存器的活跃区间：对每个基本块自后向前扫描一次，得到带空洞的多段区间
+// 调用者保存的物理寄存器按同样的方式得到固定区间
+void LinearScan::computeLiveIntervals()
+{
+    LiveVariableAnalysis lva;
+    lva.pass(func); // 对当前函数执行活跃变量分析
 
-    // 调整活跃区间
-    // 遍历每个 Interval，根据基本块的 LiveIn 和 LiveOut 集合调整其 start 和 end
-    // 逻辑较为复杂，主要基于操作数在不同基本块中的活跃状态，调整活跃区间的范围
     for (auto &interval : intervals)
+        delete interval;
+    intervals.clear();
+    vreg2interval.clear();
+    for (auto &interval : fixedIntervals)
+        delete interval;
+    fixedIntervals.assign(MachineFunction::NUM_PHYS_REGS, nullptr);
+
+    // 按基本块顺序为指令编号
+    int no = 0;
+    for (auto &bb : func->getBlocks())
+        for (auto &inst : bb->getInsts())
+            inst->setNo(no++);
+
+    auto &blocks = func->getBlocks();
+    BitVector live(func->getNumLiveIndex());
+    for (auto bb = blocks.rbegin(); bb != blocks.rend(); bb++)
     {
-        auto uses = interval->uses;
-        auto begin = interval->start;
-        auto end = interval->end;
-        for (auto block : func->getBlocks())
+        auto &insts = (*bb)->getInsts();
+        if (insts.empty())
+            continue;
+        // 指令 n 在 2n 处读取操作数、在 2n+1 处写入结果，结果可以复用在该指令处结束的操作数的寄存器
+        int blockFrom = 2 * insts.front()->getNo();
+        int blockTo = 2 * insts.back()->getNo() + 1;
+
+        // 出口处活跃的寄存器先覆盖整个基本块，遇到定值时再截短
+        live.clear();
+        live.unionWith((*bb)->getLiveOut());
+        for (int t = live.findFirst(); t >= 0; t = live.findNext(t))
         {
-            auto liveIn = block->getLiveIn();
-            auto liveOut = block->getLiveOut();
-            bool in = false;
-            bool out = false;
-            for (auto use : uses)
-                if (liveIn.count(use))
+            if (t < MachineFunction::NUM_PHYS_REGS)
+            {
+                if (auto fixed = getFixedInterval(t))
+                    addRange(fixed, blockFrom, blockTo);
+                continue;
+            }
+            MachineOperand vreg(MachineOperand::VREG, func->getVRegOf(t));
+            addRange(getInterval(&vreg), blockFrom, blockTo);
+        }
+
+        for (auto inst = insts.rbegin(); inst != insts.rend(); inst++)
+        {
+            int pos = 2 * (*inst)->getNo();
+            for (auto &def : (*inst)->getDef())
+            {
+                Interval *interval;
+                if (def->isVReg())
                 {
-                    in = true;
-                    break;
+                    interval = getInterval(def);
+                    interval->defs.push_back(def);
                 }
-            for (auto use : uses)
-                if (liveOut.count(use))
+                else if (!def->isReg() || (interval = getFixedInterval(def->getReg())) == nullptr)
+                    continue;
+                int idx = func->getLiveIndex(def);
+                if (live.test(idx))
+                    interval->ranges.back().from = pos + 1; // 截短到定值处
+                else
+                    addRange(interval, pos + 1, pos + 1); // 定值后不再使用
+                live.reset(idx);
+                if ((*inst)->readsDefs())
                 {
-                    out = true;
-                    break;
+                    // 条件不成立时原值保留下来，定值之前同样活跃
+                    addRange(interval, blockFrom, pos);
+                    live.set(idx);
                 }
-            if (in && out)
-            {
-                begin = std::min(begin, (*(block->begin()))->getNo());
-                end = std::max(end, (*(block->rbegin()))->getNo());
-            }
-            else if (!in && out)
-            {
-                for (auto i : block->getInsts())
-                    if (i->getDef().size() > 0 &&
-                        i->getDef()[0] == *(uses.begin()))
-                    {
-                        begin = std::min(begin, i->getNo());
-                        break;
-                    }
-                end = std::max(end, (*(block->rbegin()))->getNo());
             }
-            else if (in && !out)
+            for (auto &use : (*inst)->getUse())
             {
-                begin = std::min(begin, (*(block->begin()))->getNo());
-                int temp = 0;
-                for (auto use : uses)
-                    if (use->getParent()->getParent() == block)
-                        temp = std::max(temp, use->getParent()->getNo());
-                end = std::max(temp, end);
+                Interval *interval;
+                if (use->isVReg())
+                {
+                    interval = getInterval(use);
+                    interval->uses.push_back(use);
+                }
+                else if (!use->isReg() || (interval = getFixedInterval(use->getReg())) == nullptr)
+                    continue;
+                addRange(interval, blockFrom, pos);
+                live.set(func->getLiveIndex(use));
             }
         }
-        interval->start = begin;
-        interval->end = end;
     }
 
-    // 合并有重叠使用的活跃区间，确保每个操作数只有一个活跃区间
-    /*对所有活跃区间进行两两比较。
-    如果两个区间有共同的使用点（即 uses 有交集），则合并这两个区间。
-    更新 start 和 end，移除被合并的区间。*/
-    bool change;
-    change = true;
-    while (change)
+    for (auto &interval : intervals)
     {
-        change = false;
-        std::vector<Interval *> t(intervals.begin(), intervals.end());
-        for (size_t i = 0; i < t.size(); i++)
-            for (size_t j = i + 1; j < t.size(); j++)
-            {
-                Interval *w1 = t[i];
-                Interval *w2 = t[j];
-                if (**w1->defs.begin() == **w2->defs.begin())
-                {
-                    std::set<MachineOperand *> temp;
-                    set_intersection(w1->uses.begin(), w1->uses.end(), w2->uses.begin(), w2->uses.end(), inserter(temp, temp.end()));
-                    if (!temp.empty())
-                    {
-                        change = true;
-                        w1->defs.insert(w2->defs.begin(), w2->defs.end());
-                        w1->uses.insert(w2->uses.begin(), w2->uses.end());
-                        // w1->start = std::min(w1->start, w2->start);
-                        // w1->end = std::max(w1->end, w2->end);
-                        auto w1Min = std::min(w1->start, w1->end);
-                        auto w1Max = std::max(w1->start, w1->end);
-                        auto w2Min = std::min(w2->start, w2->end);
-                        auto w2Max = std::max(w2->start, w2->end);
-                        w1->start = std::min(w1Min, w2Min);
-                        w1->end = std::max(w1Max, w2Max);
-                        auto it = std::find(intervals.begin(), intervals.end(), w2);
-                        if (it != intervals.end())
-                            intervals.erase(it);
-                    }
-                }
-            }
+        std::reverse(interval->ranges.begin(), interval->ranges.end());
+        interval->start = interval->ranges.front().from;
+        interval->end = interval->ranges.back().to;
     }
+    for (auto &fixed : fixedIntervals)
+        if (fixed != nullptr)
+            std::reverse(fixed->ranges.begin(), fixed->ranges.end());
     sort(intervals.begin(), intervals.end(), compareStart);
 }
 
 // 执行线性扫描寄存器分配，尝试将所有活跃区间映射到物理寄存器，返回是否分配成功，是否需要溢出处理
 bool LinearScan::linearScanRegisterAllocation()
 {
-    // Todo
     /*
-        active ←{}
+        active ←{}, inactive ←{}
         foreach live interval i, in order of increasing start point
             ExpireOldIntervals(i)
-            if length(active) = R then
-                SpillAtInterval(i)
-            else
-                register[i] ← a register removed from pool of free registers
+            if a register is free for the whole of i then
+                register[i] ← that register
                 add i to active, sorted by increasing end point
+            else
+                SpillAtInterval(i)
 
-        活跃区间的扫描：按照起始位置顺序扫描每个活跃区间。
-        寄存器分配：为每个活跃区间分配一个物理寄存器，如果没有可用寄存器，则选择一个区间进行溢出。
-        活跃列表管理：保持一个 actives 列表，存储当前活跃的区间，并按结束位置排序，以便快速找到需要溢出的区间。
+        区间带有空洞：处于空洞中的区间放在 inactives 中，其寄存器可以分给
+        与它不相交的区间使用。
     */
     bool flag = true;
 
     actives.clear();
-    regs.clear();
-    for (int i = 4; i <= 10; i++)
-        regs.push_back(i);
+    inactives.clear();
 
     for (auto i = intervals.begin(); i != intervals.end(); i++)
     {                           // 按照起始位置顺序扫描每个活跃区间
-        expireOldIntervals(*i); // 释放在当前处理的区间（interval）开始之前已经结束的活动区间的寄存器
+        expireOldIntervals(*i); // 回收已经结束的区间的寄存器，并在 actives 与 inactives 之间移动区间
 
-        if (regs.empty()) // 当前没有可用于分配的物理寄存器
+        // 被 active 占用的寄存器不可用；inactive 区间和固定区间只有与当前区间相交时才占用寄存器
+        std::set<int> busy;
+        for (auto &active : actives)
+            busy.insert(active->rreg);
+        for (auto &inactive : inactives)
+            if (inactive->intersects(*i))
+                busy.insert(inactive->rreg);
+        addFixedConflicts(*i, busy);
+
+        auto reg = std::find_if(regs.begin(), regs.end(), [&](int r)
+                                { return !busy.count(r); });
+        if (reg == regs.end()) // 当前没有可用于分配的物理寄存器
         {
             spillAtInterval(*i); // 选择一个需要溢出的活跃区间，并标记当前区间 i 为溢出
             flag = false;        // 表示分配未完全成功，需要溢出处理
         }
         else // 当前有可用于分配的物理寄存器
         {
-            (*i)->rreg = regs.front();                        // 为区间 i 分配物理寄存器
-            regs.erase(regs.begin());                         // 从 regs 中移除该寄存器
-            actives.push_back((*i));                          // 将区间 i 添加到 actives 中
-            sort(actives.begin(), actives.end(), compareEnd); // 按照活跃区间的结束位置对 actives 进行排序，确保最早结束的区间位于前面
+            (*i)->rreg = *reg; // 为区间 i 分配物理寄存器
+            actives.insert(std::upper_bound(actives.begin(), actives.end(), *i, compareEnd), *i);
         }
     }
+    // 没有可溢出的区间被选中时，下一轮与本轮完全相同，分配不会结束
+    if (!flag && std::none_of(intervals.begin(), intervals.end(), [](Interval *i)
+                              { return i->spill; }))
+    {
+        fprintf(stderr, "寄存器分配错误：函数 %s 中溢出代码的临时寄存器分不到物理寄存器\n",
+                func->getSymPtr()->toStr().c_str());
+        throw CompileError();
+    }
     return flag;
 }
 
@@ -236,7 +321,8 @@ void LinearScan::modifyCode()
 {
     for (auto &interval : intervals) // 遍历所有活跃区间
     {
-        func->addSavedRegs(interval->rreg); // 记录保存的寄存器
+        if (isCalleeSaved(interval->rreg))
+            func->addSavedRegs(interval->rreg); // 记录需要在序言中保存的寄存器
         for (auto def : interval->defs)
             def->setReg(interval->rreg); // 替换定义操作数，将其寄存器编号设置为分配的物理寄存器 rreg
         for (auto use : interval->uses)
@@ -244,14 +330,34 @@ void LinearScan::modifyCode()
     }
 }
 
+// 在 inst 之前插入 ldr vreg, [fp, #disp]，偏移不能编码时先把它装入寄存器
+void LinearScan::insertSpillLoad(MachineInstruction *inst, int vreg, int disp)
+{
+    auto block = inst->getParent();
+    auto temp = new MachineOperand(MachineOperand::VREG, vreg);
+    auto fp = new MachineOperand(MachineOperand::REG, 11);
+    auto &instructions = block->getInsts();
+    auto it = std::find(instructions.begin(), instructions.end(), inst);
+    if (!isLegalMemOffset(disp))
+    {
+        int off_no = SymbolTable::getLabel();
+        spillTemps.insert(off_no);
+        it = block->insertLoadImm(it, new MachineOperand(MachineOperand::VREG, off_no), disp);
+        instructions.insert(it, new LoadMInstruction(block, temp, fp, new MachineOperand(MachineOperand::VREG, off_no)));
+    }
+    else
+        instructions.insert(it, new LoadMInstruction(block, temp, fp, new MachineOperand(MachineOperand::IMM, disp)));
+}
+
 // 生成溢出代码（spill code），将需要溢出的虚拟寄存器存储到内存中，并在使用时从内存加载回来
+// 每个使用/定值都换成一个新的虚拟寄存器，只在 ldr/str 与该指令之间活跃
 void LinearScan::genSpillCode()
 {
     for (auto &interval : intervals)
     {
         if (!interval->spill)
             continue;
-        // TODO
+        func->addSpilledVReg();
         /* HINT:
          * The vreg should be spilled to memory.
          * 1. insert ldr inst before the use of vreg
@@ -260,86 +366,95 @@ void LinearScan::genSpillCode()
 
         interval->disp = -func->AllocSpace(4);
 
-        auto off = new MachineOperand(MachineOperand::IMM, interval->disp);
-        auto fp = new MachineOperand(MachineOperand::REG, 11);
         for (auto use : interval->uses)
         {
-            auto temp = new MachineOperand(*use);
-            MachineOperand *operand = nullptr;
-            if (interval->disp > 255 || interval->disp < -255)
-            {
-                operand = new MachineOperand(MachineOperand::VREG, SymbolTable::getLabel());
-                auto inst = new LoadMInstruction(use->getParent()->getParent(), operand, off);
-                auto &instructions = use->getParent()->getParent()->getInsts();
-                auto it = std::find(instructions.begin(), instructions.end(), use->getParent());
-                instructions.insert(it, inst);
-                inst = new LoadMInstruction(use->getParent()->getParent(), temp, fp, new MachineOperand(*operand));
-                instructions.insert(it, inst);
-            }
-            else
-            {
-                auto inst = new LoadMInstruction(use->getParent()->getParent(), temp, fp, off);
-                auto &instructions = use->getParent()->getParent()->getInsts();
-                auto it = std::find(instructions.begin(), instructions.end(), use->getParent());
-                instructions.insert(it, inst);
-            }
+            // movt 的隐式使用这类读取本指令定值的操作数，在下面与定值一起改写
+            if (use->getParent()->readsOwnDef(use))
+                continue;
+            int temp_no = SymbolTable::getLabel();
+            spillTemps.insert(temp_no);
+            use->setVReg(temp_no);
+            insertSpillLoad(use->getParent(), temp_no, interval->disp);
         }
         for (auto def : interval->defs)
         {
-            auto temp = new MachineOperand(*def);
-            MachineOperand *operand = nullptr;
-            MachineInstruction *inst = nullptr;
-            if (interval->disp > 255 || interval->disp < -255)
+            int temp_no = SymbolTable::getLabel();
+            spillTemps.insert(temp_no);
+            int old_no = def->getReg();
+            def->setVReg(temp_no);
+            // 带条件的定值在条件不成立时要保留栈槽中原来的值，movt 要保留低半字，先把它装入同一个临时寄存器
+            if (def->getParent()->readsDefs())
             {
-                operand = new MachineOperand(MachineOperand::VREG, SymbolTable::getLabel());
-                inst = new LoadMInstruction(def->getParent()->getParent(), operand, off);
-                auto &instructions = def->getParent()->getParent()->getInsts();
-                auto it = std::find(instructions.begin(), instructions.end(), def->getParent());
-                instructions.insert(++it, inst);
-                inst = new StoreMInstruction(def->getParent()->getParent(), temp, fp, new MachineOperand(*operand));
-                instructions.insert(++it, inst);
+                insertSpillLoad(def->getParent(), temp_no, interval->disp);
+                for (auto use : def->getParent()->getUse())
+                    if (use->isVReg() && use->getReg() == old_no)
+                        use->setVReg(temp_no);
+            }
+            auto block = def->getParent()->getParent();
+            auto temp = new MachineOperand(MachineOperand::VREG, temp_no);
+            auto fp = new MachineOperand(MachineOperand::REG, 11);
+            auto &instructions = block->getInsts();
+            auto it = std::find(instructions.begin(), instructions.end(), def->getParent()) + 1;
+            if (!isLegalMemOffset(interval->disp))
+            {
+                int off_no = SymbolTable::getLabel();
+                spillTemps.insert(off_no);
+                it = block->insertLoadImm(it, new MachineOperand(MachineOperand::VREG, off_no), interval->disp);
+                auto inst = new StoreMInstruction(block, temp, fp, new MachineOperand(MachineOperand::VREG, off_no));
+                instructions.insert(it, inst);
             }
             else
             {
-                inst = new StoreMInstruction(def->getParent()->getParent(), temp, fp, off);
-                auto &instructions = def->getParent()->getParent()->getInsts();
-                auto it = std::find(instructions.begin(), instructions.end(), def->getParent());
-                instructions.insert(++it, inst);
+                auto inst = new StoreMInstruction(block, temp, fp, new MachineOperand(MachineOperand::IMM, interval->disp));
+                instructions.insert(it, inst);
             }
         }
     }
 }
 
-// 释放那些在当前处理的活跃区间开始之前已经结束的区间所占用的寄存器
+// 根据当前区间的起点维护 actives 与 inactives，释放已经结束的区间所占用的寄存器
 void LinearScan::expireOldIntervals(Interval *interval)
 {
-    // Todo
     /*
-        foreach interval j in active, in order of increasing end point
-            if endpoint[j] ≥ startpoint[i] then
-                return
-            remove j from active
-            add register[j] to pool of free registers
+        foreach interval j in active
+            if endpoint[j] < startpoint[i] then remove j from active
+            else if j does not cover startpoint[i] then move j to inactive
+        foreach interval j in inactive
+            if endpoint[j] < startpoint[i] then remove j from inactive
+            else if j covers startpoint[i] then move j to active
     */
-    // 遍历活跃区间
-    for (auto i = actives.begin(); i != actives.end();)
+    int pos = interval->start;
+    std::vector<Interval *> stillActive, stillInactive;
+    for (auto &active : actives)
     {
-        if ((*i)->end >= interval->start) // 如果当前活动区间 (*i) 的结束时间 end 大于或等于当前区间的开始时间 interval->start，说明该区间还未过期，直接退出循环。
-            return;
-        // 释放寄存器
-        regs.push_back((*i)->rreg);
-        sort(regs.begin(), regs.end());                              // 对 regs 进行排序，以便优先使用低编号的寄存器
-        i = actives.erase(find(actives.begin(), actives.end(), *i)); // 如果当前区间已过期（结束时间小于当前区间的开始时间），将其占用的寄存器号 (*i)->rreg 回收，存入 regs。
+        if (active->end < pos)
+            continue;
+        if (active->covers(pos))
+            stillActive.push_back(active);
+        else
+            stillInactive.push_back(active);
     }
+    for (auto &inactive : inactives)
+    {
+        if (inactive->end < pos)
+            continue;
+        if (inactive->covers(pos))
+            stillActive.push_back(inactive);
+        else
+            stillInactive.push_back(inactive);
+    }
+    sort(stillActive.begin(), stillActive.end(), compareEnd);
+    actives.swap(stillActive);
+    inactives.swap(stillInactive);
 }
 
 // 在当前活跃区间无法分配寄存器时，选择一个区间进行溢出处理
 void LinearScan::spillAtInterval(Interval *interval)
 {
-    // Todo
     /*
-        spill ← last interval in active
-        if endpoint[spill] > endpoint[i] then
+        spill ← active interval with the furthest end point whose register
+                is not needed by an inactive or fixed interval overlapping i
+        if spill exists and (endpoint[spill] > endpoint[i] or i cannot be spilled) then
             register[i] ← register[spill]
             location[spill] ← new stack location
             remove spill from active
@@ -347,21 +462,31 @@ void LinearScan::spillAtInterval(Interval *interval)
         else
             location[i] ← new stack location
     */
-    // 获取 actives 列表中的最后一个活跃区间 activeInterval，由于 actives 按结束时间排序，这通常是结束时间最晚的区间
-    auto activeInterval = actives.back();
-    if (activeInterval->end > interval->end) // 比较结束时间，如果 activeInterval->end > interval->end
+    std::set<int> blocked;
+    for (auto &inactive : inactives)
+        if (inactive->intersects(interval))
+            blocked.insert(inactive->rreg);
+    addFixedConflicts(interval, blocked);
+    Interval *spill = nullptr;
+    for (auto it = actives.rbegin(); it != actives.rend(); it++)
+        if ((*it)->spillable && !blocked.count((*it)->rreg))
+        {
+            spill = *it;
+            break;
+        }
+    if (spill != nullptr && (spill->end > interval->end || !interval->spillable))
     {
-        // 说明 activeInterval 的活跃时间比当前区间更长，应优先溢出 activeInterval
-        activeInterval->spill = true;                     // 需要溢出
-        interval->rreg = activeInterval->rreg;            // 将 activeInterval 的寄存器 rreg 分配给当前区间 interval。
-        func->addSavedRegs(interval->rreg);               // 调用 func->addSavedRegs(interval->rreg)，记录需要保存的寄存器。
-        actives.push_back(interval);                      // 将当前区间 interval 添加到 actives 中，并重新排序
-        sort(actives.begin(), actives.end(), compareEnd); // 如果是 active 列表中的活跃区间结束时间更晚，需要置位其 spill 标志位，并将其占用的寄存器分配给区间 i，再将区间 i 插入到 active 列表中。
+        // 说明 spill 的活跃时间比当前区间更长，应优先溢出 spill
+        spill->spill = true;
+        interval->rreg = spill->rreg;
+        actives.erase(std::find(actives.begin(), actives.end(), spill));
+        actives.insert(std::upper_bound(actives.begin(), actives.end(), interval, compareEnd), interval);
     }
-    else
+    else if (interval->spillable)
     {
         interval->spill = true; // 如果是活跃区间 i 的结束时间更晚，只需要置位其 spill 标志位即可
     }
+    // 溢出代码的临时寄存器再溢出也不会缩短区间，本轮不分配，等其他区间溢出后重试
 }
 
 // 提供比较函数，用于排序活跃区间
@@ -6,91 +6,145 @@
 void LiveVariableAnalysis::pass(MachineUnit *unit)
 {
     for (auto &func : unit->getFuncs())
-    {
-        computeUsePos(func); // 计算操作数的使用位置
-        computeDefUse(func); // 计算每个基本块的 def 和 use 集合
-        iterate(func);       // 迭代计算 LiveIn 和 LiveOut 集合，直到收敛
-    }
+        pass(func);
 }
 
 // 对单个机器函数执行活跃变量分析
 void LiveVariableAnalysis::pass(MachineFunction *func)
 {
-    computeUsePos(func);
-    computeDefUse(func);
-    iterate(func);
+    func->numberVRegs(); // 为寄存器分配稠密编号
+    computeOrder(func);  // 计算基本块的逆后序
+    computeUsePos(func); // 计算寄存器的使用位置
+    computeDefUse(func); // 计算每个基本块的 def 和 use 集合
+    iterate(func);       // 迭代计算 LiveIn 和 LiveOut 集合，直到收敛
+}
+
+void LiveVariableAnalysis::computeOrder(MachineFunction *func)
+{
+    order.clear();
+    block_pos.clear();
+    auto &blocks = func->getBlocks();
+    if (blocks.empty())
+        return;
+
+    // 非递归 DFS 求后序，再整体翻转得到逆后序
+    std::unordered_map<MachineBlock *, bool> visited;
+    std::vector<std::pair<MachineBlock *, size_t>> stack;
+    stack.push_back({blocks[0], 0});
+    visited[blocks[0]] = true;
+    while (!stack.empty())
+    {
+        auto &top = stack.back();
+        auto &succs = top.first->getSuccs();
+        if (top.second < succs.size())
+        {
+            auto succ = succs[top.second++];
+            if (!visited[succ])
+            {
+                visited[succ] = true;
+                stack.push_back({succ, 0});
+            }
+        }
+        else
+        {
+            order.push_back(top.first);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    // 不可达的块也会生成代码，同样需要活跃信息
+    for (auto &block : blocks)
+        if (!visited[block])
+            order.push_back(block);
+    for (size_t i = 0; i < order.size(); i++)
+        block_pos[order[i]] = i;
 }
 
 // 计算每个基本块的定义 (def) 和使用 (use) 集合
 void LiveVariableAnalysis::computeDefUse(MachineFunction *func)
 {
-    for (auto &block : func->getBlocks()) // 遍历函数中的每个基本块
+    int n = func->getNumLiveIndex();
+    def.assign(order.size(), BitVector(n));
+    use.assign(order.size(), BitVector(n));
+    for (size_t b = 0; b < order.size(); b++)
     {
-        // 遍历基本块中的每条指令
-        for (auto inst = block->getInsts().begin(); inst != block->getInsts().end(); inst++)
+        for (auto &inst : order[b]->getInsts())
         {
-            auto user = (*inst)->getUse();                             // 获取指令使用的所有操作数（inst->getUse()）
-            std::set<MachineOperand *> temp(user.begin(), user.end()); // 创建一个临时集合 temp，包含所有使用的操作数
-
-            // use[block] 由 temp 与 def[block] 的差集组成
-            // 即：在基本块中使用但未定义的操作数
-            set_difference(temp.begin(), temp.end(),
-                           def[block].begin(), def[block].end(), inserter(use[block], use[block].end()));
-
-            // 将 all_uses[*d] 中的所有使用位置插入到 def[block] 中。
-            // 即：记录哪些操作数被定义了。
-            auto defs = (*inst)->getDef();
-            for (auto &d : defs)
-                def[block].insert(all_uses[*d].begin(), all_uses[*d].end());
+            // use[block]：在块内定义之前就被使用的寄存器
+            for (auto &u : inst->getUse())
+            {
+                int idx = func->getLiveIndex(u);
+                if (idx >= 0 && !def[b].test(idx))
+                    use[b].set(idx);
+            }
+            for (auto &d : inst->getDef())
+            {
+                int idx = func->getLiveIndex(d);
+                if (idx < 0)
+                    continue;
+                if (inst->readsDefs() && !def[b].test(idx))
+                    use[b].set(idx);
+                def[b].set(idx);
+            }
         }
     }
 }
 
-// 通过迭代算法计算每个基本块的 LiveIn 和 LiveOut 集合，直到所有集合不再变化（即收敛）
+// 通过工作表算法计算每个基本块的 LiveIn 和 LiveOut 集合，直到所有集合不再变化（即收敛）
 void LiveVariableAnalysis::iterate(MachineFunction *func)
 {
-    // 遍历函数中的每个基本块，清空其 LiveIn 集合
-    for (auto &block : func->getBlocks())
-        block->getLiveIn().clear();
-    bool change;
-    change = true;
-    while (change) // 如果在一次完整的遍历中，任何一个基本块的 LiveIn 集合发生变化，继续迭代
+    int n = func->getNumLiveIndex();
+    for (auto &block : order)
     {
-        change = false;
-        for (auto &block : func->getBlocks())
+        block->getLiveIn().resize(n);
+        block->getLiveOut().resize(n);
+    }
+    // 后向问题：按逆后序的反方向处理，只有后继的 LiveIn 变化过的块才会被重新计算
+    BitVector pending(order.size());
+    for (size_t b = 0; b < order.size(); b++)
+        pending.set(b);
+    bool any = !order.empty();
+    while (any)
+    {
+        any = false;
+        for (int b = (int)order.size() - 1; b >= 0; b--)
         {
-            block->getLiveOut().clear();   // 清空 LiveOut
-            auto old = block->getLiveIn(); // 保存旧的 LiveIn
-
-            // 计算 LiveOut
-            for (auto &succ : block->getSuccs()) // 遍历所有后继基本块
-                                                 // 将后继基本块的 LiveIn 集合合并到当前基本块的 LiveOut 集合中
-                block->getLiveOut().insert(succ->getLiveIn().begin(), succ->getLiveIn().end());
-
-            // 计算 LiveIn
-            block->getLiveIn() = use[block]; // 初始化 LiveIn 为 use[block]
-            // 通过 set_difference，从 LiveOut 中减去 def[block]，并将结果加入到 LiveIn 中。
-            // 即：LiveIn = use[block] ∪ (LiveOut - def[block])
-            std::vector<MachineOperand *> temp;
-            set_difference(block->getLiveOut().begin(), block->getLiveOut().end(),
-                           def[block].begin(), def[block].end(), inserter(block->getLiveIn(), block->getLiveIn().end()));
-
-            if (old != block->getLiveIn())
-                change = true; // 如果 LiveIn 集合发生变化（old != block->getLiveIn()），设置 change = true，以继续迭代
+            if (!pending.test(b))
+                continue;
+            pending.reset(b);
+            auto block = order[b];
+            // LiveOut = ∪ LiveIn[succ]
+            for (auto &succ : block->getSuccs())
+                block->getLiveOut().unionWith(succ->getLiveIn());
+            // LiveIn = use[block] ∪ (LiveOut - def[block])
+            if (block->getLiveIn().assignTransfer(use[b], block->getLiveOut(), def[b]))
+            {
+                for (auto &pred : block->getPreds())
+                {
+                    int p = block_pos[pred];
+                    pending.set(p);
+                    if (p >= b)
+                        any = true; // 本轮已经扫过的位置需要再来一轮
+                }
+            }
         }
     }
 }
 
-// 计算每个操作数被使用的位置，填充 all_uses
+// 计算每个寄存器被使用的位置，填充 all_uses
 void LiveVariableAnalysis::computeUsePos(MachineFunction *func)
 {
+    all_uses.assign(func->getNumLiveIndex(), {});
     for (auto &block : func->getBlocks()) // 遍历函数中的每个基本块
     {
         for (auto &inst : block->getInsts()) // 遍历基本块中的每条指令
         {
-            auto uses = inst->getUse(); // 获取操作数的使用位置
-            for (auto &use : uses)
-                all_uses[*use].insert(use); // 将操作数 *use 的使用位置添加到集合中
+            for (auto &use : inst->getUse())
+            {
+                int idx = func->getLiveIndex(use);
+                if (idx >= 0)
+                    all_uses[idx].push_back(use); // 将 use 添加到对应寄存器的使用位置中
+            }
         }
     }
 }
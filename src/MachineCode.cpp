@@ -2,8 +2,22 @@
 #include <cstring>
 #include <iostream>
 #include "Instruction.h"
+#include "OutputStream.h"
 
-extern FILE *yyout;
+extern thread_local OutputStream *code_out;
+
+bool isLegalImm(int val)
+{
+    unsigned u = val;
+    for (int rot = 0; rot < 32; rot += 2)
+    {
+        // 循环左移 rot 位后落在低 8 位内，即原数是 8 位常数循环右移 rot 位
+        unsigned v = rot == 0 ? u : (u << rot) | (u >> (32 - rot));
+        if (v <= 0xff)
+            return true;
+    }
+    return false;
+}
 
 MachineOperand::MachineOperand(int tp, int val)
 {
@@ -46,28 +60,34 @@ bool MachineOperand::operator<(const MachineOperand &a) const
     return this->reg_no == a.reg_no;
 }
 
-void MachineOperand::PrintReg()
+// fp、sp、lr、pc 按别名输出，其余为 r编号
+static void printReg(int reg_no)
 {
     switch (reg_no)
     {
     case 11:
-        fprintf(yyout, "fp");
+        *code_out << "fp";
         break;
     case 13:
-        fprintf(yyout, "sp");
+        *code_out << "sp";
         break;
     case 14:
-        fprintf(yyout, "lr");
+        *code_out << "lr";
         break;
     case 15:
-        fprintf(yyout, "pc");
+        *code_out << "pc";
         break;
     default:
-        fprintf(yyout, "r%d", reg_no);
+        *code_out << 'r' << reg_no;
         break;
     }
 }
 
+void MachineOperand::PrintReg()
+{
+    printReg(reg_no);
+}
+
 void MachineOperand::output()
 {
     /* HINT：print operand
@@ -78,21 +98,21 @@ void MachineOperand::output()
     switch (this->type)
     {
     case IMM:
-        fprintf(yyout, "#%d", this->val);
+        *code_out << '#' << this->val;
         break;
     case VREG:
-        fprintf(yyout, "v%d", this->reg_no);
+        *code_out << 'v' << this->reg_no;
         break;
     case REG:
         PrintReg();
         break;
     case LABEL:
-        if (this->label.substr(0, 2) == ".L")
-            fprintf(yyout, "%s", this->label.c_str());
+        if (this->label.compare(0, 2, ".L") == 0)
+            *code_out << this->label;
         else if (!this->label.empty() && this->label[0] == '@')
-            fprintf(yyout, "addr_%s", this->label.c_str() + 1); // 去掉第一个字符 '@'
+            *code_out << "addr_" << this->label.c_str() + 1; // 去掉第一个字符 '@'
         else
-            fprintf(yyout, "addr_%s", this->label.c_str());
+            *code_out << "addr_" << this->label;
     default:
         break;
     }
@@ -104,22 +124,22 @@ void MachineInstruction::PrintCond() // 打印指令执行条件
     switch (cond)
     {
     case EQ:
-        fprintf(yyout, "eq");
+        *code_out << "eq";
         break;
     case NE:
-        fprintf(yyout, "ne");
+        *code_out << "ne";
         break;
     case LT:
-        fprintf(yyout, "lt");
+        *code_out << "lt";
         break;
     case LE:
-        fprintf(yyout, "le");
+        *code_out << "le";
         break;
     case GT:
-        fprintf(yyout, "gt");
+        *code_out << "gt";
         break;
     case GE:
-        fprintf(yyout, "ge");
+        *code_out << "ge";
         break;
     default:
         break;
@@ -150,36 +170,57 @@ void BinaryMInstruction::output()
     switch (this->op)
     {
     case BinaryMInstruction::ADD:
-        fprintf(yyout, "\tadd ");
+        code_out->printf("\tadd");
         break;
     case BinaryMInstruction::SUB:
-        fprintf(yyout, "\tsub ");
+        code_out->printf("\tsub");
         break;
     case BinaryMInstruction::AND:
-        fprintf(yyout, "\tand ");
+        code_out->printf("\tand");
         break;
     case BinaryMInstruction::OR:
-        fprintf(yyout, "\torr ");
+        code_out->printf("\torr");
         break;
     case BinaryMInstruction::MUL:
-        fprintf(yyout, "\tmul ");
+        code_out->printf("\tmul");
         break;
     case BinaryMInstruction::DIV:
-        fprintf(yyout, "\tsdiv ");
+        code_out->printf("\tsdiv");
         break;
     case BinaryMInstruction::XOR:
-        fprintf(yyout, "\teor ");
+        code_out->printf("\teor");
+        break;
+    case BinaryMInstruction::RSB:
+        code_out->printf("\trsb");
+        break;
+    case BinaryMInstruction::LSL:
+        code_out->printf("\tlsl");
+        break;
+    case BinaryMInstruction::LSR:
+        code_out->printf("\tlsr");
+        break;
+    case BinaryMInstruction::ASR:
+        code_out->printf("\tasr");
+        break;
+    case BinaryMInstruction::SMMUL:
+        code_out->printf("\tsmmul");
         break;
     default:
         break;
     }
+    if (updateFlags)
+        *code_out << 's';
     this->PrintCond();
+    *code_out << ' ';
     this->def_list[0]->output();
-    fprintf(yyout, ", ");
+    code_out->printf(", ");
     this->use_list[0]->output();
-    fprintf(yyout, ", ");
+    code_out->printf(", ");
     this->use_list[1]->output();
-    fprintf(yyout, "\n");
+    static const char *shiftNames[] = {"lsl", "lsr", "asr"};
+    if (shiftOp != -1)
+        code_out->printf(", %s #%d", shiftNames[shiftOp - LSL], shiftAmount);
+    code_out->printf("\n");
 }
 
 LoadMInstruction::LoadMInstruction(MachineBlock *p,
@@ -202,31 +243,31 @@ LoadMInstruction::LoadMInstruction(MachineBlock *p,
 
 void LoadMInstruction::output()
 {
-    fprintf(yyout, "\tldr ");
+    code_out->printf("\tldr ");
     this->def_list[0]->output();
-    fprintf(yyout, ", ");
+    code_out->printf(", ");
 
     // Load immediate num, eg: ldr r1, =8
     if (this->use_list[0]->isImm())
     {
-        fprintf(yyout, "=%d\n", this->use_list[0]->getVal());
+        code_out->printf("=%d\n", this->use_list[0]->getVal());
         return;
     }
 
     // Load address
     if (this->use_list[0]->isReg() || this->use_list[0]->isVReg())
-        fprintf(yyout, "[");
+        code_out->printf("[");
 
     this->use_list[0]->output();
     if (this->use_list.size() > 1)
     {
-        fprintf(yyout, ", ");
+        code_out->printf(", ");
         this->use_list[1]->output();
     }
 
     if (this->use_list[0]->isReg() || this->use_list[0]->isVReg())
-        fprintf(yyout, "]");
-    fprintf(yyout, "\n");
+        code_out->printf("]");
+    code_out->printf("\n");
 }
 
 StoreMInstruction::StoreMInstruction(MachineBlock *p,
@@ -249,21 +290,56 @@ StoreMInstruction::StoreMInstruction(MachineBlock *p,
 
 void StoreMInstruction::output()
 {
-    fprintf(yyout, "\tstr ");    // 输出存储指令 "str"
+    code_out->printf("\tstr ");    // 输出存储指令 "str"
     this->use_list[0]->output(); // 输出存储的数据
-    fprintf(yyout, ", ");        // 添加逗号分隔符
+    code_out->printf(", ");        // 添加逗号分隔符
     // 输出存储地址
     if (this->use_list[1]->isReg() || this->use_list[1]->isVReg())
-        fprintf(yyout, "[");
+        code_out->printf("[");
     this->use_list[1]->output(); // 输出基地址
     if (this->use_list.size() > 2)
     { // 如果有偏移量
-        fprintf(yyout, ", ");
+        code_out->printf(", ");
         this->use_list[2]->output(); // 输出偏移量
     }
     if (this->use_list[1]->isReg() || this->use_list[1]->isVReg())
-        fprintf(yyout, "]");
-    fprintf(yyout, "\n");
+        code_out->printf("]");
+    code_out->printf("\n");
+}
+
+bool MachineInstruction::isCopy() const
+{
+    if (type != MOV || op != MovMInstruction::MOV || cond != NONE)
+        return false;
+    auto dst = def_list[0], src = use_list[0];
+    return (dst->isReg() || dst->isVReg()) && (src->isReg() || src->isVReg());
+}
+
+bool MachineInstruction::isCall() const
+{
+    return type == BRANCH && op == BranchMInstruction::BL;
+}
+
+bool MachineInstruction::isUncondBranch() const
+{
+    return type == BRANCH && op == BranchMInstruction::B && cond == NONE;
+}
+
+bool MachineInstruction::readsDefs() const
+{
+    if (def_list.empty())
+        return false;
+    return cond != NONE || (type == MOV && op == MovMInstruction::MOVT);
+}
+
+bool MachineInstruction::readsOwnDef(MachineOperand *use)
+{
+    if (!readsDefs())
+        return false;
+    for (auto def : def_list)
+        if (*def == *use)
+            return true;
+    return false;
 }
 
 MovMInstruction::MovMInstruction(MachineBlock *p, int op,
@@ -280,18 +356,36 @@ MovMInstruction::MovMInstruction(MachineBlock *p, int op,
     // 设置两个操作数的parent，以便操作数能够跟踪到其所属的指令
     dst->setParent(this);
     src->setParent(this);
+    if (op == MOVT)
+        addImplicitUse(new MachineOperand(*dst));
 }
 
 void MovMInstruction::output()
 {
-    fprintf(yyout, "\tmov");
+    switch (op)
+    {
+    case MVN:
+        code_out->printf("\tmvn");
+        break;
+    case MOVW:
+        code_out->printf("\tmovw");
+        break;
+    case MOVT:
+        code_out->printf("\tmovt");
+        break;
+    default:
+        code_out->printf("\tmov");
+        break;
+    }
+    if (updateFlags)
+        *code_out << 's';
     PrintCond(); // 打印条件码
-    fprintf(yyout, " ");
+    code_out->printf(" ");
     // cout << def_list[0]->getLabel() << endl;
     this->def_list[0]->output();
-    fprintf(yyout, ", ");
+    code_out->printf(", ");
     this->use_list[0]->output();
-    fprintf(yyout, "\n");
+    code_out->printf("\n");
 }
 
 BranchMInstruction::BranchMInstruction(MachineBlock *p, int op,
@@ -312,37 +406,34 @@ void BranchMInstruction::output()
     // 这里把BL单独处理，解决库函数调用的前缀addr_问题
     if (op == BL)
     {
-        fprintf(yyout, "\tbl ");
+        code_out->printf("\tbl ");
         if (!this->use_list[0]->getLabel().empty() && this->use_list[0]->getLabel()[0] == '@')
         {
-            fprintf(yyout, "%s", this->use_list[0]->getLabel().c_str() + 1);
+            code_out->printf("%s", this->use_list[0]->getLabel().c_str() + 1);
         }
-        fprintf(yyout, "\n");
+        code_out->printf("\n");
     }
     else
     {
         switch (op)
         {
         case B:
-            fprintf(yyout, "\tb");
+            code_out->printf("\tb");
             break;
         case BX:
         {
             // 输出一个 POP 指令来恢复帧指针（fp）和链接寄存器（lr）
-            auto fp = new MachineOperand(MachineOperand::REG, 11);
-            auto lr = new MachineOperand(MachineOperand::REG, 14);
-            auto cur_inst = new StackMInstrcuton(this->getParent(), StackMInstrcuton::POP, this->getParent()->getParent()->getSavedRegs(), fp, lr);
-            cur_inst->output();
-            fprintf(yyout, "\tbx"); // 跳转到链接寄存器（lr）中存储的地址，即函数的调用地址
+            this->getParent()->getParent()->printSavedRegs("pop");
+            code_out->printf("\tbx"); // 跳转到链接寄存器（lr）中存储的地址，即函数的调用地址
             break;
         }
         default:
             break;
         }
         PrintCond();
-        fprintf(yyout, " ");
+        code_out->printf(" ");
         this->use_list[0]->output();
-        fprintf(yyout, "\n");
+        code_out->printf("\n");
     }
 }
 
@@ -366,11 +457,11 @@ void CmpMInstruction::output()
     // TODO
     // Jsut for reg alloca test
     // delete it after test
-    fprintf(yyout, "\tcmp ");
+    code_out->printf("\tcmp ");
     this->use_list[0]->output();
-    fprintf(yyout, ", ");
+    code_out->printf(", ");
     this->use_list[1]->output();
-    fprintf(yyout, "\n");
+    code_out->printf("\n");
 }
 
 StackMInstrcuton::StackMInstrcuton(MachineBlock *p, int op, std::vector<MachineOperand *> srcs, MachineOperand *src, MachineOperand *src1, int cond)
@@ -405,20 +496,20 @@ void StackMInstrcuton::output()
     switch (op)
     {
     case PUSH:
-        fprintf(yyout, "\tpush ");
+        code_out->printf("\tpush ");
         break;
     case POP:
-        fprintf(yyout, "\tpop ");
+        code_out->printf("\tpop ");
         break;
     }
-    fprintf(yyout, "{");
+    code_out->printf("{");
     this->use_list[0]->output();
     for (long unsigned int i = 1; i < use_list.size(); i++)
     {
-        fprintf(yyout, ", ");
+        code_out->printf(", ");
         this->use_list[i]->output();
     }
-    fprintf(yyout, "}\n");
+    code_out->printf("}\n");
 }
 
 MachineFunction::MachineFunction(MachineUnit *p, SymbolEntry *sym_ptr)
@@ -426,24 +517,72 @@ MachineFunction::MachineFunction(MachineUnit *p, SymbolEntry *sym_ptr)
     this->parent = p;
     this->sym_ptr = sym_ptr;
     this->stack_size = 0;
+    this->alloc_rounds = 0;
+    this->spilled_vregs = 0;
+    this->next_vreg = 0;
+    this->domTree = nullptr;
+    this->loopInfo = nullptr;
 };
 
+DominatorTree<MachineBlock> &MachineFunction::getDomTree()
+{
+    if (domTree == nullptr)
+        domTree = new DominatorTree<MachineBlock>(block_list[0]);
+    return *domTree;
+}
+
+LoopInfo<MachineBlock> &MachineFunction::getLoopInfo()
+{
+    if (loopInfo == nullptr)
+        loopInfo = new LoopInfo<MachineBlock>(getDomTree());
+    return *loopInfo;
+}
+
+void MachineFunction::invalidateAnalyses()
+{
+    delete loopInfo;
+    delete domTree;
+    loopInfo = nullptr;
+    domTree = nullptr;
+}
+
+std::vector<MachineInstruction *>::iterator MachineBlock::insertLoadImm(std::vector<MachineInstruction *>::iterator pos,
+                                                                        MachineOperand *dst, int val)
+{
+    std::vector<MachineInstruction *> insts;
+    if (isLegalImm(val))
+        insts.push_back(new MovMInstruction(this, MovMInstruction::MOV, dst, new MachineOperand(MachineOperand::IMM, val)));
+    else if (isLegalImm(~val))
+        insts.push_back(new MovMInstruction(this, MovMInstruction::MVN, dst, new MachineOperand(MachineOperand::IMM, ~val)));
+    else
+    {
+        unsigned u = val;
+        insts.push_back(new MovMInstruction(this, MovMInstruction::MOVW, dst, new MachineOperand(MachineOperand::IMM, u & 0xffff)));
+        if (u >> 16)
+            insts.push_back(new MovMInstruction(this, MovMInstruction::MOVT, new MachineOperand(*dst), new MachineOperand(MachineOperand::IMM, u >> 16)));
+    }
+    pos = inst_list.insert(pos, insts.begin(), insts.end());
+    return pos + insts.size();
+}
+
 void MachineBlock::output() // 输出该基本块的所有指令
 {
-    fprintf(yyout, ".L%d:\n", this->no);
+    code_out->printf(".L%d:\n", this->no);
     for (auto iter : inst_list)
         iter->output();
 }
 
 void MachineFunction::output()
 {
-    // std::cout<<"111";
-    // 分配足够的内存来存储函数名
-    char *func_name = new char[strlen(this->sym_ptr->toStr().c_str()) + 1]; // 加1是为了存放'\0'
-    strcpy(func_name, this->sym_ptr->toStr().c_str() + 1);                  // 将函数名从符号表条目中复制到新分配的内存中，并且跳过了第一个字符@
-    fprintf(yyout, "\t.global %s\n", func_name);
-    fprintf(yyout, "\t.type %s , %%function\n", func_name);
-    fprintf(yyout, "%s:\n", func_name); // 输出函数的标签，表示函数的开始位置
+    if (isCached())
+    {
+        *code_out << cached_asm;
+        return;
+    }
+    const std::string &func_name = this->sym_ptr->getName();
+    *code_out << "\t.global " << func_name << '\n';
+    *code_out << "\t.type " << func_name << " , %function\n";
+    *code_out << func_name << ":\n"; // 输出函数的标签，表示函数的开始位置
     // TODO 生成函数前导代码
     /* Hint:
      *  1. Save fp  保存帧指针（fp）
@@ -453,23 +592,34 @@ void MachineFunction::output()
 
     // Traverse all the block in block_list to print assembly code.
 
-    MachineOperand *fp = new MachineOperand(MachineOperand::REG, 11);
-    MachineOperand *sp = new MachineOperand(MachineOperand::REG, 13);
-    MachineOperand *lr = new MachineOperand(MachineOperand::REG, 14);
-    MachineInstruction *cur_inst;
-
-    cur_inst = new StackMInstrcuton(nullptr, StackMInstrcuton::PUSH, this->getSavedRegs(), fp, lr);
-    cur_inst->output();
-
-    cur_inst = new MovMInstruction(nullptr, MovMInstruction::MOV, fp, sp);
-    cur_inst->output();
+    printSavedRegs("push");
+    *code_out << "\tmov fp, sp\n";
+    int frame = AllocSpace(0);
+    if (isLegalImm(frame))
+        *code_out << "\tsub sp, sp, #" << frame << '\n';
+    else
+    {
+        // 栈帧大小不能直接编码时借用 r12，它在函数入口处不保存任何值
+        *code_out << "\tmovw r12, #" << (frame & 0xffff) << '\n';
+        if (frame >> 16)
+            *code_out << "\tmovt r12, #" << (frame >> 16) << '\n';
+        *code_out << "\tsub sp, sp, r12\n";
+    }
 
-    cur_inst = new BinaryMInstruction(nullptr, BinaryMInstruction::SUB, sp, sp, new MachineOperand(MachineOperand::IMM, AllocSpace(0)));
-    cur_inst->output();
+    for (auto block : block_list)
+        block->output();
+    code_out->printf("\n");
+}
 
-    for (auto iter : block_list)
-        iter->output();
-    fprintf(yyout, "\n");
+void MachineFunction::printSavedRegs(const char *op)
+{
+    *code_out << '\t' << op << " {";
+    for (auto i : saved_regs)
+    {
+        printReg(i);
+        *code_out << ", ";
+    }
+    *code_out << "fp, lr}\n";
 }
 
 std::vector<MachineOperand *> MachineFunction::getSavedRegs() // 返回保存的寄存器操作数列表，用于在函数调用前后保存和恢复寄存器状态
@@ -488,7 +638,7 @@ void MachineUnit::PrintGlobalDecl()
     // 判断是否有全局变量或常量
     if (!global_list.empty())
     {
-        fprintf(yyout, "\t.data\n");
+        code_out->printf("\t.data\n");
     }
     std::vector<IdentifierSymbolEntry *> Global_list;
 
@@ -496,15 +646,8 @@ void MachineUnit::PrintGlobalDecl()
     {
         // cout<<"a";
         IdentifierSymbolEntry *se = (IdentifierSymbolEntry *)global;
-        // 获取变量名并去除开头的 '@'（如果存在）
-        std::string varName = se->toStr();
-        if (!varName.empty() && varName[0] == '@')
-        {
-            // cout << "@@@@" << endl;
-            // cout << "1" << varName << endl;
-            varName = varName.substr(1);
-            // cout << "2" << varName << endl;
-        }
+        // 变量名，不含 IR 中开头的 '@'
+        const std::string &varName = se->getName();
         // 如果是常量，将其加入 Global_list
         if (se->isConstant())
         {
@@ -513,38 +656,31 @@ void MachineUnit::PrintGlobalDecl()
         else
         {
             // 输出普通全局变量的信息
-            fprintf(yyout, ".global %s\n", varName.c_str());
-            fprintf(yyout, "\t.size %s, %d\n", varName.c_str(), se->getType()->getSize() / 8);
-            fprintf(yyout, "%s:\n", varName.c_str());
+            code_out->printf(".global %s\n", varName.c_str());
+            code_out->printf("\t.size %s, %d\n", varName.c_str(), se->getType()->getSize() / 8);
+            code_out->printf("%s:\n", varName.c_str());
 
             // 输出变量值
-            fprintf(yyout, "\t.word %d\n", se->getValue());
+            code_out->printf("\t.word %d\n", se->getValue());
         }
     }
 
     // 如果有常量，进入只读数据段
     if (!Global_list.empty())
     {
-        fprintf(yyout, ".section .rodata\n");
+        code_out->printf(".section .rodata\n");
 
         for (auto con : Global_list)
         {
             IdentifierSymbolEntry *se = con;
-            // 获取变量名并去除开头的 '@'（如果存在）
-            std::string varName = se->toStr();
-            if (!varName.empty() && varName[0] == '@')
-            {
-                // cout << "@@@@" << endl;
-                // cout << "1" << varName << endl;
-                varName = varName.substr(1);
-                // cout << "2" << varName << endl;
-            }
-            fprintf(yyout, ".global %s\n", varName.c_str());
-            fprintf(yyout, "\t.size %s, %d\n", varName.c_str(), se->getType()->getSize() / 8);
-            fprintf(yyout, "%s:\n", varName.c_str());
+            // 变量名，不含 IR 中开头的 '@'
+            const std::string &varName = se->getName();
+            code_out->printf(".global %s\n", varName.c_str());
+            code_out->printf("\t.size %s, %d\n", varName.c_str(), se->getType()->getSize() / 8);
+            code_out->printf("%s:\n", varName.c_str());
 
             // 输出常量值
-            fprintf(yyout, "\t.word %d\n", se->getValue());
+            code_out->printf("\t.word %d\n", se->getValue());
         }
     }
 }
@@ -554,27 +690,57 @@ void MachineUnit::PrintGlobal()
     for (auto s : global_list)
     {
         IdentifierSymbolEntry *se = (IdentifierSymbolEntry *)s;
-        // 获取变量名并去除开头的 '@'（如果存在）
-        std::string varName = se->toStr();
-        if (!varName.empty() && varName[0] == '@')
-        {
-            // cout << "@@@@" << endl;
-            // cout << "1" << varName << endl;
-            varName = varName.substr(1);
-            // cout << "2" << varName << endl;
-        }
-        fprintf(yyout, "addr_%s:\n", varName.c_str());
-        fprintf(yyout, "\t.word %s\n", varName.c_str());
+        // 变量名，不含 IR 中开头的 '@'
+        const std::string &varName = se->getName();
+        code_out->printf("addr_%s:\n", varName.c_str());
+        code_out->printf("\t.word %s\n", varName.c_str());
     }
 }
 void MachineUnit::output()
 {
-    fprintf(yyout, "\t.arch armv8-a\n");
-    fprintf(yyout, "\t.arch_extension crc\n");
-    fprintf(yyout, "\t.arm\n");
+    code_out->printf("\t.arch armv8-a\n");
+    code_out->printf("\t.arch_extension crc\n");
+    code_out->printf("\t.arm\n");
     PrintGlobalDecl();
-    fprintf(yyout, "\t.text\n");
+    code_out->printf("\t.text\n");
     for (auto iter : func_list)
         iter->output();
     PrintGlobal();
 }
+
+int MachineFunction::numberVRegs()
+{
+    vreg_index.clear();
+    vregs.clear();
+    for (auto &block : block_list)
+        for (auto &inst : block->getInsts())
+        {
+            for (auto &def : inst->getDef())
+                if (def->isVReg() && vreg_index.emplace(def->getReg(), NUM_PHYS_REGS + vregs.size()).second)
+                    vregs.push_back(def->getReg());
+            for (auto &use : inst->getUse())
+                if (use->isVReg() && vreg_index.emplace(use->getReg(), NUM_PHYS_REGS + vregs.size()).second)
+                    vregs.push_back(use->getReg());
+        }
+    return getNumLiveIndex();
+}
+
+int MachineFunction::getLiveIndex(MachineOperand *ope)
+{
+    if (ope->isReg())
+        return ope->getReg();
+    if (ope->isVReg())
+    {
+        auto it = vreg_index.find(ope->getReg());
+        return it == vreg_index.end() ? -1 : it->second;
+    }
+    return -1;
+}
+
+void MachineUnit::printAllocStats(FILE *out)
+{
+    fprintf(out, "register allocation:\n");
+    fprintf(out, "  %-20s %8s %8s\n", "function", "rounds", "spilled");
+    for (auto &func : func_list)
+        fprintf(out, "  %-20s %8d %8d\n", func->getSymPtr()->toStr().c_str() + 1, func->getAllocRounds(), func->getSpilledVRegs());
+}
@@ -0,0 +1,245 @@
+#include "MachinePeephole.h"
+#include "MachineCode.h"
+#include "ThreadPool.h"
+#include <unordered_map>
+#include <utility>
+
+static const char *patternNames[MachinePeephole::NUM_PATTERNS] = {"store-to-load", "redundant-move", "fallthrough", "cmp-zero"};
+
+MachinePeephole::MachinePeephole(MachineUnit *unit) : unit(unit)
+{
+    for (auto &h : hits)
+        h = 0;
+}
+
+void MachinePeephole::pass(ThreadPool *pool)
+{
+    auto &funcs = unit->getFuncs();
+    parallelFor(pool, funcs.size(), [&](size_t i)
+                { runOnFunction(funcs[i]); });
+}
+
+void MachinePeephole::runOnFunction(MachineFunction *func)
+{
+    if (func->isCached())
+        return;
+    auto &blocks = func->getBlocks();
+    int count[NUM_PATTERNS] = {};
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        count[STORE_TO_LOAD] += forwardStores(blocks[i]);
+        count[REDUNDANT_MOVE] += removeRedundantMoves(blocks[i]);
+        count[CMP_ZERO] += foldCmpZero(blocks[i]);
+        count[FALLTHROUGH] += removeFallthrough(blocks[i], i + 1 < blocks.size() ? blocks[i + 1] : nullptr);
+    }
+    for (int k = 0; k < NUM_PATTERNS; k++)
+        hits[k] += count[k];
+}
+
+void MachinePeephole::printStats(FILE *out) const
+{
+    fprintf(out, "machine peephole:\n");
+    for (int k = 0; k < NUM_PATTERNS; k++)
+        fprintf(out, "  %-20s %8d\n", patternNames[k], hits[k].load());
+}
+
+// 以 fp 为基址、立即数为偏移的 ldr/str 访问的栈槽
+static bool frameSlot(MachineInstruction *inst, int &off)
+{
+    auto &uses = inst->getUse();
+    size_t base = inst->isStore() ? 1 : 0;
+    if (uses.size() != base + 2 || !uses[base]->isReg() || uses[base]->getReg() != 11 || !uses[base + 1]->isImm())
+        return false;
+    off = uses[base + 1]->getVal();
+    return true;
+}
+
+int MachinePeephole::forwardStores(MachineBlock *block)
+{
+    int count = 0;
+    std::unordered_map<int, int> slots; // 栈槽偏移 -> 仍保存着该槽内容的寄存器
+    auto &insts = block->getInsts();
+    for (size_t i = 0; i < insts.size(); i++)
+    {
+        auto inst = insts[i];
+        int off;
+        if (inst->isLoad() && frameSlot(inst, off))
+        {
+            auto it = slots.find(off);
+            if (it != slots.end())
+            {
+                int reg = inst->getDef()[0]->getReg();
+                count++;
+                if (reg == it->second)
+                {
+                    insts.erase(insts.begin() + i--);
+                    continue;
+                }
+                inst = insts[i] = new MovMInstruction(block, MovMInstruction::MOV, new MachineOperand(MachineOperand::REG, reg),
+                                                      new MachineOperand(MachineOperand::REG, it->second));
+            }
+        }
+        // 寄存器被改写后不再代表原来的栈槽，fp 被改写则全部作废
+        for (auto def : inst->getDef())
+        {
+            if (def->getReg() == 11)
+                slots.clear();
+            for (auto it = slots.begin(); it != slots.end();)
+                it = it->second == def->getReg() ? slots.erase(it) : std::next(it);
+        }
+        if (inst->isCall())
+            slots.clear();
+        else if (inst->isStore())
+        {
+            // 通过其他地址的写入可能落在任何栈槽上
+            if (frameSlot(inst, off))
+                slots[off] = inst->getUse()[0]->getReg();
+            else
+                slots.clear();
+        }
+        else if (inst->isLoad() && frameSlot(inst, off))
+            slots[off] = inst->getDef()[0]->getReg();
+    }
+    return count;
+}
+
+int MachinePeephole::removeRedundantMoves(MachineBlock *block)
+{
+    int count = 0;
+    std::vector<std::pair<int, int>> copies; // 此前的 mov 使之值相同、之后都未被改写的寄存器对
+    auto &insts = block->getInsts();
+    for (size_t i = 0; i < insts.size(); i++)
+    {
+        auto inst = insts[i];
+        bool copy = inst->isCopy();
+        int dst = 0, src = 0;
+        if (copy)
+        {
+            dst = inst->getDef()[0]->getReg();
+            src = inst->getUse()[0]->getReg();
+            bool redundant = dst == src;
+            for (auto &p : copies)
+                if ((p.first == dst && p.second == src) || (p.first == src && p.second == dst))
+                    redundant = true;
+            if (redundant)
+            {
+                count++;
+                insts.erase(insts.begin() + i--);
+                continue;
+            }
+        }
+        for (auto def : inst->getDef())
+            for (size_t j = 0; j < copies.size();)
+                if (copies[j].first == def->getReg() || copies[j].second == def->getReg())
+                    copies.erase(copies.begin() + j);
+                else
+                    j++;
+        if (copy)
+            copies.push_back({dst, src});
+    }
+    return count;
+}
+
+// label 是否为 ".L<no>"
+static bool isBlockLabel(const std::string &label, int no)
+{
+    char buf[16];
+    int n = snprintf(buf, sizeof(buf), ".L%d", no);
+    return label.size() == (size_t)n && label.compare(0, n, buf) == 0;
+}
+
+static int negateCond(int cond)
+{
+    switch (cond)
+    {
+    case MachineInstruction::EQ:
+        return MachineInstruction::NE;
+    case MachineInstruction::NE:
+        return MachineInstruction::EQ;
+    case MachineInstruction::LT:
+        return MachineInstruction::GE;
+    case MachineInstruction::LE:
+        return MachineInstruction::GT;
+    case MachineInstruction::GT:
+        return MachineInstruction::LE;
+    case MachineInstruction::GE:
+        return MachineInstruction::LT;
+    }
+    return cond;
+}
+
+int MachinePeephole::removeFallthrough(MachineBlock *block, MachineBlock *next)
+{
+    auto &insts = block->getInsts();
+    if (next == nullptr || insts.empty() || !insts.back()->isUncondBranch())
+        return 0;
+    auto last = insts.back();
+    if (isBlockLabel(last->getUse()[0]->getLabel(), next->getNo()))
+    {
+        insts.pop_back();
+        return 1;
+    }
+    if (insts.size() < 2)
+        return 0;
+    // b<cond> 下一块; b L  =>  b<!cond> L
+    auto prev = insts[insts.size() - 2];
+    if (!prev->isBranch() || prev->getOp() != BranchMInstruction::B || prev->getCond() == MachineInstruction::NONE ||
+        !isBlockLabel(prev->getUse()[0]->getLabel(), next->getNo()))
+        return 0;
+    insts.pop_back();
+    insts.back() = new BranchMInstruction(block, BranchMInstruction::B, new MachineOperand(last->getUse()[0]->getLabel()),
+                                          negateCond(prev->getCond()));
+    return 1;
+}
+
+// 加上 s 后缀后按结果设置 N、Z 的指令
+static bool canUpdateFlags(MachineInstruction *inst)
+{
+    if (inst->getCond() != MachineInstruction::NONE || inst->getUpdateFlags() || inst->getDef().size() != 1)
+        return false;
+    if (inst->isMov())
+        return inst->getOp() == MovMInstruction::MOV || inst->getOp() == MovMInstruction::MVN;
+    if (!inst->isBinary())
+        return false;
+    switch (inst->getOp())
+    {
+    case BinaryMInstruction::ADD:
+    case BinaryMInstruction::SUB:
+    case BinaryMInstruction::RSB:
+    case BinaryMInstruction::AND:
+    case BinaryMInstruction::OR:
+    case BinaryMInstruction::XOR:
+    case BinaryMInstruction::LSL:
+    case BinaryMInstruction::LSR:
+    case BinaryMInstruction::ASR:
+    case BinaryMInstruction::MUL:
+        return true;
+    }
+    return false;
+}
+
+int MachinePeephole::foldCmpZero(MachineBlock *block)
+{
+    int count = 0;
+    auto &insts = block->getInsts();
+    for (size_t i = 1; i < insts.size(); i++)
+    {
+        auto cmp = insts[i], def = insts[i - 1];
+        auto &uses = cmp->getUse();
+        if (!cmp->isCmp() || !uses[1]->isImm() || uses[1]->getVal() != 0 || !canUpdateFlags(def) ||
+            def->getDef()[0]->getReg() != uses[0]->getReg())
+            continue;
+        // s 后缀不设置 cmp 那样的 C、V，读这组标志位的条件只能是 eq、ne
+        bool onlyZero = true;
+        for (size_t j = i + 1; j < insts.size() && !insts[j]->isCmp() && !insts[j]->isCall() && !insts[j]->getUpdateFlags(); j++)
+            if (insts[j]->getCond() != MachineInstruction::NONE && insts[j]->getCond() != MachineInstruction::EQ &&
+                insts[j]->getCond() != MachineInstruction::NE)
+                onlyZero = false;
+        if (!onlyZero)
+            continue;
+        def->setUpdateFlags();
+        insts.erase(insts.begin() + i--);
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,230 @@
+#include "Mem2Reg.h"
+#include "Type.h"
+#include <algorithm>
+
+bool Mem2Reg::runOnFunction(Function *func)
+{
+    removeUnreachableBlocks(func);
+    insertPhis(func);
+    rename(func);
+    removeDeadPhis();
+    return !allocas.empty();
+}
+
+// 不可达块没有支配者，先删掉；块的析构函数会一并删除其中的指令和 CFG 边
+void Mem2Reg::removeUnreachableBlocks(Function *func)
+{
+    auto &dt = func->getDomTree();
+    std::vector<BasicBlock *> dead;
+    for (auto &bb : func->getBlockList())
+        if (!dt.isReachable(bb))
+            dead.push_back(bb);
+    for (auto &bb : dead)
+        delete bb;
+    if (!dead.empty())
+        func->invalidateAnalyses();
+}
+
+// 标量 alloca 只作为 load 的地址或 store 的目的地址出现时才能提升
+bool Mem2Reg::isPromotable(Instruction *alloca)
+{
+    Type *type = ((PointerType *)alloca->getDef()->getType())->getValueType();
+    if (!type->calculatable())
+        return false;
+    Operand *addr = alloca->getDef();
+    for (auto use = addr->use_begin(); use != addr->use_end(); use++)
+    {
+        Instruction *user = *use;
+        if (user->isLoad())
+            continue;
+        if (user->isStore() && user->getOperands()[0].get() == addr && user->getOperands()[1].get() != addr)
+            continue;
+        return false;
+    }
+    return true;
+}
+
+void Mem2Reg::insertPhis(Function *func)
+{
+    allocas.clear();
+    allocaIdx.clear();
+    phi2alloca.clear();
+    BasicBlock *entry = func->getEntry();
+    for (auto inst = entry->begin(); inst != entry->end(); inst = inst->getNext())
+        if (inst->isAlloca() && isPromotable(inst))
+        {
+            allocaIdx[inst->getDef()] = allocas.size();
+            allocas.push_back(inst);
+        }
+
+    auto &dt = func->getDomTree();
+    std::unordered_map<BasicBlock *, int> hasPhi, inWork;
+    std::vector<BasicBlock *> worklist;
+    for (int k = 0; k < (int)allocas.size(); k++)
+    {
+        Operand *addr = allocas[k]->getDef();
+        worklist.clear();
+        for (auto use = addr->use_begin(); use != addr->use_end(); use++)
+        {
+            if (!(*use)->isStore())
+                continue;
+            BasicBlock *b = (*use)->getParent();
+            if (!inWork.count(b) || inWork[b] != k)
+            {
+                inWork[b] = k;
+                worklist.push_back(b);
+            }
+        }
+        Type *type = ((PointerType *)addr->getType())->getValueType();
+        while (!worklist.empty())
+        {
+            BasicBlock *b = worklist.back();
+            worklist.pop_back();
+            for (auto d : dt.getFrontier(b))
+            {
+                if (hasPhi.count(d) && hasPhi[d] == k)
+                    continue;
+                hasPhi[d] = k;
+                Operand *dst = new Operand(new TemporarySymbolEntry(type, SymbolTable::getLabel()));
+                auto phi = new PhiInstruction(dst);
+                d->insertFront(phi);
+                phi2alloca[phi] = k;
+                if (!inWork.count(d) || inWork[d] != k)
+                {
+                    inWork[d] = k;
+                    worklist.push_back(d);
+                }
+            }
+        }
+    }
+}
+
+// 沿支配树先序遍历，values[k] 为第 k 个 alloca 的当前值栈
+void Mem2Reg::rename(Function *func)
+{
+    if (allocas.empty())
+        return;
+    int m = allocas.size();
+    std::vector<std::vector<Operand *>> values(m);
+    std::vector<Operand *> undef(m, nullptr);
+    std::vector<int> log; // 压栈记录，回溯时据此弹栈
+    auto current = [&](int k) {
+        if (!values[k].empty())
+            return values[k].back();
+        if (undef[k] == nullptr) // 未初始化的读取取 0
+        {
+            Type *type = ((PointerType *)allocas[k]->getDef()->getType())->getValueType();
+            undef[k] = new Operand(new ConstantSymbolEntry(type, 0));
+        }
+        return undef[k];
+    };
+
+    auto &dt = func->getDomTree();
+    std::vector<std::pair<BasicBlock *, size_t>> stack; // (块, 已访问的子结点数)
+    std::vector<size_t> mark;
+    stack.push_back({dt.getRoot(), 0});
+    mark.push_back(0);
+    bool enter = true;
+    while (!stack.empty())
+    {
+        auto &top = stack.back();
+        BasicBlock *bb = top.first;
+        if (enter)
+        {
+            for (auto inst = bb->begin(), next = inst; inst != bb->end(); inst = next)
+            {
+                next = inst->getNext();
+                if (inst->isPhi())
+                {
+                    auto it = phi2alloca.find(inst);
+                    if (it != phi2alloca.end())
+                    {
+                        values[it->second].push_back(inst->getDef());
+                        log.push_back(it->second);
+                    }
+                }
+                else if (inst->isLoad())
+                {
+                    auto it = allocaIdx.find(inst->getOperands()[1].get());
+                    if (it == allocaIdx.end())
+                        continue;
+                    inst->getDef()->replaceAllUsesWith(current(it->second));
+                    delete inst;
+                }
+                else if (inst->isStore())
+                {
+                    auto it = allocaIdx.find(inst->getOperands()[0].get());
+                    if (it == allocaIdx.end())
+                        continue;
+                    values[it->second].push_back(inst->getOperands()[1].get());
+                    log.push_back(it->second);
+                    delete inst;
+                }
+            }
+            for (auto succ = bb->succ_begin(); succ != bb->succ_end(); succ++)
+                for (auto inst = (*succ)->begin(); inst != (*succ)->end() && inst->isPhi(); inst = inst->getNext())
+                {
+                    auto it = phi2alloca.find(inst);
+                    if (it != phi2alloca.end())
+                        ((PhiInstruction *)inst)->addIncoming(current(it->second), bb);
+                }
+        }
+        auto &children = dt.getChildren(bb);
+        if (top.second < children.size())
+        {
+            BasicBlock *child = children[top.second++];
+            stack.push_back({child, 0});
+            mark.push_back(log.size());
+            enter = true;
+        }
+        else
+        {
+            while (log.size() > mark.back())
+            {
+                values[log.back()].pop_back();
+                log.pop_back();
+            }
+            mark.pop_back();
+            stack.pop_back();
+            enter = false;
+        }
+    }
+
+    for (auto &alloca : allocas)
+        delete alloca;
+}
+
+// 按支配边界插入的 phi 未必有人使用：从非 phi 的使用出发标记活跃的 phi，其余删除
+void Mem2Reg::removeDeadPhis()
+{
+    std::unordered_map<Instruction *, bool> live;
+    std::vector<Instruction *> worklist;
+    for (auto &it : phi2alloca)
+    {
+        Operand *dst = it.first->getDef();
+        for (auto use = dst->use_begin(); use != dst->use_end(); use++)
+            if (!(*use)->isPhi())
+            {
+                live[it.first] = true;
+                worklist.push_back(it.first);
+                break;
+            }
+    }
+    while (!worklist.empty())
+    {
+        auto phi = worklist.back();
+        worklist.pop_back();
+        for (auto &src : phi->getUse())
+        {
+            auto def = src->getDef();
+            if (def != nullptr && def->isPhi() && !live[def])
+            {
+                live[def] = true;
+                worklist.push_back(def);
+            }
+        }
+    }
+    for (auto &it : phi2alloca)
+        if (!live[it.first])
+            delete it.first;
+}
@@ -1,17 +1,87 @@
 #include "Operand.h"
+#include "Instruction.h"
 #include <sstream>
 #include <algorithm>
 #include <string.h>
 
+Use::Use(Operand *val, Instruction *user, bool def) : val(val), user(user), prev(nullptr), next(nullptr), def(def)
+{
+    link();
+}
+
+Use::Use(Use &&other) noexcept : val(other.val), user(other.user), prev(other.prev), next(other.next), def(other.def)
+{
+    if (val != nullptr && !def)
+    {
+        if (prev != nullptr)
+            prev->next = this;
+        else
+            val->useHead = this;
+        if (next != nullptr)
+            next->prev = this;
+    }
+    other.val = nullptr;
+    other.prev = other.next = nullptr;
+}
+
+Use::~Use()
+{
+    if (!Arena::isFinalizing())
+        unlink();
+}
+
+// 头插到 val 的 use 链表
+void Use::link()
+{
+    if (val == nullptr || def)
+        return;
+    prev = nullptr;
+    next = val->useHead;
+    if (next != nullptr)
+        next->prev = this;
+    val->useHead = this;
+    val->numUses++;
+}
+
+void Use::unlink()
+{
+    if (val == nullptr || def)
+        return;
+    if (prev != nullptr)
+        prev->next = next;
+    else
+        val->useHead = next;
+    if (next != nullptr)
+        next->prev = prev;
+    prev = next = nullptr;
+    val->numUses--;
+}
+
+void Use::set(Operand *newVal)
+{
+    unlink();
+    val = newVal;
+    link();
+}
+
 std::string Operand::toStr() const
 {
     return se->toStr();
 }
 
-void Operand::removeUse(Instruction *inst)
+int Operand::loadusersNum() const
 {
-    auto i = std::find(uses.begin(), uses.end(), inst);
-    if(i != uses.end())
-        uses.erase(i);
+    int num = 0;
+    for (Use *u = useHead; u != nullptr; u = u->getNext())
+        if (u->getUser()->isLoad())
+            num++;
+    return num;
 }
 
+void Operand::replaceAllUsesWith(Operand *newOp)
+{
+    if (newOp == this)
+        return;
+    while (useHead != nullptr)
+        useHead->set(newOp);
+}
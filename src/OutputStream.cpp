@@ -0,0 +1,138 @@
+#include "OutputStream.h"
+#include "Compiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+OutputStream &OutputStream::operator<<(int v)
+{
+    if (end - cur < 11)
+        reserve(11);
+    unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+    char digits[10];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u != 0);
+    if (v < 0)
+        *cur++ = '-';
+    while (n > 0)
+        *cur++ = digits[--n];
+    return *this;
+}
+
+void OutputStream::printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void OutputStream::vprintf(const char *format, va_list args)
+{
+    va_list again;
+    va_copy(again, args);
+    size_t room = end - cur;
+    int n = vsnprintf(cur, room, format, args);
+    // vsnprintf 总要写结尾的 '\0'，所以需要 n + 1 字节
+    if (n >= 0 && (size_t)n >= room)
+    {
+        reserve(n + 1);
+        n = vsnprintf(cur, end - cur, format, again);
+    }
+    va_end(again);
+    if (n > 0)
+        cur += n;
+}
+
+FileOutputStream::FileOutputStream(FILE *file, size_t bufferSize) : file(file), buffer(bufferSize)
+{
+    cur = buffer.data();
+    end = cur + buffer.size();
+}
+
+void FileOutputStream::flush()
+{
+    fwrite(buffer.data(), 1, cur - buffer.data(), file);
+    cur = buffer.data();
+}
+
+void FileOutputStream::reserve(size_t need)
+{
+    flush();
+    if (need > buffer.size())
+        buffer.resize(need);
+    cur = buffer.data();
+    end = cur + buffer.size();
+}
+
+void StringOutputStream::flush()
+{
+    if (cur == nullptr)
+        return;
+    str.resize(cur - &str[0]);
+    cur = end = nullptr;
+}
+
+void StringOutputStream::reserve(size_t need)
+{
+    size_t used = cur == nullptr ? str.size() : cur - &str[0];
+    str.resize(std::max({used + need, 2 * str.size(), (size_t)256}));
+    cur = &str[0] + used;
+    end = &str[0] + str.size();
+}
+
+MmapOutputStream::MmapOutputStream(const char *path) : base(nullptr), mapped(0)
+{
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0 && !grow(1 << 20))
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+// 把文件扩大到 size 字节并重新映射，窗口指向同样的位置
+bool MmapOutputStream::grow(size_t size)
+{
+    size_t used = cur - base;
+    if (ftruncate(fd, size) != 0)
+        return false;
+    void *p = base == nullptr ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                              : mremap(base, mapped, size, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+        return false;
+    base = (char *)p;
+    mapped = size;
+    cur = base + used;
+    end = base + mapped;
+    return true;
+}
+
+void MmapOutputStream::reserve(size_t need)
+{
+    size_t used = cur - base;
+    if (!grow(std::max(2 * mapped, used + need)))
+    {
+        fprintf(stderr, "fail to extend output file: %s\n", strerror(errno));
+        throw CompileError();
+    }
+}
+
+void MmapOutputStream::close()
+{
+    if (fd < 0)
+        return;
+    size_t used = cur - base;
+    munmap(base, mapped);
+    if (ftruncate(fd, used) != 0)
+        fprintf(stderr, "fail to truncate output file: %s\n", strerror(errno));
+    ::close(fd);
+    fd = -1;
+    base = cur = end = nullptr;
+}
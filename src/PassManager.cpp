@@ -0,0 +1,54 @@
+#include "PassManager.h"
+#include "Mem2Reg.h"
+#include "SCCP.h"
+#include "IRComSubExprElim.h"
+#include "LICM.h"
+#include "IRBlockMerge.h"
+#include "TimeReport.h"
+
+PassManager::~PassManager()
+{
+    for (auto pass : passes)
+        delete pass;
+}
+
+void PassManager::addPipeline(int level)
+{
+    if (level <= 0)
+        return;
+    add(new Mem2Reg(unit));
+    add(new SCCP(unit));
+    if (level >= 2)
+    {
+        add(new IRComSubExprElim(unit));
+        add(new LICM(unit));
+    }
+    add(new BlockMerge(unit));
+}
+
+void PassManager::run()
+{
+    for (auto pass : passes)
+    {
+        TimeRegion region(pass->getName());
+        if (pass->isModulePass())
+        {
+            if (!((ModulePass *)pass)->runOnModule())
+                continue;
+            for (auto func = unit->begin(); func != unit->end(); func++)
+                (*func)->invalidateAnalyses(pass->getPreserved());
+            continue;
+        }
+        auto fp = (FunctionPass *)pass;
+        fp->doInitialization();
+        for (auto func = unit->begin(); func != unit->end(); func++)
+            if (fp->runOnFunction(*func))
+                (*func)->invalidateAnalyses(pass->getPreserved());
+    }
+}
+
+void PassManager::printStats(FILE *out)
+{
+    for (auto pass : passes)
+        pass->printStats(out);
+}
@@ -0,0 +1,35 @@
+#include "PhiElimination.h"
+
+void PhiElimination::pass()
+{
+    for (auto func = unit->begin(); func != unit->end(); func++)
+        eliminate(*func);
+}
+
+void PhiElimination::eliminate(Function *func)
+{
+    for (auto &bb : func->getBlockList())
+    {
+        std::vector<PhiInstruction *> phis;
+        for (auto inst = bb->begin(); inst != bb->end() && inst->isPhi(); inst = inst->getNext())
+            phis.push_back((PhiInstruction *)inst);
+        for (auto &phi : phis)
+        {
+            Operand *dst = phi->getDef();
+            Operand *tmp = new Operand(new TemporarySymbolEntry(dst->getType(), SymbolTable::getLabel()));
+            for (int i = 0; i < phi->getNumIncoming(); i++)
+            {
+                BasicBlock *pred = phi->getIncomingBlock(i);
+                Instruction *term = pred->rbegin();
+                auto copy = new CopyInstruction(tmp, phi->getIncomingValue(i));
+                if (term != pred->rend() && (term->isJump() || term->isRet()))
+                    pred->insertBefore(copy, term);
+                else
+                    pred->insertBack(copy);
+            }
+            auto copy = new CopyInstruction(dst, tmp);
+            bb->insertBefore(copy, phi);
+            delete phi;
+        }
+    }
+}
@@ -0,0 +1,319 @@
+#include "SCCP.h"
+#include "Type.h"
+#include <climits>
+
+void SCCP::doInitialization()
+{
+    constGlobals.clear();
+    for (auto &global : unit->getGlobalVars())
+    {
+        Operand *addr = global->getDef();
+        if (addr->isConst() && global->getValueType()->isInt())
+            constGlobals[addr] = global->getIntValue();
+    }
+}
+
+bool SCCP::runOnFunction(Function *func)
+{
+    solve(func);
+    int folded = rewrite(func);
+    int removed = removeDeadBlocks(func);
+    stats.push_back({func->getSymPtr()->toStr().substr(1), {folded, removed}});
+    return folded || removed;
+}
+
+void SCCP::printStats(FILE *out)
+{
+    fprintf(out, "sparse conditional constant propagation:\n");
+    fprintf(out, "  %-20s %8s %8s\n", "function", "folded", "removed");
+    for (auto &it : stats)
+        fprintf(out, "  %-20s %8d %8d\n", it.first.c_str(), it.second.first, it.second.second);
+}
+
+SCCP::Lattice SCCP::getValue(Operand *op)
+{
+    SymbolEntry *se = op->getEntry();
+    if (se->isConstant())
+    {
+        auto c = dynamic_cast<ConstantSymbolEntry *>(se);
+        if (c != nullptr && !se->getType()->isFloat())
+            return {Lattice::CONST, c->getValue()};
+        return {Lattice::NAC, 0};
+    }
+    if (op->getDef() == nullptr) // 参数、全局变量地址等
+        return {Lattice::NAC, 0};
+    auto it = values.find(op);
+    if (it == values.end())
+        return {Lattice::UNDEF, 0};
+    return it->second;
+}
+
+// 格值只会下降，变化时把使用者加入 SSA 工作表
+void SCCP::setValue(Operand *op, Lattice v)
+{
+    Lattice old = getValue(op);
+    if (old.state == v.state && (v.state != Lattice::CONST || old.value == v.value))
+        return;
+    values[op] = v;
+    for (auto user = op->use_begin(); user != op->use_end(); user++)
+        ssaWorklist.push_back(*user);
+}
+
+SCCP::Lattice SCCP::evaluate(Instruction *inst)
+{
+    const Lattice undef = {Lattice::UNDEF, 0}, nac = {Lattice::NAC, 0};
+    Type *type = inst->getDef()->getType();
+    if (!type->isInt() && !type->isBool())
+        return nac;
+
+    if (inst->isPhi())
+    {
+        auto phi = (PhiInstruction *)inst;
+        Lattice res = undef;
+        for (int i = 0; i < phi->getNumIncoming(); i++)
+        {
+            if (!execEdges.count({phi->getIncomingBlock(i), phi->getParent()}))
+                continue;
+            Lattice v = getValue(phi->getIncomingValue(i));
+            if (v.state == Lattice::UNDEF)
+                continue;
+            if (v.state == Lattice::NAC || (res.state == Lattice::CONST && res.value != v.value))
+                return nac;
+            res = v;
+        }
+        return res;
+    }
+    if (inst->isLoad())
+    {
+        auto it = constGlobals.find(inst->getOperands()[1]);
+        if (it != constGlobals.end())
+            return {Lattice::CONST, it->second};
+        return nac;
+    }
+    if (!inst->isPure())
+        return nac;
+
+    std::vector<int> srcs;
+    bool hasUndef = false;
+    for (auto &src : inst->getUse())
+    {
+        Lattice v = getValue(src);
+        if (v.state == Lattice::NAC)
+            return nac;
+        if (v.state == Lattice::UNDEF)
+            hasUndef = true;
+        srcs.push_back(v.value);
+    }
+    if (hasUndef)
+        return undef;
+
+    // 按 32 位补码回绕计算
+    unsigned a = srcs[0], b = srcs.size() > 1 ? srcs[1] : 0;
+    int x = srcs[0], y = srcs.size() > 1 ? srcs[1] : 0;
+    int res;
+    if (inst->isBinary())
+    {
+        switch (inst->getOpcode())
+        {
+        case BinaryInstruction::ADD:
+            res = a + b;
+            break;
+        case BinaryInstruction::SUB:
+            res = a - b;
+            break;
+        case BinaryInstruction::MUL:
+            res = a * b;
+            break;
+        case BinaryInstruction::DIV:
+        case BinaryInstruction::MOD:
+            if (y == 0 || (x == INT_MIN && y == -1))
+                return nac; // 运行时行为交给目标机器
+            res = inst->getOpcode() == BinaryInstruction::DIV ? x / y : x % y;
+            break;
+        case BinaryInstruction::AND:
+            res = a & b;
+            break;
+        case BinaryInstruction::OR:
+            res = a | b;
+            break;
+        default:
+            return nac;
+        }
+    }
+    else if (inst->isCmp())
+    {
+        switch (inst->getOpcode())
+        {
+        case CmpInstruction::E:
+            res = x == y;
+            break;
+        case CmpInstruction::NE:
+            res = x != y;
+            break;
+        case CmpInstruction::L:
+            res = x < y;
+            break;
+        case CmpInstruction::LE:
+            res = x <= y;
+            break;
+        case CmpInstruction::G:
+            res = x > y;
+            break;
+        case CmpInstruction::GE:
+            res = x >= y;
+            break;
+        default:
+            return nac;
+        }
+    }
+    else if (inst->isZext())
+        res = x;
+    else if (inst->isXor())
+        res = x == 0;
+    else if (inst->isToBool())
+        res = x != 0;
+    else
+        return nac; // 涉及浮点的类型转换
+    return {Lattice::CONST, res};
+}
+
+void SCCP::visit(Instruction *inst)
+{
+    BasicBlock *bb = inst->getParent();
+    auto addEdge = [&](BasicBlock *to) {
+        if (execEdges.insert({bb, to}).second)
+            cfgWorklist.push_back({bb, to});
+    };
+    if (inst->isCond())
+    {
+        auto br = (CondBrInstruction *)inst;
+        Lattice cond = getValue(br->getOperands()[0]);
+        if (cond.state == Lattice::CONST)
+            addEdge(cond.value ? br->getTrueBranch() : br->getFalseBranch());
+        else if (cond.state == Lattice::NAC)
+        {
+            addEdge(br->getTrueBranch());
+            addEdge(br->getFalseBranch());
+        }
+    }
+    else if (inst->isUncond())
+        addEdge(((UncondBrInstruction *)inst)->getBranch());
+    else if (inst->getDef() != nullptr)
+        setValue(inst->getDef(), evaluate(inst));
+}
+
+void SCCP::solve(Function *func)
+{
+    values.clear();
+    execBlocks.clear();
+    execEdges.clear();
+    cfgWorklist.clear();
+    ssaWorklist.clear();
+    execEdges.insert({nullptr, func->getEntry()});
+    cfgWorklist.push_back({nullptr, func->getEntry()});
+    while (!cfgWorklist.empty() || !ssaWorklist.empty())
+    {
+        while (!cfgWorklist.empty())
+        {
+            BasicBlock *bb = cfgWorklist.back().second;
+            cfgWorklist.pop_back();
+            // 第一次到达时求值整个块，之后只需重新求值 phi
+            bool first = execBlocks.insert(bb).second;
+            for (auto inst = bb->begin(); inst != bb->end(); inst = inst->getNext())
+            {
+                if (!first && !inst->isPhi())
+                    break;
+                visit(inst);
+            }
+        }
+        while (!ssaWorklist.empty())
+        {
+            Instruction *inst = ssaWorklist.back();
+            ssaWorklist.pop_back();
+            if (execBlocks.count(inst->getParent()))
+                visit(inst);
+        }
+    }
+}
+
+// 用常量替换常量值的定值，折叠常量条件跳转，返回改写的指令数
+int SCCP::rewrite(Function *func)
+{
+    int count = 0;
+    for (auto bb : func->getBlockList())
+    {
+        if (!execBlocks.count(bb))
+            continue;
+        for (auto inst = bb->begin(), next = inst; inst != bb->end(); inst = next)
+        {
+            next = inst->getNext();
+            Operand *def = inst->getDef();
+            if (def == nullptr || !(inst->isPure() || inst->isPhi() || inst->isLoad()))
+                continue;
+            Lattice v = getValue(def);
+            if (v.state != Lattice::CONST)
+                continue;
+            def->replaceAllUsesWith(new Operand(new ConstantSymbolEntry(def->getType(), v.value)));
+            delete inst;
+            count++;
+        }
+
+        Instruction *term = bb->rbegin();
+        if (term == bb->rend() || !term->isCond())
+            continue;
+        auto br = (CondBrInstruction *)term;
+        Lattice cond = getValue(br->getOperands()[0]);
+        if (cond.state != Lattice::CONST)
+            continue;
+        BasicBlock *taken = cond.value ? br->getTrueBranch() : br->getFalseBranch();
+        BasicBlock *other = cond.value ? br->getFalseBranch() : br->getTrueBranch();
+        bb->insertBefore(new UncondBrInstruction(taken), br);
+        delete br;
+        count++;
+        bb->removeSucc(other);
+        other->removePred(bb);
+        if (other == taken)
+            continue; // 两个目标相同，只去掉重复的一条边
+        for (auto inst = other->begin(); inst != other->end() && inst->isPhi(); inst = inst->getNext())
+            ((PhiInstruction *)inst)->removeIncoming(bb);
+    }
+    return count;
+}
+
+// 删除不可执行的块，并化简只剩一个不同来值的 phi，返回删除的块数
+int SCCP::removeDeadBlocks(Function *func)
+{
+    std::vector<BasicBlock *> dead;
+    for (auto bb : func->getBlockList())
+        if (!execBlocks.count(bb))
+            dead.push_back(bb);
+    for (auto bb : dead)
+        for (auto succ : bb->getSuccs())
+            for (auto inst = succ->begin(); inst != succ->end() && inst->isPhi(); inst = inst->getNext())
+                ((PhiInstruction *)inst)->removeIncoming(bb);
+    for (auto bb : dead)
+        delete bb;
+
+    for (auto bb : func->getBlockList())
+        for (auto inst = bb->begin(), next = inst; inst != bb->end() && inst->isPhi(); inst = next)
+        {
+            next = inst->getNext();
+            auto phi = (PhiInstruction *)inst;
+            Operand *same = nullptr;
+            bool unique = true;
+            for (int i = 0; i < phi->getNumIncoming(); i++)
+            {
+                Operand *v = phi->getIncomingValue(i);
+                if (v == phi->getDef() || v == same)
+                    continue;
+                if (same != nullptr)
+                    unique = false;
+                same = v;
+            }
+            if (!unique || same == nullptr)
+                continue;
+            phi->getDef()->replaceAllUsesWith(same);
+            delete phi;
+        }
+    return dead.size();
+}
@@ -1,9 +1,19 @@
 #include "SymbolTable.h"
 #include "Type.h"
+#include "OutputStream.h"
 #include <iostream>
 #include <vector>
 #include <sstream>
 
+std::string SymbolEntry::toStr()
+{
+    std::string str;
+    StringOutputStream out(str);
+    print(out);
+    out.flush();
+    return str;
+}
+
 SymbolEntry::SymbolEntry(Type *type, int kind)
 {
     this->type = type;
@@ -16,45 +26,42 @@ ConstantSymbolEntry::ConstantSymbolEntry(Type *type, int value) : SymbolEntry(ty
     this->value = value;
 }
 
-std::string ConstantSymbolEntry::toStr()
+void ConstantSymbolEntry::print(OutputStream &out)
 {
-    std::ostringstream buffer;
-    buffer << value;
-    return buffer.str();
+    out << value;
 }
 FloatSymbolEntry::FloatSymbolEntry(Type *type, double value)
     : SymbolEntry(type, SymbolEntry::CONSTANT)
 {
     this->value = value;
 }
-std::string FloatSymbolEntry::toStr()
+void FloatSymbolEntry::print(OutputStream &out)
 {
-    std::ostringstream buffer;
-    buffer << value;
-    return buffer.str();
+    out.printf("%g", value); // 与 ostream 默认的 6 位有效数字一致
 }
 BoolSymbolEntry::BoolSymbolEntry(Type *type, bool value)
     : SymbolEntry(type, SymbolEntry::CONSTANT)
 {
     this->value = value;
 }
-std::string BoolSymbolEntry::toStr()
+void BoolSymbolEntry::print(OutputStream &out)
 {
-    std::ostringstream buffer;
-    buffer << value;
-    return buffer.str();
+    out << (int)value;
 }
 
-IdentifierSymbolEntry::IdentifierSymbolEntry(Type *type, std::string name, int scope, bool isConst)
-    : SymbolEntry(type, SymbolEntry::VARIABLE), name(name), scope(scope), isConst(isConst)
+IdentifierSymbolEntry::IdentifierSymbolEntry(Type *type, int nameId, int scope, bool isConst)
+    : SymbolEntry(type, SymbolEntry::VARIABLE), scope(scope), nameId(nameId), isConst(isConst)
 {
+    this->name = &names->getName(nameId); // 名字存放在基类中，getName() 才能取到
     this->scope = scope;
     addr = nullptr;
+    isid = false;
+    ConstantValue = 0; // 未初始化的全局变量为 0
 }
 
-std::string IdentifierSymbolEntry::toStr()
+void IdentifierSymbolEntry::print(OutputStream &out)
 {
-    return "@" + name;
+    out << '@' << *name;
 }
 
 TemporarySymbolEntry::TemporarySymbolEntry(Type *type, int label) : SymbolEntry(type, SymbolEntry::TEMPORARY)
@@ -62,98 +69,102 @@ TemporarySymbolEntry::TemporarySymbolEntry(Type *type, int label) : SymbolEntry(
     this->label = label;
 }
 
-std::string TemporarySymbolEntry::toStr()
+void TemporarySymbolEntry::print(OutputStream &out)
+{
+    out << "%t" << label;
+}
+
+int NameTable::intern(const char *name, size_t length)
+{
+    auto it = ids.find(std::string_view(name, length));
+    if (it != ids.end())
+        return it->second;
+    int id = spellings.size();
+    spellings.emplace_back(name, length);
+    ids.emplace(spellings.back(), id);
+    return id;
+}
+
+SymbolTable::SymbolTable() : slots(64, Binding{-1, 0, nullptr}), used(0), level(0)
+{
+}
+
+SymbolTable::Binding &SymbolTable::slotOf(int name)
 {
-    std::ostringstream buffer;
-    buffer << "%t" << label;
-    return buffer.str();
+    size_t mask = slots.size() - 1;
+    // 编号是连续的小整数，乘以黄金分割常数把相邻编号打散
+    size_t i = ((unsigned)name * 2654435769u) & mask;
+    while (slots[i].name != name && slots[i].name != -1)
+        i = (i + 1) & mask;
+    return slots[i];
 }
 
-SymbolTable::SymbolTable(SymbolTable *prev)
+void SymbolTable::grow()
 {
-    this->prev = prev;
-    this->level = prev->level + 1;
+    std::vector<Binding> old(2 * slots.size(), Binding{-1, 0, nullptr});
+    old.swap(slots);
+    for (auto &b : old)
+        if (b.name != -1)
+            slotOf(b.name) = b;
 }
 
-SymbolEntry *SymbolTable::lookup(std::string name)
+void SymbolTable::enterScope()
 {
-    if (symbolTable.find(name) != symbolTable.end())
+    scopeMarks.push_back(undoLog.size());
+    level++;
+}
+
+void SymbolTable::exitScope()
+{
+    size_t mark = scopeMarks.back();
+    scopeMarks.pop_back();
+    while (undoLog.size() > mark)
     {
-        return symbolTable[name];
+        slotOf(undoLog.back().name) = undoLog.back();
+        undoLog.pop_back();
     }
-    else
+    level--;
+}
+
+// install the entry into current symbol table.
+void SymbolTable::install(int name, SymbolEntry *entry)
+{
+    Binding *slot = &slotOf(name);
+    if (slot->name == -1)
     {
-        if (prev != nullptr)
-        {
-            return prev->lookup(name);
-        }
-        else
+        if (2 * (used + 1) > slots.size())
         {
-            return nullptr;
+            grow();
+            slot = &slotOf(name);
         }
+        used++;
+        *slot = Binding{name, level, nullptr};
     }
+    // 全局作用域的声明不会被撤销，不必记录
+    if (!scopeMarks.empty())
+        undoLog.push_back(*slot);
+    slot->level = level;
+    slot->entry = entry;
 }
-SymbolEntry *SymbolTable::lookupCurrentLevel(std::string name)
+
+SymbolEntry *SymbolTable::lookup(int name)
 {
-    // 只查找当前作用域的 symbolTable，而不递归到上级作用域
-    if (symbolTable.find(name) != symbolTable.end())
-    {
-        return symbolTable[name]; // 找到返回 SymbolEntry
-    }
-    else
-    {
-        return nullptr; // 没找到返回 nullptr
-    }
+    return slotOf(name).entry;
 }
 
-int SymbolTable::counter = 0;
-static SymbolTable t;
-SymbolTable *identifiers = &t;
-SymbolTable *globals = &t;
-
-// std::string FunctionSymbolEntry::toStr()
-// {
-//     std::string str = name + "(";
-//     for (size_t i = 0; i < paramTypes.size(); ++i)
-//     {
-//         str += paramTypes[i]->toStr();
-//         if (i < paramTypes.size() - 1)
-//             str += ", ";
-//     } // 输出所有参数类型
-//     str += ") -> " + returnType->toStr(); // 返回类型
-//     return str;
-// }
-
-// install the entry into current symbol table.
-void SymbolTable::install(std::string name, SymbolEntry *entry)
+SymbolEntry *SymbolTable::lookupCurrentLevel(int name)
 {
-    symbolTable[name] = entry;
+    // 只查找当前作用域中的声明，外层作用域中的同名声明不算
+    Binding &slot = slotOf(name);
+    return slot.entry != nullptr && slot.level == level ? slot.entry : nullptr;
 }
 
-SymbolTable::SymbolTable()
+bool SymbolTable::checkExist(int name)
 {
-    // printf("putint已完成");
-    prev = nullptr;
-    level = 0;
-
-    // // 创建标准库函数 putint(int) 并添加到符号表
-    // Type *intType = TypeSystem::intType; // commonInt是一个静态变量，不应该被修改
-    // // 此处应该新建一个intType，而TypeSystem::intType = &commonInt，IntType TypeSystem::commonInt = IntType(4);  则TypeSystem::intType就是一个IntType(4)
-    // Type *voidType = TypeSystem::voidType;
-    // std::vector<Type *> paramTypes = {intType};
-
-    // FunctionSymbolEntry *putintEntry = new FunctionSymbolEntry(voidType, paramTypes, "putint");
-    // install("putint", putintEntry);
-
-    // // 创建标准库函数 getint() 并添加到符号表
-    // FunctionSymbolEntry *getintEntry = new FunctionSymbolEntry(intType, {}, "getint");
-    // install("getint", getintEntry);
+    return lookupCurrentLevel(name) != nullptr;
 }
 
-bool SymbolTable::checkExist(std::string name)
-{
-    if (symbolTable.find(name) != symbolTable.end())
-        return true;
-    else
-        return false;
-}
\ No newline at end of file
+thread_local int SymbolTable::counter = 0;
+thread_local SymbolTable *identifiers = nullptr;
+thread_local SymbolTable *globals = nullptr;
+thread_local NameTable *names = nullptr;
@@ -0,0 +1,93 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <exception>
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    hasJob.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    hasJob.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]
+              { return jobs.empty() && running == 0; });
+}
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            hasJob.wait(lock, [this]
+                        { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            running++;
+        }
+        job();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+            if (jobs.empty() && running == 0)
+                idle.notify_all();
+        }
+    }
+}
+
+void parallelFor(ThreadPool *pool, size_t n, const std::function<void(size_t)> &body)
+{
+    if (pool == nullptr)
+    {
+        for (size_t i = 0; i < n; i++)
+            body(i);
+        return;
+    }
+    // 任务抛出的异常（如 CompileError）在全部任务结束后于调用线程重新抛出，只保留第一个
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    for (size_t i = 0; i < n; i++)
+        pool->submit([&body, &error, &errorMutex, i]
+                     {
+                         try
+                         {
+                             body(i);
+                         }
+                         catch (...)
+                         {
+                             std::lock_guard<std::mutex> lock(errorMutex);
+                             if (!error)
+                                 error = std::current_exception();
+                         } });
+    pool->wait();
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,216 @@
+#include "TimeReport.h"
+#include "Unit.h"
+#include "MachineCode.h"
+#include "ThreadPool.h"
+#include <functional>
+#include <sys/resource.h>
+
+thread_local TimeReport *TimeReport::active = nullptr;
+
+TimeReport::TimeReport(Unit *unit, MachineUnit *munit) : unit(unit), munit(munit)
+{
+    created = clock::now();
+    startRss = peakRss();
+}
+
+TimeReport::TimeReport(MachineFunction *func) : unit(nullptr), munit(nullptr), func(func)
+{
+    created = clock::now();
+    startRss = peakRss();
+}
+
+// 进程的峰值 RSS，Linux 下 ru_maxrss 以 KB 为单位
+long TimeReport::peakRss()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+size_t TimeReport::countIR() const
+{
+    size_t n = 0;
+    if (unit == nullptr)
+        return 0;
+    for (auto func = unit->begin(); func != unit->end(); func++)
+        for (auto bb = (*func)->begin(); bb != (*func)->end(); bb++)
+            for (auto inst = (*bb)->begin(); inst != (*bb)->end(); inst = inst->getNext())
+                n++;
+    return n;
+}
+
+size_t TimeReport::countMachine() const
+{
+    size_t n = 0;
+    if (func != nullptr)
+    {
+        for (auto bb : func->getBlocks())
+            n += bb->getInsts().size();
+        return n;
+    }
+    if (munit == nullptr)
+        return 0;
+    for (auto func : munit->getFuncs())
+        for (auto bb : func->getBlocks())
+            n += bb->getInsts().size();
+    return n;
+}
+
+// 在当前父记录下查找同名记录，没有则新建
+int TimeReport::find(const char *name, bool counted)
+{
+    return find(name, counted, stack.empty() ? -1 : stack.back().record, stack.size());
+}
+
+int TimeReport::find(const char *name, bool counted, int parent, int depth)
+{
+    for (size_t i = 0; i < records.size(); i++)
+        if (records[i].parent == parent && records[i].name == name)
+            return i;
+    Record r;
+    r.name = name;
+    r.parent = parent;
+    r.depth = depth;
+    r.counted = counted;
+    records.push_back(r);
+    return records.size() - 1;
+}
+
+void TimeReport::begin(const char *name)
+{
+    int i = find(name, true);
+    Record &r = records[i];
+    size_t ir = countIR(), mir = countMachine();
+    if (r.calls == 0)
+    {
+        r.irBefore = ir;
+        r.mirBefore = mir;
+    }
+    r.calls++;
+    stack.push_back({i, clock::now(), peakRss()});
+}
+
+void TimeReport::end()
+{
+    Frame frame = stack.back();
+    stack.pop_back();
+    Record &r = records[frame.record];
+    r.wall += std::chrono::duration<double>(clock::now() - frame.start).count();
+    r.rss += peakRss() - frame.rss;
+    r.irAfter = countIR();
+    r.mirAfter = countMachine();
+}
+
+void TimeReport::addTime(const char *name, double seconds)
+{
+    Record &r = records[find(name, false)];
+    r.calls++;
+    r.wall += seconds;
+}
+
+// 任务报告的顶层记录挂到当前所在的记录之下。新记录的机器指令数取各任务之和，
+// 已有的记录只累加增量；IR 在这些并行阶段中不变，取并入时的值
+void TimeReport::merge(const std::vector<TimeReport> &jobs)
+{
+    std::vector<int> calls; // 并入前各记录的调用次数，为 0 的是这次新建的
+    for (auto &r : records)
+        calls.push_back(r.calls);
+    size_t ir = countIR();
+    for (auto &job : jobs)
+    {
+        std::vector<int> map(job.records.size());
+        for (size_t i = 0; i < job.records.size(); i++)
+        {
+            auto &src = job.records[i];
+            int parent = src.parent >= 0 ? map[src.parent] : (stack.empty() ? -1 : stack.back().record);
+            int k = find(src.name.c_str(), src.counted, parent, stack.size() + src.depth);
+            map[i] = k;
+            Record &r = records[k];
+            bool fresh = (size_t)k >= calls.size() || calls[k] == 0;
+            r.calls += src.calls;
+            r.wall += src.wall;
+            r.rss += src.rss;
+            if (fresh)
+            {
+                r.irBefore = ir;
+                r.mirBefore += src.mirBefore;
+                r.mirAfter += src.mirAfter;
+            }
+            else
+                r.mirAfter += src.mirAfter - src.mirBefore;
+            r.irAfter = ir;
+        }
+    }
+}
+
+void timedParallelFor(ThreadPool *pool, size_t n, const std::function<void(size_t)> &body,
+                      const std::vector<MachineFunction *> *funcs)
+{
+    TimeReport *report = TimeReport::current();
+    if (report == nullptr)
+    {
+        parallelFor(pool, n, body);
+        return;
+    }
+    // 每个任务只写自己的报告，不需要加锁
+    std::vector<TimeReport> jobs;
+    jobs.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        jobs.emplace_back(funcs ? (*funcs)[i] : nullptr);
+    parallelFor(pool, n, [&](size_t i)
+                {
+                    struct Install
+                    {
+                        TimeReport *saved = TimeReport::current();
+                        ~Install() { TimeReport::setCurrent(saved); }
+                    } install;
+                    TimeReport::setCurrent(&jobs[i]);
+                    body(i); });
+    report->merge(jobs);
+}
+
+void TimeReport::print(FILE *out) const
+{
+    double total = std::chrono::duration<double>(clock::now() - created).count();
+    fprintf(out, "time report:\n");
+    fprintf(out, "  %-24s %10s %6s %10s %17s %17s\n", "phase", "wall(ms)", "%", "rss(KB)", "IR insts", "machine insts");
+    std::function<void(int)> visit = [&](int parent)
+    {
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            auto &r = records[i];
+            if (r.parent != parent)
+                continue;
+            std::string name = std::string(2 * r.depth, ' ') + r.name;
+            fprintf(out, "  %-24s %10.3f %6.1f", name.c_str(), r.wall * 1000, total > 0 ? r.wall / total * 100 : 0);
+            if (r.counted)
+                fprintf(out, " %+10ld %8zu->%-8zu %8zu->%-8zu", r.rss, r.irBefore, r.irAfter, r.mirBefore, r.mirAfter);
+            fprintf(out, "\n");
+            visit(i);
+        }
+    };
+    visit(-1);
+    fprintf(out, "  %-24s %10.3f %6.1f %+10ld\n", "total", total * 1000, 100.0, peakRss() - startRss);
+}
+
+void TimeReport::printJSON(FILE *out) const
+{
+    double total = std::chrono::duration<double>(clock::now() - created).count();
+    fprintf(out, "{\n  \"total_ms\": %.3f,\n  \"peak_rss_kb\": %ld,\n  \"peak_rss_delta_kb\": %ld,\n  \"phases\": [",
+            total * 1000, peakRss(), peakRss() - startRss);
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        auto &r = records[i];
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"parent\": ", i ? "," : "", r.name.c_str());
+        if (r.parent < 0)
+            fprintf(out, "null");
+        else
+            fprintf(out, "\"%s\"", records[r.parent].name.c_str());
+        fprintf(out, ", \"depth\": %d, \"calls\": %d, \"wall_ms\": %.3f", r.depth, r.calls, r.wall * 1000);
+        if (r.counted)
+            fprintf(out, ", \"rss_delta_kb\": %ld, \"ir_before\": %zu, \"ir_after\": %zu, \"machine_before\": %zu, \"machine_after\": %zu",
+                    r.rss, r.irBefore, r.irAfter, r.mirBefore, r.mirAfter);
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
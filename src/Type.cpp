@@ -1,5 +1,5 @@
 #include "Type.h"
-#include <sstream>
+#include "OutputStream.h"
 
 // 基本类型的初始化
 IntType TypeSystem::commonInt = IntType(32);
@@ -9,8 +9,6 @@ DecimalType TypeSystem::commonDecimal(4);
 
 FloatType TypeSystem::commonFloat(4);
 
-ArrayType TypeSystem::commonArray(10);
-
 ConstType TypeSystem::commonConst(&commonInt); // commonConst 必须在 commonInt 之后定义
 
 // 指针类型的初始化
@@ -20,14 +18,53 @@ Type *TypeSystem::decimalType = &commonDecimal;
 
 Type *TypeSystem::floatType = &commonFloat;
 
-Type *TypeSystem::arrayType = &commonArray;
 Type *TypeSystem::constType = &commonConst; // 这里只定义一次
 Type *TypeSystem::boolType = &commonBool;
 
-// `ConstType` 的获取方法
-Type *TypeSystem::getConstType(Type *baseType)
+thread_local TypeContext *TypeSystem::context = nullptr;
+
+// constType 是静态实例，登记进来才能与 getConstType(intType) 得到同一个对象
+TypeContext::TypeContext()
+{
+    consts[TypeSystem::intType] = TypeSystem::constType;
+}
+
+Type *TypeContext::getPointerType(Type *valueType)
 {
-    return new ConstType(baseType);
+    Type *&type = pointers[valueType];
+    if (type == nullptr)
+        type = new PointerType(valueType);
+    return type;
+}
+
+Type *TypeContext::getConstType(Type *baseType)
+{
+    Type *&type = consts[baseType];
+    if (type == nullptr)
+        type = new ConstType(baseType);
+    return type;
+}
+
+Type *TypeContext::getArrayType(Type *elementType, int length)
+{
+    Type *&type = arrays[{elementType, length}];
+    if (type == nullptr)
+        type = new ArrayType(elementType, length);
+    return type;
+}
+
+Type *TypeContext::getFunctionType(Type *returnType, const vector<Type *> &paramsType)
+{
+    size_t hash = std::hash<Type *>()(returnType);
+    for (auto param : paramsType)
+        hash = hash * 31 + std::hash<Type *>()(param);
+    auto range = functions.equal_range(hash);
+    for (auto it = range.first; it != range.second; it++)
+        if (it->second->getRetType() == returnType && it->second->getParamsTypes() == paramsType)
+            return it->second;
+    FunctionType *type = new FunctionType(returnType, paramsType);
+    functions.emplace(hash, type);
+    return type;
 }
 bool Type::isValid(Type *t1, Type *t2)
 {
@@ -35,66 +72,74 @@ bool Type::isValid(Type *t1, Type *t2)
         return true;
     return false;
 }
-// 各种类型的 `toStr()` 方法实现
-std::string IntType::toStr()
+std::string Type::toStr()
+{
+    std::string str;
+    StringOutputStream out(str);
+    print(out);
+    out.flush();
+    return str;
+}
+
+// 各种类型的 `print()` 方法实现
+void IntType::print(OutputStream &out)
 {
-    std::ostringstream buffer;
-    buffer << "i" << size;
-    return buffer.str();
+    out << 'i' << size;
 }
 
-std::string VoidType::toStr()
+void VoidType::print(OutputStream &out)
 {
-    return "void";
+    out << "void";
 }
 
-std::string BoolType::toStr()
+void BoolType::print(OutputStream &out)
 {
-    return "bool";
+    out << "bool";
 }
-std::string FunctionType::toStr()
+void FunctionType::print(OutputStream &out)
 {
-    ostringstream buffer;
-    buffer << returnType->toStr() << "(";
+    returnType->print(out);
+    out << '(';
     for (auto it = paramsType.begin(); it != paramsType.end(); it++)
     {
-        buffer << (*it)->toStr();
+        (*it)->print(out);
         if (it + 1 != paramsType.end())
         {
-            buffer << ", ";
+            out << ", ";
         }
     }
-    buffer << ')';
-    return buffer.str();
+    out << ')';
 }
-std::string DecimalType::toStr()
+void DecimalType::print(OutputStream &out)
 {
-    return "decimal";
+    out << "decimal";
 }
 
 
 
-std::string FloatType::toStr()
+void FloatType::print(OutputStream &out)
 {
-    return "float";
+    out << "float";
 }
 
 
 
-std::string ConstType::toStr()
+void ConstType::print(OutputStream &out)
 {
-    return "const" + baseType->toStr();
+    out << "const";
+    baseType->print(out);
 }
 
-std::string PointerType::toStr()
+void PointerType::print(OutputStream &out)
 {
-    std::ostringstream buffer;
-    buffer << valueType->toStr() << "*";
-    return buffer.str();
+    valueType->print(out);
+    out << '*';
 }
-std::string ArrayType::toStr()
+void ArrayType::print(OutputStream &out)
 {
-    return "array";
+    out << '[' << length << " x ";
+    elementType->print(out);
+    out << ']';
 }
 
 bool TypeSystem::needCast(Type *src, Type *target)
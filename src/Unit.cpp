@@ -1,10 +1,15 @@
 #include "Unit.h"
 #include "Type.h"
+#include "ThreadPool.h"
+#include "TimeReport.h"
+#include "FunctionCache.h"
+#include "OutputStream.h"
 #include <unordered_map>
 #include <deque>
 #include <unordered_set>
 
-extern FILE *yyout;
+// IR 和汇编的输出流，每个编译线程各自一份
+thread_local OutputStream *code_out = nullptr;
 
 void Unit::insertFunc(Function *f)
 {
@@ -18,13 +23,13 @@ void Unit::removeFunc(Function *func)
 
 void Unit::output() const
 {
-    fprintf(yyout, "target triple = \"x86_64-pc-linux-gnu\"\n\n");
-    // fprintf(yyout, "target triple = \"armv7-unknown-linux-gnueabihf\"\n\n");
-    fprintf(yyout, "declare i32 @getint()\n");
-    fprintf(yyout, "declare void @putint(i32)\n");
-    fprintf(yyout, "declare i32 @getch()\n");
-    fprintf(yyout, "declare void @putch(i32)\n");
-    fprintf(yyout, "declare void @putf(i32)\n\n");
+    code_out->printf("target triple = \"x86_64-pc-linux-gnu\"\n\n");
+    // code_out->printf("target triple = \"armv7-unknown-linux-gnueabihf\"\n\n");
+    code_out->printf("declare i32 @getint()\n");
+    code_out->printf("declare void @putint(i32)\n");
+    code_out->printf("declare i32 @getch()\n");
+    code_out->printf("declare void @putch(i32)\n");
+    code_out->printf("declare void @putf(i32)\n\n");
     for (auto i : global_var)
         i->output();
     for (auto &func : func_list)
@@ -34,19 +39,24 @@ void Unit::initLibraryFunctions()
 {
     // printf("%s\n", argv[optind]);
     Type *funcType;
-    funcType = new FunctionType(TypeSystem::intType, {});
-    SymbolEntry *se = new IdentifierSymbolEntry(funcType, "getint", identifiers->getLevel());
-    identifiers->install("getint", se);
+    SymbolEntry *se;
+    int name;
+    funcType = TypeSystem::getFunctionType(TypeSystem::intType, {});
+    name = names->intern("getint");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 
     // getch
-    funcType = new FunctionType(TypeSystem::intType, {});
-    se = new IdentifierSymbolEntry(funcType, "getch", identifiers->getLevel());
-    identifiers->install("getch", se);
+    funcType = TypeSystem::getFunctionType(TypeSystem::intType, {});
+    name = names->intern("getch");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 
     // getfloat
-    funcType = new FunctionType(TypeSystem::floatType, {});
-    se = new IdentifierSymbolEntry(funcType, "getfloat", identifiers->getLevel());
-    identifiers->install("getfloat", se);
+    funcType = TypeSystem::getFunctionType(TypeSystem::floatType, {});
+    name = names->intern("getfloat");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 
     // // getarray
     // funcType = new FunctionType(TypeSystem::intType, {});
@@ -54,19 +64,22 @@ void Unit::initLibraryFunctions()
     // identifiers->install("getarray", se);
 
     // putint
-    funcType = new FunctionType(TypeSystem::voidType, {TypeSystem::intType});
-    se = new IdentifierSymbolEntry(funcType, "putint", identifiers->getLevel());
-    identifiers->install("putint", se);
+    funcType = TypeSystem::getFunctionType(TypeSystem::voidType, {TypeSystem::intType});
+    name = names->intern("putint");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 
     // putch
-    funcType = new FunctionType(TypeSystem::voidType, {TypeSystem::intType});
-    se = new IdentifierSymbolEntry(funcType, "putch", identifiers->getLevel());
-    identifiers->install("putch", se);
+    funcType = TypeSystem::getFunctionType(TypeSystem::voidType, {TypeSystem::intType});
+    name = names->intern("putch");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 
     // putfloat
-    funcType = new FunctionType(TypeSystem::voidType, {TypeSystem::floatType});
-    se = new IdentifierSymbolEntry(funcType, "putfloat", identifiers->getLevel());
-    identifiers->install("putfloat", se);
+    funcType = TypeSystem::getFunctionType(TypeSystem::voidType, {TypeSystem::floatType});
+    name = names->intern("putfloat");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 
     // // putarray
     // funcType = new FunctionType(TypeSystem::voidType, {});
@@ -74,19 +87,22 @@ void Unit::initLibraryFunctions()
     // identifiers->install("putarray", se);
 
     // putf
-    funcType = new FunctionType(TypeSystem::voidType, {});
-    se = new IdentifierSymbolEntry(funcType, "putf", identifiers->getLevel());
-    identifiers->install("putf", se);
+    funcType = TypeSystem::getFunctionType(TypeSystem::voidType, {});
+    name = names->intern("putf");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 
     // starttime
-    funcType = new FunctionType(TypeSystem::voidType, {});
-    se = new IdentifierSymbolEntry(funcType, "starttime", identifiers->getLevel());
-    identifiers->install("starttime", se);
+    funcType = TypeSystem::getFunctionType(TypeSystem::voidType, {});
+    name = names->intern("starttime");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 
     // stoptime
-    funcType = new FunctionType(TypeSystem::voidType, {});
-    se = new IdentifierSymbolEntry(funcType, "stoptime", identifiers->getLevel());
-    identifiers->install("stoptime", se);
+    funcType = TypeSystem::getFunctionType(TypeSystem::voidType, {});
+    name = names->intern("stoptime");
+    se = new IdentifierSymbolEntry(funcType, name, identifiers->getLevel());
+    identifiers->install(name, se);
 }
 void Unit::removeUnusedAlloca()
 {
@@ -270,17 +286,8 @@ void Unit::samebboptimize()
                 if (!loadDef)
                     continue;
 
-                // 获取 loadDef 的所有使用者
-                std::vector<Instruction *> users = loadDef->getUse();
-
-                for (auto userInst : users)
-                {
-                    // fprintf(stderr, "当前指令类型是：%d\n", userInst->getInstType());
-                    userInst->replaceUse(loadDef, replacementVal);
-                    // fprintf(stderr, "Replaced %s with %s\n", loadDef->toStr().c_str(), replacementVal->toStr().c_str());
-                    // fprintf(stderr, "User instruction: %s\n", userInst->getDef()->toStr().c_str());
-                    //  fprintf(stderr, "User instruction: %s\n", userInst->getUse()[0]->toStr().c_str());
-                }
+                // 沿 use 链表把 loadDef 的所有使用改为 replacementVal
+                loadDef->replaceAllUsesWith(replacementVal);
             }
 
             // 第四阶段：删除标记的指令
@@ -316,17 +323,36 @@ void Unit::samebboptimize()
 }
 Unit::~Unit()
 {
-    auto delete_var = global_var;
-    for (auto &i : delete_var)
-        delete i;
-    auto delete_list = func_list;
-    for (auto &func : delete_list)
-        delete func;
+    // 函数、基本块、指令等节点都分配在 arena 中，由 arena 析构后整体释放，不再逐个 delete
 }
-void Unit::genMachineCode(MachineUnit* munit) 
+void Unit::genMachineCode(MachineUnit* munit, ThreadPool *pool, FunctionCache *cache)
 {
-    AsmBuilder* builder = new AsmBuilder();
-    builder->setUnit(munit);
-    for (auto &func : func_list)
-        func->genMachineCode(builder);
-}
\ No newline at end of file
+    for (auto se : global_syms)
+        munit->InsertGlobal(se);
+    // 各函数的指令选择互不依赖：每个函数从同一个编号开始新建虚拟寄存器，
+    // 结果按函数原来的顺序加入 munit，与执行顺序和线程数无关
+    int base = SymbolTable::peekLabel();
+    std::vector<MachineFunction *> mfuncs(func_list.size());
+    timedParallelFor(pool, func_list.size(), [&](size_t i)
+                     {
+                         std::string key, text;
+                         if (cache != nullptr)
+                         {
+                             key = cache->makeKey(func_list[i]);
+                             if (cache->lookup(key, func_list[i], text))
+                             {
+                                 mfuncs[i] = new MachineFunction(munit, func_list[i]->getSymPtr());
+                                 mfuncs[i]->setCachedAsm(text);
+                                 return;
+                             }
+                         }
+                         AsmBuilder builder;
+                         builder.setUnit(munit);
+                         SymbolTable::setLabel(base);
+                         func_list[i]->genMachineCode(&builder);
+                         mfuncs[i] = builder.getFunction();
+                         mfuncs[i]->setNextVReg(SymbolTable::peekLabel());
+                         mfuncs[i]->setCacheKey(key); });
+    for (auto mfunc : mfuncs)
+        munit->InsertFunc(mfunc);
+}
@@ -1,26 +1,120 @@
 #include <iostream>
 #include <string.h>
 #include <unistd.h>
-#include "common.h"
-#include "Ast.h"
-#include "Unit.h"
-#include "MachineCode.h"
-#include "LinearScan.h"
+#include "Compiler.h"
+#include "ThreadPool.h"
+#include "OutputStream.h"
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <atomic>
+#include <exception>
 
-extern FILE *yyin;
-extern FILE *yyout;
-int yyparse();
-
-Ast ast;
-Unit unit;
-MachineUnit mUnit;
 char outfile[256] = "a.out";
-dump_type_t dump_type = ASM;
+char batchfile[256] = "";
+int jobs = -1; // 未指定 -j
+CompileOptions options;
+
+// 批量编译时各文件的 -M/-P/-R/-ftime-report 输出不能交错
+static std::mutex reportMutex;
+
+// 编译一个文件：读入源文件，由 Compiler 在内存中完成编译，结果边生成边写进输出文件
+static bool compile(const char *infile, const char *outfile)
+{
+    std::ifstream in(infile, std::ios::binary);
+    if (!in)
+    {
+        fprintf(stderr, "%s: No such file or directory\nno input file\n", infile);
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string source = buffer.str();
+    Compiler compiler(options);
+    bool ok;
+    // 结果直接写进映射的输出文件；不能映射的（比如管道）改为缓冲后 fwrite
+    MmapOutputStream mapped(outfile);
+    if (mapped.isOpen())
+    {
+        ok = compiler.compile(source.data(), source.size(), mapped);
+        mapped.close();
+        if (!ok)
+            remove(outfile);
+    }
+    else
+    {
+        FILE *out;
+        if (!(out = fopen(outfile, "w")))
+        {
+            fprintf(stderr, "%s: fail to open output file\n", outfile);
+            return false;
+        }
+        FileOutputStream stream(out);
+        ok = compiler.compile(source.data(), source.size(), stream);
+        stream.flush();
+        fclose(out);
+    }
+    const std::string &report = compiler.getReport();
+    if (!report.empty())
+    {
+        std::lock_guard<std::mutex> lock(reportMutex);
+        if (batchfile[0] != '\0')
+            fprintf(stderr, "%s:\n", infile);
+        fputs(report.c_str(), stderr);
+    }
+    return ok;
+}
+
+// 批量编译：列表文件每行是一对 "输入文件 输出文件"，由线程池并发编译。
+// 某个文件编译失败或抛出异常时只报告该文件、删除它不完整的输出，其余文件照常编译；
+// 所有文件共用一个进程，段错误之类的致命信号仍会终止整个批次
+static bool compileBatch()
+{
+    std::ifstream list(batchfile);
+    if (!list)
+    {
+        fprintf(stderr, "%s: No such file or directory\n", batchfile);
+        return false;
+    }
+    std::vector<std::pair<std::string, std::string>> files;
+    std::string in, out;
+    while (list >> in >> out)
+        files.push_back({in, out});
+    std::atomic<int> failed(0);
+    ThreadPool pool(jobs < 0 ? 0 : jobs);
+    for (auto &file : files)
+        pool.submit([&file, &failed]
+                    {
+                        bool ok = false;
+                        try
+                        {
+                            ok = compile(file.first.c_str(), file.second.c_str());
+                        }
+                        catch (const std::exception &e)
+                        {
+                            fprintf(stderr, "%s: internal compiler error: %s\n", file.first.c_str(), e.what());
+                            remove(file.second.c_str());
+                        }
+                        catch (...)
+                        {
+                            fprintf(stderr, "%s: internal compiler error\n", file.first.c_str());
+                            remove(file.second.c_str());
+                        }
+                        if (!ok)
+                        {
+                            fprintf(stderr, "%s: compilation failed\n", file.first.c_str());
+                            failed++;
+                        } });
+    pool.wait();
+    if (failed)
+        fprintf(stderr, "%d of %zu files failed\n", failed.load(), files.size());
+    return failed == 0;
+}
 
 int main(int argc, char *argv[])
 {
     int opt;
-    while ((opt = getopt(argc, argv, "Siato:")) != -1)
+    while ((opt = getopt(argc, argv, "SiatMRCPo:O:f:B:j:")) != -1)
     {
         switch (opt)
         {
@@ -28,50 +122,80 @@ int main(int argc, char *argv[])
             strcpy(outfile, optarg);
             break;
         case 'a':
-            dump_type = AST;
+            options.dumpType = AST;
             break;
         case 't':
-            dump_type = TOKENS;
+            options.dumpType = TOKENS;
             break;
         case 'i':
-            dump_type = IR;
+            options.dumpType = IR;
             break;
         case 'S':
-            dump_type = ASM;
+            options.dumpType = ASM;
+            break;
+        case 'M':
+            options.memReport = true;
+            break;
+        case 'R':
+            options.raReport = true;
+            break;
+        case 'C':
+            options.graphColoring = true;
+            break;
+        case 'P':
+            options.optReport = true;
+            break;
+        case 'O':
+            options.optLevel = atoi(optarg);
+            if (options.optLevel < 0 || options.optLevel > 2)
+            {
+                fprintf(stderr, "unsupported optimization level -O%s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            // -ftime-report 输出文本，-ftime-report=json 输出 JSON，都写到 stderr
+            if (strcmp(optarg, "time-report") == 0)
+                options.timeReport = CompileOptions::TEXT_REPORT;
+            else if (strcmp(optarg, "time-report=json") == 0)
+                options.timeReport = CompileOptions::JSON_REPORT;
+            // -fcache-dir=目录 启用函数缓存，-fcache-size=MB 限制其大小，-fcache-report 输出命中统计
+            else if (strncmp(optarg, "cache-dir=", 10) == 0)
+                options.cacheDir = optarg + 10;
+            else if (strncmp(optarg, "cache-size=", 11) == 0)
+                options.cacheSize = (size_t)atol(optarg + 11) << 20;
+            else if (strcmp(optarg, "cache-report") == 0)
+                options.cacheReport = true;
+            else
+            {
+                fprintf(stderr, "unsupported option -f%s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'B':
+            strcpy(batchfile, optarg);
+            break;
+        case 'j':
+            // 批量编译时是同时编译的文件数，编译单个文件时是后端按函数并行的线程数
+            jobs = atoi(optarg);
             break;
         default:
-            fprintf(stderr, "Usage: %s [-o outfile] infile\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-o outfile] [-O0|-O1|-O2] [-ftime-report[=json]] [-fcache-dir=dir] [-j threads] infile\n"
+                            "       %s -B listfile [-j threads] [options]\n",
+                    argv[0], argv[0]);
             exit(EXIT_FAILURE);
             break;
         }
     }
+    if (batchfile[0] != '\0')
+        return compileBatch() ? 0 : EXIT_FAILURE;
+    options.threads = jobs < 0 ? 1 : jobs;
     if (optind >= argc)
     {
         fprintf(stderr, "no input file\n");
         exit(EXIT_FAILURE);
     }
-    if (!(yyin = fopen(argv[optind], "r")))
-    {
-        fprintf(stderr, "%s: No such file or directory\nno input file\n", argv[optind]);
-        exit(EXIT_FAILURE);
-    }
-    if (!(yyout = fopen(outfile, "w")))
-    {
-        fprintf(stderr, "%s: fail to open output file\n", outfile);
+    if (!compile(argv[optind], outfile))
         exit(EXIT_FAILURE);
-    }
-    unit.initLibraryFunctions();
-    yyparse();
-    if(dump_type == AST)
-        ast.output();
-    ast.typeCheck();
-    ast.genCode(&unit);
-    if(dump_type == IR)
-        unit.output();
-    unit.genMachineCode(&mUnit);
-    LinearScan linearScan(&mUnit);
-    linearScan.allocateRegisters();
-    if(dump_type == ASM)
-        mUnit.output();
     return 0;
 }
@@ -1,23 +1,36 @@
 %code top{
     #include <iostream>
     #include <assert.h>
-    #include "parser.h"
-    extern Ast ast;
-    int yylex();
-    int yyerror( char const * );
-    
+    #include "Compiler.h"
+    #include "TimeReport.h"
 }
 
-
 %code requires {
     #include "Ast.h"
     #include "SymbolTable.h"
     #include "Type.h"
+    // 与 flex 生成的定义一致，parser.h 不依赖词法分析器的头文件
+    #ifndef YY_TYPEDEF_YY_SCANNER_T
+    #define YY_TYPEDEF_YY_SCANNER_T
+    typedef void *yyscan_t;
+    #endif
 }
 
+%code {
+    int yylex(YYSTYPE *, yyscan_t);
+    int yyerror(yyscan_t, Ast *, char const *);
+    // 词法分析由 yyparse 逐个 token 驱动，-ftime-report 时单独累计其耗时
+    static int timedLex(YYSTYPE *, yyscan_t);
+    #define yylex timedLex
+}
+
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {Ast *ast}
+
 %union {
     int itype;
-    char* strtype;
+    int nametype; // 驻留后的标识符编号
     StmtNode* stmttype;
     ExprNode* exprtype;
     Type* type;
@@ -26,7 +39,7 @@
 }
 
 %start Program
-%token <strtype> ID 
+%token <nametype> ID 
 %token <itype> INTEGER
 %token <ftype> FLOAT_LITERAL
 %token <itype> HEX_LITERAL
@@ -48,7 +61,7 @@
 %%
 Program
     : Stmts {
-        ast.setRoot($1);
+        ast->setRoot($1);
     }
     ;
 Stmts
@@ -79,19 +92,17 @@ LVal
     : ID {
         SymbolEntry *se;
         se = identifiers->lookup($1);
-        //fprintf(stderr, "identifier \"%s\" is defined\n", (char*)$1);
+        //fprintf(stderr, "identifier \"%s\" is defined\n", names->getName($1).c_str());
         if (se == nullptr) {
-            fprintf(stderr, "类型检查错误：变量 \"%s\" 未定义\n", (char*)$1);
-            exit(EXIT_FAILURE);
-            delete [](char*)$1;
+            fprintf(stderr, "类型检查错误：变量 \"%s\" 未定义\n", names->getName($1).c_str());
+            throw CompileError();
             assert(se != nullptr);
         }
         if (se->isConstant()) {
-            fprintf(stderr, "类型检查错误： 不能给给常量\"%s\" 赋值\n", (char*)$1);
-            exit(EXIT_FAILURE);
+            fprintf(stderr, "类型检查错误： 不能给给常量\"%s\" 赋值\n", names->getName($1).c_str());
+            throw CompileError();
         }
         $$ = new Id(se);
-        delete []$1;
     }
     ;
 AssignStmt
@@ -107,13 +118,11 @@ AssignStmt
     ;
 BlockStmt
     :   LBRACE 
-        {identifiers = new SymbolTable(identifiers);} 
+        {identifiers->enterScope();} 
         Stmts RBRACE 
         {
             $$ = new CompoundStmt($3);
-            SymbolTable *top = identifiers;
-            identifiers = identifiers->getPrev();
-            delete top;
+            identifiers->exitScope();
         }
     ;
 IfStmt
@@ -211,7 +220,7 @@ AddExp
             //fprintf(stderr, "右操作数类型: %s\n", rightType->toStr().c_str());
                       if (rightType->isVoid() || leftType->isVoid()) {
             fprintf(stderr, "类型检查错误：赋值为void\n");
-            exit(EXIT_FAILURE);
+            throw CompileError();
             }
         }
         SymbolEntry *se = new TemporarySymbolEntry(TypeSystem::intType, SymbolTable::getLabel());
@@ -404,7 +413,7 @@ Type
         $$ = TypeSystem::boolType;
     }
     /* | CONST Type {
-        $$ = new ConstType($2);
+        $$ = TypeSystem::getConstType($2);
     } */
     | DECIMAL {
         $$ = TypeSystem::decimalType;
@@ -451,8 +460,8 @@ DeclStmtNode
     : ID {  // 不带初始化的声明
         // 检查变量是否已在当前作用域声明
         if (identifiers->checkExist($1)) {
-            fprintf(stderr, "类型检查错误：重定义变量 %s\n", $1);
-            exit(EXIT_FAILURE);
+            fprintf(stderr, "类型检查错误：重定义变量 %s\n", names->getName($1).c_str());
+            throw CompileError();
         }
 
         // 默认类型为 int，如有其他类型需求，可在上层规则中设置
@@ -461,23 +470,21 @@ DeclStmtNode
 
         // 创建声明语句节点
         $$ = new DeclStmt(new Id(se));
-        delete[] $1;
     }
     | ID ASSIGN Exp {  // 带初始化的声明
         // 检查变量是否已在当前作用域声明
         if (identifiers->checkExist($1)) {
-            fprintf(stderr, "类型检查错误：重定义变量 %s\n", $1);
-            exit(EXIT_FAILURE);
+            fprintf(stderr, "类型检查错误：重定义变量 %s\n", names->getName($1).c_str());
+            throw CompileError();
         }
-        if ($3->getType()->isVoid()){fprintf(stderr, "类型检查错误：%s 赋值为void\n", $1);
-            exit(EXIT_FAILURE);};
+        if ($3->getType()->isVoid()){fprintf(stderr, "类型检查错误：%s 赋值为void\n", names->getName($1).c_str());
+            throw CompileError();};
         // 默认类型为 int，如有其他类型需求，可在上层规则中设置
         SymbolEntry* se = new IdentifierSymbolEntry(TypeSystem::intType, $1, identifiers->getLevel());
         identifiers->install($1, se);
 
         // 创建声明和赋值语句节点
         $$ = new DeclStmt(new Id(se), $3);
-        delete[] $1;
     }
     ;
 
@@ -488,21 +495,22 @@ FuncDef
     Type ID LPAREN {
         // 函数类型
         Type *funcType;
-        funcType = new FunctionType($1, vector<Type*>());
+        // 形参类型要等形参列表分析完才知道，先用无参的函数类型登记函数名
+        funcType = TypeSystem::getFunctionType($1, vector<Type*>());
 
         // 创建符号条目，并将函数名加入符号表
         SymbolEntry *se = new IdentifierSymbolEntry(funcType, $2, identifiers->getLevel());
         identifiers->install($2, se);
 
-        // 创建新的符号表用于函数体的局部变量
-        identifiers = new SymbolTable(identifiers);
+        // 进入形参的作用域
+        identifiers->enterScope();
     }
     FuncDefParams RPAREN {
-        identifiers = new SymbolTable(identifiers);
+        identifiers->enterScope();
         DeclStmt* curr = (DeclStmt*)$5;
         while(curr != nullptr)
         {
-            std::string name = ((IdentifierSymbolEntry*)curr->getId()->getSymPtr())->getName();
+            int name = ((IdentifierSymbolEntry*)curr->getId()->getSymPtr())->getNameId();
             SymbolEntry *se = new IdentifierSymbolEntry(curr->getId()->getSymPtr()->getType(), name, identifiers->getLevel());
             identifiers->install(name, se);
             curr = (DeclStmt*)(curr->getNext());
@@ -516,12 +524,12 @@ FuncDef
         {
             if(paramDecl == nullptr)
             {
-                paramDecl = new DeclStmt(new Id(identifiers->lookup(((IdentifierSymbolEntry*)curr->getId()->getSymPtr())->getName())), curr->getId());
+                paramDecl = new DeclStmt(new Id(identifiers->lookup(((IdentifierSymbolEntry*)curr->getId()->getSymPtr())->getNameId())), curr->getId());
                 paramDecl->setIsParam();
             }
             else
             {
-                DeclStmt* newDecl = new DeclStmt(new Id(identifiers->lookup(((IdentifierSymbolEntry*)curr->getId()->getSymPtr())->getName())), curr->getId());
+                DeclStmt* newDecl = new DeclStmt(new Id(identifiers->lookup(((IdentifierSymbolEntry*)curr->getId()->getSymPtr())->getNameId())), curr->getId());
                 newDecl->setIsParam();
                 paramDecl->setNext(newDecl);
             }
@@ -534,22 +542,18 @@ FuncDef
         se = identifiers->lookup($2);
         assert(se != nullptr);
                 
-        // 获取函数类型，并设置参数类型
-        FunctionType* tmp = (FunctionType*)(se->getType());
-        tmp->setParamsType(paramsType);
+        // 类型是唯一化的，不能原地修改，换成带形参类型的函数类型
+        Type *retType = ((FunctionType*)(se->getType()))->getRetType();
+        se->setType(TypeSystem::getFunctionType(retType, paramsType));
         if(paramDecl)
             ((SeqNode*)$8)->addStmtFront(paramDecl);
 
         // 创建函数定义对象，绑定符号条目和代码块
         $$ = new FunctionDef(se,new CompoundStmt($8), (DeclStmt*)$5);
 
-                // 恢复符号表，退出函数体的作用域
-        SymbolTable *top = identifiers;
-        identifiers = identifiers->getPrev();
-        delete top;
-                
-        // 释放函数名的内存
-        delete []$2;
+                // 恢复符号表，退出函数体和形参的作用域
+        for (int i = 0; i < 2; i++)
+            identifiers->exitScope();
     }
     ;
 funcBlock 
@@ -576,14 +580,12 @@ FuncDefParam
         se = new IdentifierSymbolEntry($1, $2, identifiers->getLevel());
         identifiers->install($2, se);
         $$ = new DeclStmt(new Id(se));
-        delete []$2;
     }
     | Type ID ASSIGN Exp {
         SymbolEntry* se;
         se = new IdentifierSymbolEntry($1, $2, identifiers->getLevel());
         identifiers->install($2, se);
         $$ = new DeclStmt(new Id(se), $4);
-        delete []$2;
     }
     ;
 
@@ -593,9 +595,8 @@ FuncCallExp
         se = identifiers->lookup($1);
         if(se == nullptr)
             {
-                fprintf(stderr, "类型检查错误：函数 \"%s\" 未定义\n", (char*)$1);
-                exit(EXIT_FAILURE);
-                delete [](char*)$1;
+                fprintf(stderr, "类型检查错误：函数 \"%s\" 未定义\n", names->getName($1).c_str());
+                throw CompileError();
                 assert(se != nullptr);
             }
     assert(se != nullptr);
@@ -606,7 +607,19 @@ FuncCallExp
 
 %%
 
-int yyerror(char const* message)
+#undef yylex
+static int timedLex(YYSTYPE *lval, yyscan_t scanner)
+{
+    TimeReport *report = TimeReport::current();
+    if (report == nullptr)
+        return yylex(lval, scanner);
+    auto start = TimeReport::clock::now();
+    int token = yylex(lval, scanner);
+    report->addTime("lex", std::chrono::duration<double>(TimeReport::clock::now() - start).count());
+    return token;
+}
+
+int yyerror(yyscan_t, Ast *, char const* message)
 {
     std::cerr<<message<<std::endl;
     return -1;